@@ -0,0 +1,872 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../src/utils/utils.h"
+#include "../src/utils/records.h"
+#include "../src/logger/logger.h"
+#include "../src/calculate/moving_avg.h"
+#include "../src/calculate/correlation.h"
+#include "../src/trace/trace.h"
+#include "../src/sequence/sequence.h"
+#include "../src/reorder/reorder.h"
+#include "../src/book/book.h"
+#include "../src/broadcast/broadcast.h"
+#include "../src/kernels/kernels.h"
+#include "../src/stats/stats.h"
+#include "../src/tsdb/tsdb.h"
+#include "../src/pca/pca.h"
+#include "../src/flow/flow.h"
+#include <pthread.h>
+#include <ftw.h>
+#include <sys/mman.h>
+
+// Offline microbenchmarks for the hot-path functions, no network or services needed
+
+const char* symbols[8] = SYMBOL_NAMES;
+
+#define BENCH_MAX_REPS 1001
+#define BENCH_TARGET_NS 2000000ull     // Each repetition runs for ~2 ms
+#define BENCH_BASE_TS 1717599017123ull
+
+typedef void (*BenchFn)(void* ctx, size_t iters);
+
+static int reps = 31;
+static int warmup = 3;
+static const char* filter = NULL;
+static FILE* csv = NULL;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Calibrates the batch size, warms up, then reports median and p99 ns/op over the repetitions
+static void bench_run(const char* name, const char* params, size_t ops_per_iter, BenchFn fn, void* ctx) {
+    if (filter && !strstr(name, filter)) {
+        return;
+    }
+
+    size_t iters = 1;
+    for (;;) {
+        uint64_t t0 = now_ns();
+        fn(ctx, iters);
+        uint64_t elapsed = now_ns() - t0;
+        if (elapsed >= BENCH_TARGET_NS / 4 || iters >= (1u << 30)) {
+            if (elapsed < BENCH_TARGET_NS) {
+                iters = (size_t)((double)iters * BENCH_TARGET_NS / (elapsed ? elapsed : 1)) + 1;
+            }
+            break;
+        }
+        iters *= 2;
+    }
+
+    for (int w = 0; w < warmup; w++) {
+        fn(ctx, iters);
+    }
+
+    static double samples[BENCH_MAX_REPS];
+    for (int r = 0; r < reps; r++) {
+        uint64_t t0 = now_ns();
+        fn(ctx, iters);
+        samples[r] = (double)(now_ns() - t0) / ((double)iters * ops_per_iter);
+    }
+    qsort(samples, reps, sizeof(double), cmp_double);
+
+    double median = samples[reps / 2];
+    int p99_idx = (int)(0.99 * (reps - 1) + 0.5);
+    double p99 = samples[p99_idx];
+    double ops_per_sec = median > 0 ? 1e9 / median : 0.0;
+
+    fprintf(stderr, "%-24s %-28s %12.1f ns/op  p99 %12.1f ns/op  %14.0f ops/s\n", name, params, median, p99, ops_per_sec);
+    fprintf(csv, "%s,%s,%d,%zu,%.3f,%.3f,%.1f\n", name, params, reps, iters * ops_per_iter, median, p99, ops_per_sec);
+    fflush(csv);
+}
+
+// ---- pearson_correlation ----
+
+typedef struct {
+    double* x;
+    double* y;
+    int n;
+    volatile double sink;
+} PearsonCtx;
+
+static void run_pearson(void* arg, size_t iters) {
+    PearsonCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        c->sink = pearson_correlation(c->x, c->y, c->n);
+    }
+}
+
+static void bench_pearson(void) {
+    const int sizes[] = {8, 64, 512, 4096};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        PearsonCtx c = {.n = sizes[s]};
+        c.x = malloc(c.n * sizeof(double));
+        c.y = malloc(c.n * sizeof(double));
+        for (int i = 0; i < c.n; i++) {
+            c.x[i] = 42000.0 + (rand() % 1000) / 10.0;
+            c.y[i] = 2200.0 + (rand() % 1000) / 100.0;
+        }
+
+        char params[64];
+        snprintf(params, sizeof(params), "window=%d", c.n);
+        bench_run("pearson_correlation", params, 1, run_pearson, &c);
+        free(c.x);
+        free(c.y);
+    }
+}
+
+// ---- statistics kernels ----
+
+typedef struct {
+    const KernelOps* ops;
+    double* x;
+    double* y;
+    size_t n;
+    int series;
+    double* matrix;
+    volatile double sink;
+} KernelCtx;
+
+static double naive_sum(const double* x, size_t n) {
+    double s = 0.0;
+    for (size_t i = 0; i < n; i++) s += x[i];
+    return s;
+}
+
+static double naive_dot(const double* x, const double* y, size_t n) {
+    double s = 0.0;
+    for (size_t i = 0; i < n; i++) s += x[i] * y[i];
+    return s;
+}
+
+static double naive_sum_sq(const double* x, size_t n) {
+    return naive_dot(x, x, n);
+}
+
+// Plain single-accumulator loops, the baseline the kernel timings are compared with
+static const KernelOps naive_ops = {"naive", naive_sum, naive_sum_sq, naive_dot, NULL};
+
+static double rel_error(double got, double want) {
+    return fabs(got - want) / (fabs(want) > 1e-300 ? fabs(want) : 1.0);
+}
+
+// Every variant has to agree with the scalar references before its timings mean anything
+static int check_kernels(const KernelOps* ops) {
+    const size_t sizes[] = {0, 1, 3, 7, 8, 15, 16, 33, 1000, 4099};
+    double worst = 0.0;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        size_t n = sizes[s];
+        double* x = malloc((n + 1) * sizeof(double));
+        double* y = malloc((n + 1) * sizeof(double));
+        for (size_t i = 0; i < n; i++) {
+            x[i] = 64000.0 + (rand() % 100000) / 100.0;
+            y[i] = (rand() % 100000) / 10000.0;
+        }
+        double e = rel_error(ops->sum(x, n), naive_sum(x, n));
+        e = fmax(e, rel_error(ops->sum_sq(y, n), naive_dot(y, y, n)));
+        e = fmax(e, rel_error(ops->dot(x, y, n), naive_dot(x, y, n)));
+        worst = fmax(worst, e);
+        free(x);
+        free(y);
+    }
+
+    // Correlated price-like series, compared pairwise against pearson_correlation
+    double worst_corr = 0.0;
+    const int lengths[] = {8, 64, 777};
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        int n = lengths[l], series = 8;
+        double* x = malloc((size_t)n * series * sizeof(double));
+        double col_x[777], col_y[777], matrix[64];
+        double walk = 0.0;
+        for (int t = 0; t < n; t++) {
+            walk += (rand() % 200 - 100) / 100.0;
+            for (int c = 0; c < series; c++) {
+                x[t * series + c] = (c + 1) * 1000.0 + walk * (c % 3 - 1) + (rand() % 100) / 50.0;
+            }
+        }
+        ops->pearson_matrix(x, series, (size_t)n, matrix);
+        for (int a = 0; a < series; a++) {
+            for (int b = 0; b < series; b++) {
+                for (int t = 0; t < n; t++) {
+                    col_x[t] = x[t * series + a];
+                    col_y[t] = x[t * series + b];
+                }
+                worst_corr = fmax(worst_corr, fabs(matrix[a * series + b] - pearson_correlation(col_x, col_y, n)));
+            }
+        }
+        free(x);
+    }
+
+    // The one-pass reference itself loses ~1e-8 on low-variance columns at price level, the kernels centre first
+    fprintf(stderr, "kernels %-8s max rel error sums %.2e, max abs error correlation %.2e\n", ops->name, worst, worst_corr);
+    return worst < 1e-12 && worst_corr < 1e-6;
+}
+
+static void run_kernel_sum(void* arg, size_t iters) {
+    KernelCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        c->sink = c->ops->sum(c->x, c->n);
+    }
+}
+
+static void run_kernel_dot(void* arg, size_t iters) {
+    KernelCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        c->sink = c->ops->dot(c->x, c->y, c->n);
+    }
+}
+
+static void run_kernel_pearson(void* arg, size_t iters) {
+    KernelCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        c->ops->pearson_matrix(c->x, c->series, c->n, c->matrix);
+    }
+}
+
+// Pairwise scalar reference for the same matrix, the baseline for pearson_matrix
+static void run_pearson_pairs(void* arg, size_t iters) {
+    KernelCtx* c = arg;
+    double col_x[512], col_y[512];
+    for (size_t i = 0; i < iters; i++) {
+        for (int a = 0; a < c->series; a++) {
+            for (int b = 0; b < c->series; b++) {
+                for (size_t t = 0; t < c->n; t++) {
+                    col_x[t] = c->x[t * c->series + a];
+                    col_y[t] = c->x[t * c->series + b];
+                }
+                c->matrix[a * c->series + b] = pearson_correlation(col_x, col_y, (int)c->n);
+            }
+        }
+    }
+}
+
+static int bench_kernels(void) {
+    const KernelOps* variants[KERNEL_MAX_VARIANTS];
+    int count = kernels_variants(variants);
+    int ok = 1;
+    for (int v = 0; v < count; v++) {
+        if (!check_kernels(variants[v])) {
+            fprintf(stderr, "kernels %s disagrees with the scalar reference\n", variants[v]->name);
+            ok = 0;
+        }
+    }
+
+    const size_t sizes[] = {1024, 100000};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        KernelCtx c = {.n = sizes[s]};
+        c.x = malloc(c.n * sizeof(double));
+        c.y = malloc(c.n * sizeof(double));
+        for (size_t i = 0; i < c.n; i++) {
+            c.x[i] = 64000.0 + (rand() % 1000) / 10.0;
+            c.y[i] = (rand() % 1000) / 100.0;
+        }
+        char params[64];
+        for (int v = -1; v < count; v++) {
+            c.ops = v < 0 ? &naive_ops : variants[v];
+            snprintf(params, sizeof(params), "isa=%s;n=%zu", c.ops->name, c.n);
+            bench_run("kernel_sum", params, 1, run_kernel_sum, &c);
+            bench_run("kernel_dot", params, 1, run_kernel_dot, &c);
+        }
+        free(c.x);
+        free(c.y);
+    }
+
+    const size_t lengths[] = {8, 512};
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        double matrix[64];
+        KernelCtx c = {.n = lengths[l], .series = 8, .matrix = matrix};
+        c.x = malloc(c.n * c.series * sizeof(double));
+        for (size_t i = 0; i < c.n * c.series; i++) {
+            c.x[i] = 42000.0 + (rand() % 1000) / 10.0;
+        }
+        char params[64];
+        snprintf(params, sizeof(params), "isa=pairwise;series=8;n=%zu", c.n);
+        bench_run("pearson_matrix", params, 1, run_pearson_pairs, &c);
+        for (int v = 0; v < count; v++) {
+            c.ops = variants[v];
+            snprintf(params, sizeof(params), "isa=%s;series=8;n=%zu", c.ops->name, c.n);
+            bench_run("pearson_matrix", params, 1, run_kernel_pearson, &c);
+        }
+        free(c.x);
+    }
+    return ok;
+}
+
+// ---- parse_transaction ----
+
+typedef struct {
+    char** messages;
+    size_t* lengths;
+    size_t count;
+    size_t next;
+} ParseCtx;
+
+// Same shape as an OKX v5 "trades" push, one instrument per message
+static size_t build_message(char* buf, size_t cap, const char* symbol, int batch, uint64_t* trade_id, uint64_t* ts) {
+    size_t len = (size_t)snprintf(buf, cap, "{\"arg\":{\"channel\":\"trades\",\"instId\":\"%s\"},\"data\":[", symbol);
+    for (int t = 0; t < batch; t++) {
+        len += (size_t)snprintf(buf + len, cap - len,
+            "%s{\"instId\":\"%s\",\"tradeId\":\"%llu\",\"px\":\"%.1f\",\"sz\":\"%.8f\",\"side\":\"%s\",\"ts\":\"%llu\",\"count\":\"1\"}",
+            t ? "," : "", symbol, (unsigned long long)(*trade_id)++, 64212.1 + (rand() % 200) / 10.0,
+            (rand() % 100000) / 1e6, (rand() & 1) ? "buy" : "sell", (unsigned long long)*ts);
+        *ts += 100;
+    }
+    len += (size_t)snprintf(buf + len, cap - len, "]}");
+    return len;
+}
+
+static void run_parse(void* arg, size_t iters) {
+    ParseCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        parse_transaction(c->messages[c->next], c->lengths[c->next], &trade_queue, now_ns(), 0);
+        if (++c->next == c->count) {
+            // Replaying the same messages would otherwise only exercise the duplicate path
+            c->next = 0;
+            for (int s = 0; s < 8; s++) {
+                seq_reset(&seq_trackers[s]);
+            }
+            reorder_reset();
+        }
+    }
+}
+
+static void reset_histories(void) {
+    for (int i = 0; i < 8; i++) {
+        seq_reset(&seq_trackers[i]);
+        free(symbol_histories[i].trades);
+        free(symbol_histories[i].prices);
+        free(symbol_histories[i].volumes);
+        free(symbol_histories[i].pending);
+        symbol_histories[i] = (SymbolHistory){
+            .trades = NULL,
+            .prices = NULL,
+            .volumes = NULL,
+            .pending = NULL,
+            .mutex = PTHREAD_MUTEX_INITIALIZER,
+        };
+    }
+    reorder_reset();
+}
+
+static void bench_parse(void) {
+    const int batches[] = {1, 4, 16};
+    const int symbol_counts[] = {1, 8};
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        for (size_t s = 0; s < sizeof(symbol_counts) / sizeof(symbol_counts[0]); s++) {
+            reset_histories();
+
+            ParseCtx c = {.count = 1024};
+            c.messages = malloc(c.count * sizeof(char*));
+            c.lengths = malloc(c.count * sizeof(size_t));
+            uint64_t trade_id = 242720720, ts = BENCH_BASE_TS;
+            for (size_t m = 0; m < c.count; m++) {
+                c.messages[m] = malloc(256 + batches[b] * 192);
+                c.lengths[m] = build_message(c.messages[m], 256 + batches[b] * 192, symbols[m % symbol_counts[s]], batches[b], &trade_id, &ts);
+            }
+
+            char params[64];
+            snprintf(params, sizeof(params), "batch=%d;symbols=%d", batches[b], symbol_counts[s]);
+            bench_run("parse_transaction", params, batches[b], run_parse, &c);
+
+            for (size_t m = 0; m < c.count; m++) {
+                free(c.messages[m]);
+            }
+            free(c.messages);
+            free(c.lengths);
+        }
+    }
+    reset_histories();
+}
+
+// ---- queue_push / queue_pop ----
+
+typedef struct {
+    int batch;
+    TradeData trade;
+} QueueCtx;
+
+static void run_queue(void* arg, size_t iters) {
+    QueueCtx* c = arg;
+    TradeData out;
+    for (size_t i = 0; i < iters; i++) {
+        for (int b = 0; b < c->batch; b++) {
+            queue_push(&trade_queue, &c->trade);
+        }
+        for (int b = 0; b < c->batch; b++) {
+            queue_pop(&trade_queue, &out);
+        }
+    }
+}
+
+static void bench_queue(void) {
+    const int batches[] = {1, 64, 1024};
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        QueueCtx c = {.batch = batches[b], .trade = {.symbol = "BTC-USDT", .price = 64212.1, .volume = 0.01, .timestamp = BENCH_BASE_TS}};
+
+        char params[64];
+        snprintf(params, sizeof(params), "batch=%d", batches[b]);
+        bench_run("queue_push_pop", params, 2 * batches[b], run_queue, &c);
+    }
+}
+
+// ---- calculate_moving_avg ----
+
+typedef struct {
+    time_t time_now;
+} MovingAvgCtx;
+
+static void run_moving_avg(void* arg, size_t iters) {
+    MovingAvgCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        calculate_moving_avg(c->time_now);
+    }
+}
+
+static void bench_moving_avg(void) {
+    const size_t windows[] = {1000, 10000, 100000};
+    for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+        reset_histories();
+        MovingAvgCtx c = {.time_now = (time_t)(BENCH_BASE_TS / 1000)};
+
+        // Spread each window evenly across the last 15 minutes so nothing gets purged
+        for (int i = 0; i < 8; i++) {
+            SymbolHistory* h = &symbol_histories[i];
+            for (size_t t = 0; t < windows[w]; t++) {
+                TradeData trade = {
+                    .price = 100.0 + (rand() % 1000) / 10.0,
+                    .volume = (rand() % 1000) / 100.0,
+                    .timestamp = (uint64_t)c.time_now * 1000 - 899000 + t * 899000 / windows[w],
+                };
+                strcpy(trade.symbol, symbols[i]);
+                history_push(h, &trade);
+            }
+        }
+
+        char params[64];
+        snprintf(params, sizeof(params), "window=%zu;symbols=8", windows[w]);
+        bench_run("calculate_moving_avg", params, 1, run_moving_avg, &c);
+    }
+    reset_histories();
+}
+
+// ---- order book updates ----
+
+typedef struct {
+    char** messages;
+    size_t* lengths;
+    size_t count;
+    size_t next;
+} BookCtx;
+
+static OrderBook shadow;
+
+// Adds one level to the message and mirrors it into the shadow book used for checksums
+static size_t book_level(char* buf, size_t len, size_t cap, int first, BookSide* side, int descending, int64_t ticks, int64_t lots) {
+    char px[32], sz[32];
+    snprintf(px, sizeof(px), "%lld.%lld", (long long)(ticks / 10), (long long)(ticks % 10));
+    snprintf(sz, sizeof(sz), "%lld.%04lld", (long long)(lots / 10000), (long long)(lots % 10000));
+
+    BookLevel level;
+    book_parse_fixed(px, &level.px, &level.px_dec);
+    book_parse_fixed(sz, &level.sz, &level.sz_dec);
+    book_set_level(side, &level, descending);
+    return len + (size_t)snprintf(buf + len, cap - len, "%s[\"%s\",\"%s\",\"0\",\"1\"]", first ? "" : ",", px, sz);
+}
+
+// Message 0 is a full snapshot of the given depth, the rest change one random level near the top
+static size_t build_book_message(char* buf, size_t cap, int depth, size_t m) {
+    const int64_t mid = 642121;
+    size_t len = (size_t)snprintf(buf, cap, "{\"arg\":{\"channel\":\"books\",\"instId\":\"BTC-USDT\"},\"action\":\"%s\",\"data\":[{\"asks\":[",
+                                  m == 0 ? "snapshot" : "update");
+    int side = rand() & 1, level = rand() % 25;
+    int64_t lots = (rand() % 4) ? 1 + rand() % 100000 : 0;
+
+    if (m == 0) {
+        shadow.bids.count = shadow.asks.count = 0;
+        for (int i = 0; i < depth; i++) len = book_level(buf, len, cap, i == 0, &shadow.asks, 0, mid + 1 + i, 1 + rand() % 100000);
+    } else if (side) {
+        len = book_level(buf, len, cap, 1, &shadow.asks, 0, mid + 1 + level, lots);
+    }
+    len += (size_t)snprintf(buf + len, cap - len, "],\"bids\":[");
+    if (m == 0) {
+        for (int i = 0; i < depth; i++) len = book_level(buf, len, cap, i == 0, &shadow.bids, 1, mid - 1 - i, 1 + rand() % 100000);
+    } else if (!side) {
+        len = book_level(buf, len, cap, 1, &shadow.bids, 1, mid - 1 - level, lots);
+    }
+    len += (size_t)snprintf(buf + len, cap - len, "],\"ts\":\"%llu\",\"checksum\":%d,\"prevSeqId\":%lld,\"seqId\":%lld}]}",
+                            (unsigned long long)BENCH_BASE_TS, book_checksum(&shadow), m == 0 ? -1ll : (long long)m - 1, (long long)m);
+    return len;
+}
+
+static void run_book(void* arg, size_t iters) {
+    BookCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        parse_transaction(c->messages[c->next], c->lengths[c->next], &trade_queue, now_ns(), 0);
+        c->next = (c->next + 1) % c->count;
+    }
+}
+
+static void bench_book(void) {
+    const int depths[] = {25, 400};
+    for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+        BookCtx c = {.count = 1024};
+        size_t cap = 512 + (size_t)depths[d] * 2 * 48;
+        c.messages = malloc(c.count * sizeof(char*));
+        c.lengths = malloc(c.count * sizeof(size_t));
+        for (size_t m = 0; m < c.count; m++) {
+            c.messages[m] = malloc(cap);
+            c.lengths[m] = build_book_message(c.messages[m], cap, depths[d], m);
+        }
+
+        char params[64];
+        snprintf(params, sizeof(params), "depth=%d;snapshot_every=%zu", depths[d], c.count);
+        bench_run("book_update", params, 1, run_book, &c);
+
+        if (!order_books[0].valid) {
+            fprintf(stderr, "book_update: book failed validation, results measure the resync path\n");
+        }
+        for (size_t m = 0; m < c.count; m++) {
+            free(c.messages[m]);
+        }
+        free(c.messages);
+        free(c.lengths);
+    }
+}
+
+// ---- broadcast_trade ----
+
+typedef struct {
+    TradeData trade;
+    atomic_int stop;
+    uint64_t read;
+} BroadcastCtx;
+
+static void* broadcast_reader_func(void* arg) {
+    BroadcastCtx* c = arg;
+    BroadcastReader r;
+    if (broadcast_reader_open(&r, broadcast_name, 0) != 0) {
+        return NULL;
+    }
+    BroadcastTrade t;
+    while (!atomic_load_explicit(&c->stop, memory_order_relaxed)) {
+        if (broadcast_read_trade(&r, &t) == BROADCAST_READ_OK) {
+            c->read++;
+        }
+    }
+    broadcast_reader_close(&r);
+    return NULL;
+}
+
+static void run_broadcast(void* arg, size_t iters) {
+    BroadcastCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        c->trade.trade_id = i;
+        broadcast_trade((int)(i & 7), &c->trade, i);
+    }
+}
+
+// Publish cost with spinning readers attached, it should not grow with their number
+static void bench_broadcast(void) {
+    snprintf(broadcast_name, sizeof(broadcast_name), "/espx_bench_%d", (int)getpid());
+    if (broadcast_open() != 0) {
+        return;
+    }
+    const int readers[] = {0, 2};
+    for (size_t n = 0; n < sizeof(readers) / sizeof(readers[0]); n++) {
+        BroadcastCtx c = {.trade = {.price = 64212.1, .volume = 0.01, .timestamp = BENCH_BASE_TS}};
+        pthread_t threads[2];
+        for (int r = 0; r < readers[n]; r++) {
+            pthread_create(&threads[r], NULL, broadcast_reader_func, &c);
+        }
+
+        char params[64];
+        snprintf(params, sizeof(params), "readers=%d", readers[n]);
+        bench_run("broadcast_trade", params, 1, run_broadcast, &c);
+
+        atomic_store(&c.stop, 1);
+        for (int r = 0; r < readers[n]; r++) {
+            pthread_join(threads[r], NULL);
+        }
+    }
+    broadcast_close();
+    shm_unlink(broadcast_name);
+}
+
+// ---- online statistics ----
+
+typedef struct {
+    double prices[1024];
+    double volumes[1024];
+    uint64_t ts;
+    uint64_t id;
+} StatsCtx;
+
+static void run_stats(void* arg, size_t iters) {
+    StatsCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        c->ts += (i & 3) == 0;      // Several trades per millisecond, like a busy symbol
+        stats_update((int)(i & 7), c->ts, ++c->id, c->prices[i & 1023], c->volumes[i & 1023]);
+    }
+}
+
+// Per-trade cost of the accumulators and alert checks, to compare against parse_transaction
+static void bench_stats(void) {
+    StatsCtx c = {.ts = BENCH_BASE_TS};
+    double price = 64212.1;
+    for (int i = 0; i < 1024; i++) {
+        price *= 1.0 + (rand() % 201 - 100) * 1e-6;
+        c.prices[i] = price;
+        c.volumes[i] = 0.0001 * (1 + rand() % 10000);
+    }
+    bench_run("stats_update", "symbols=8", 1, run_stats, &c);
+}
+
+// ---- order flow ----
+
+typedef struct {
+    double prices[1024];
+    double volumes[1024];
+    uint64_t ts;
+    FlowWindow window;
+} FlowCtx;
+
+static void run_flow_update(void* arg, size_t iters) {
+    FlowCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        c->ts += (i & 3) == 0;
+        flow_update((int)(i & 7), c->ts, c->prices[i & 1023], c->volumes[i & 1023], (int)(i >> 3) & 1);
+    }
+}
+
+static void run_flow_window(void* arg, size_t iters) {
+    FlowCtx* c = arg;
+    time_t minute = (time_t)(c->ts / 1000) / 60 * 60;
+    for (size_t i = 0; i < iters; i++) {
+        flow_window((int)(i & 7), minute, 900, &c->window);
+    }
+}
+
+// Per-trade cost next to stats_update, and the per-minute read of the longest window
+static void bench_flow(void) {
+    FlowCtx c = {.ts = BENCH_BASE_TS};
+    for (int i = 0; i < 1024; i++) {
+        c.prices[i] = 64212.1 + (rand() % 201 - 100) * 0.1;
+        c.volumes[i] = 0.0001 * (1 + rand() % 10000);
+    }
+    bench_run("flow_update", "symbols=8", 1, run_flow_update, &c);
+    bench_run("flow_window", "seconds=900", 1, run_flow_window, &c);
+}
+
+// ---- time-series store ----
+
+typedef struct {
+    int series;
+    int64_t ts;
+    double value;
+    long visited;
+} TsdbCtx;
+
+static void run_tsdb_append(void* arg, size_t iters) {
+    TsdbCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        c->ts += 60;
+        c->value *= 1.0 + (rand() % 201 - 100) * 1e-6;
+        tsdb_append(c->series, c->ts, c->value);
+        if ((i & 63) == 63) {
+            tsdb_flush();       // The processor flushes once per tick after ~64 appends
+        }
+    }
+}
+
+static int count_point(const TsdbPoint* p, void* ctx) {
+    (void)p;
+    ((TsdbCtx*)ctx)->visited++;
+    return 0;
+}
+
+static void run_tsdb_scan(void* arg, size_t iters) {
+    TsdbCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        tsdb_scan(tsdb_dir, "bench.scan", TSDB_RAW, INT64_MIN, INT64_MAX, count_point, c);
+    }
+}
+
+// Append cost per minute value, and decode cost per point for a month of minutes
+static void bench_tsdb(void) {
+    if (filter && !strstr("tsdb_append tsdb_scan", filter)) {
+        return;
+    }
+    tsdb_open();
+    TsdbCtx c = {.series = tsdb_series("bench.append", 44), .ts = (int64_t)(BENCH_BASE_TS / 1000), .value = 64212.1};
+    bench_run("tsdb_append", "mantissa=44", 1, run_tsdb_append, &c);
+
+    const size_t month = 30 * 24 * 60;
+    TsdbCtx s = {.series = tsdb_series("bench.scan", 44), .ts = (int64_t)(BENCH_BASE_TS / 1000), .value = 64212.1};
+    run_tsdb_append(&s, month);
+    tsdb_flush();
+    bench_run("tsdb_scan", "points=43200", month, run_tsdb_scan, &s);
+    tsdb_close();
+}
+
+// ---- rolling covariance components ----
+
+typedef struct {
+    PcaState state;
+    double* levels;
+    double* beta;
+} PcaCtx;
+
+// One minute of a one-factor market with sector tilts, then the warm-started solve
+static void run_pca(void* arg, size_t iters) {
+    PcaCtx* c = arg;
+    int n = c->state.n;
+    for (size_t i = 0; i < iters; i++) {
+        double market = (rand() % 2001 - 1000) * 1e-6, sector = (rand() % 2001 - 1000) * 5e-7;
+        for (int s = 0; s < n; s++) {
+            double r = c->beta[s] * market + (s % 3 == 0 ? sector : 0.0) + (rand() % 2001 - 1000) * 3e-7;
+            c->levels[s] *= 1.0 + r;
+        }
+        pca_push(&c->state, c->levels);
+        pca_solve(&c->state);
+    }
+}
+
+// Per-minute cost at the repo's 8 symbols and at the 200 the covariance has to scale to
+static void bench_pca(void) {
+    const int sizes[] = {8, 200};
+    for (size_t k = 0; k < sizeof(sizes) / sizeof(sizes[0]); k++) {
+        PcaCtx c;
+        int n = sizes[k];
+        if (pca_init(&c.state, n, PCA_COMPONENTS, PCA_WINDOW) != 0) {
+            return;
+        }
+        c.levels = malloc(n * sizeof(double));
+        c.beta = malloc(n * sizeof(double));
+        for (int s = 0; s < n; s++) {
+            c.levels[s] = 100.0 + s;
+            c.beta[s] = 0.5 + (s % 7) * 0.1;
+        }
+        run_pca(&c, PCA_WINDOW);
+
+        char params[64];
+        snprintf(params, sizeof(params), "symbols=%d window=%d k=%d", n, PCA_WINDOW, PCA_COMPONENTS);
+        bench_run("pca_minute", params, 1, run_pca, &c);
+        pca_free(&c.state);
+        free(c.levels);
+        free(c.beta);
+    }
+}
+
+// ---- logger formatting ----
+
+typedef struct {
+    TradeData trades[64];
+    char line[128];
+} FormatCtx;
+
+static void run_format(void* arg, size_t iters) {
+    FormatCtx* c = arg;
+    for (size_t i = 0; i < iters; i++) {
+        format_trade(c->line, sizeof(c->line), &c->trades[i & 63]);
+    }
+}
+
+static void bench_format(void) {
+    FormatCtx c;
+    for (int i = 0; i < 64; i++) {
+        c.trades[i] = (TradeData){.price = 64212.1 + i, .volume = 0.00011356 * i, .timestamp = BENCH_BASE_TS + i};
+    }
+    bench_run("format_trade", "-", 1, run_format, &c);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-r reps] [-w warmup] [-f filter] [-o results.csv]\n", prog);
+}
+
+static int remove_entry(const char* path, const struct stat* st, int type, struct FTW* ftw) {
+    (void)st;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+int main(int argc, char* argv[]) {
+    const char* out_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:w:f:o:h")) != -1) {
+        switch (opt) {
+            case 'r': reps = atoi(optarg); break;
+            case 'w': warmup = atoi(optarg); break;
+            case 'f': filter = optarg; break;
+            case 'o': out_path = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (reps < 1 || reps > BENCH_MAX_REPS) {
+        fprintf(stderr, "reps must be between 1 and %d\n", BENCH_MAX_REPS);
+        return 1;
+    }
+
+    csv = out_path ? fopen(out_path, "w") : stdout;
+    if (!csv) {
+        perror("Failed to open results file");
+        return 1;
+    }
+
+    // Functions that write output files do so inside a scratch directory
+    char scratch[] = "/tmp/espx_bench_XXXXXX";
+    if (!mkdtemp(scratch) || chdir(scratch) != 0) {
+        perror("Failed to create scratch directory");
+        return 1;
+    }
+
+    srand(42);
+    queue_init(&trade_queue, 4096);
+    for (int i = 0; i < 8; i++) {
+        seq_init(&seq_trackers[i]);
+    }
+    reset_histories();
+    book_init();
+    kernels_init();
+    stats_init();
+    flow_init();
+
+    fprintf(csv, "name,params,reps,ops,median_ns,p99_ns,ops_per_sec\n");
+    bench_pearson();
+    int kernels_ok = bench_kernels();
+    bench_parse();
+    bench_queue();
+    bench_moving_avg();
+    bench_book();
+    bench_broadcast();
+    bench_stats();
+    bench_flow();
+    bench_tsdb();
+    bench_pca();
+    bench_format();
+
+    if (csv != stdout) {
+        fclose(csv);
+    }
+
+    // Depth first so every directory is empty by the time it is removed
+    stats_close();
+    if (chdir("/") != 0 || nftw(scratch, remove_entry, 16, FTW_DEPTH | FTW_PHYS) != 0) {
+        perror("Failed to remove scratch directory");
+    }
+    return kernels_ok ? 0 : 1;
+}
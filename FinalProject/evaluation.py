@@ -1,5 +1,7 @@
 import os
 import re
+import sys
+import subprocess
 import pandas as pd
 import numpy as np
 import matplotlib.pyplot as plt
@@ -15,18 +17,40 @@ MA_DIR = "data/mavg"
 CORR_DIR = "data/corr"
 TIMINGS_LOG = "logs/timings.log"
 CPU_IDLE_LOG = "logs/cpu_idle.log"
+THREAD_CPU_LOG = "logs/thread_cpu.log"
+CORE_CPU_LOG = "logs/core_cpu.log"
+PERF_LOG = "logs/perf_counters.log"
 OUT_DIR = "results"
+ANALYZER = "bin/espx_analyzer"
+TSDB_EXPORT = "bin/espx_tsdb_export"
+ANALYSIS_DIR = f"{OUT_DIR}/analysis"
 os.makedirs(OUT_DIR, exist_ok=True)
 
 re_ma = re.compile(r'^\[(\d+)\],\s*MovingAvg:\s*([0-9.]+)')
 re_tim = re.compile(r'^Start:\s*([0-9:.]+),\s*End:\s*([0-9:.]+),\s*Duration:\s*([0-9.]+)\s*ms')
 re_cpu = re.compile(r'^\[(\d+)\],\s*([0-9.]+)')
+re_thread = re.compile(r'^\[(\d+)\],\s*([^,]+),\s*(\d+),\s*user:\s*([0-9.]+),\s*system:\s*([0-9.]+),\s*voluntary_cs:\s*(\d+),\s*involuntary_cs:\s*(\d+)')
+re_core = re.compile(r'^\[(\d+)\],\s*cpu(\d+),\s*([0-9.]+)')
+re_perf = re.compile(r'^\[(\d+)\],\s*(\w+),\s*cycles:\s*(\S+),\s*instructions:\s*(\S+),\s*cache_misses:\s*(\S+),\s*branch_misses:\s*(\S+)')
+
+# Raw minute series from the compressed store, for runs started with -X that keep no text copy
+def export_series(name):
+    if not os.path.exists(TSDB_EXPORT):
+        return []
+    out = subprocess.run([TSDB_EXPORT, name], capture_output=True, text=True)
+    rows = []
+    for line in out.stdout.splitlines()[1:]:    # After the CSV header
+        parts = line.split(",")
+        if len(parts) == 3:
+            rows.append((int(parts[1]), float(parts[2])))
+    return rows
 
 def load_moving_avg():
     rows = []
     for sym in symbols:
         path = f"{MA_DIR}/{sym}.log"
         if not os.path.exists(path):
+            rows.extend((ts, sym, val) for ts, val in export_series(f"mavg.{sym}"))
             continue
         with open(path, 'r') as f:
             for line in f:
@@ -65,6 +89,15 @@ def load_corr():
     corr_sum = pd.DataFrame(0.0, index=symbols, columns=symbols, dtype=float)
     count = pd.DataFrame(0, index=symbols, columns=symbols, dtype=int)
 
+    # The store keeps each pair once, it counts towards both rows
+    if not any(os.path.isfile(os.path.join(CORR_DIR, f"{s}.log")) for s in symbols):
+        for i, a in enumerate(symbols):
+            for b in symbols[i + 1:]:
+                for _, val in export_series(f"corr.{a}.{b}"):
+                    for x, y in ((a, b), (b, a)):
+                        corr_sum.loc[x, y] += val
+                        count.loc[x, y] += 1
+
     for sym_file in symbols:
         path = os.path.join(CORR_DIR, f"{sym_file}.log")
         if not os.path.isfile(path):
@@ -151,7 +184,11 @@ def plot_heatmap_corr(corr_df):
 
 def load_timings():
     if not os.path.exists(TIMINGS_LOG):
-        return pd.DataFrame()
+        rows = [(datetime.fromtimestamp(ts), datetime.fromtimestamp(ts + ms / 1000.0), ms)
+                for ts, ms in export_series("tick_ms")]
+        if not rows:
+            return pd.DataFrame()
+        return pd.DataFrame(rows, columns=['start','end','duration_ms']).sort_values('start')
     rows = []
     with open(TIMINGS_LOG,'r') as f:
         for line in f:
@@ -189,17 +226,17 @@ def plot_timings(timing_df):
     plt.close()
 
 def load_cpu_idle():
-    if not os.path.exists(CPU_IDLE_LOG):
-        return pd.DataFrame()
-    
     data = []
-    with open(CPU_IDLE_LOG, 'r') as f:
-        for line in f:
-            m = re_cpu.match(line.strip())
-            if m:
-                ts = int(m.group(1))
-                idle_pct = float(m.group(2))
-                data.append((ts, idle_pct))
+    if not os.path.exists(CPU_IDLE_LOG):
+        data = export_series("cpu_idle")
+    else:
+        with open(CPU_IDLE_LOG, 'r') as f:
+            for line in f:
+                m = re_cpu.match(line.strip())
+                if m:
+                    ts = int(m.group(1))
+                    idle_pct = float(m.group(2))
+                    data.append((ts, idle_pct))
     
     if not data:
         return pd.DataFrame()
@@ -226,20 +263,208 @@ def plot_cpu_idle(cpu_df):
     plt.savefig(f"{OUT_DIR}/cpu_idle_histogram.png")
     plt.close()
 
+def load_thread_cpu():
+    if not os.path.exists(THREAD_CPU_LOG):
+        return pd.DataFrame()
+
+    rows = []
+    with open(THREAD_CPU_LOG, 'r') as f:
+        for line in f:
+            m = re_thread.match(line.strip())
+            if m:
+                ts, name, tid, user, system, vcs, ivcs = m.groups()
+                rows.append((int(ts), f"{name.strip()} ({tid})", float(user) + float(system), int(vcs) + int(ivcs)))
+
+    if not rows:
+        return pd.DataFrame()
+
+    df = pd.DataFrame(rows, columns=['timestamp', 'thread', 'cpu_pct', 'ctx_switches'])
+    df['datetime'] = pd.to_datetime(df['timestamp'], unit='s')
+    return df
+
+def plot_thread_cpu(thread_df):
+    if thread_df.empty:
+        print("No per-thread CPU data.")
+        return
+
+    fig, (ax_cpu, ax_cs) = plt.subplots(2, 1, figsize=(12, 8), sharex=True)
+    for thread, group in thread_df.groupby('thread'):
+        ax_cpu.plot(group['datetime'], group['cpu_pct'], label=thread, linewidth=1)
+        ax_cs.plot(group['datetime'], group['ctx_switches'], label=thread, linewidth=1)
+    ax_cpu.set_title("CPU Usage per Thread")
+    ax_cpu.set_ylabel("CPU (%)")
+    ax_cpu.legend(fontsize=8)
+    ax_cs.set_title("Context Switches per Minute")
+    ax_cs.set_ylabel("Switches")
+    ax_cs.set_xlabel("Time")
+    plt.tight_layout()
+    plt.savefig(f"{OUT_DIR}/thread_cpu.png")
+    plt.close()
+
+def load_core_cpu():
+    if not os.path.exists(CORE_CPU_LOG):
+        return pd.DataFrame()
+
+    rows = []
+    with open(CORE_CPU_LOG, 'r') as f:
+        for line in f:
+            m = re_core.match(line.strip())
+            if m:
+                rows.append((int(m.group(1)), int(m.group(2)), float(m.group(3))))
+
+    if not rows:
+        return pd.DataFrame()
+
+    df = pd.DataFrame(rows, columns=['timestamp', 'core', 'busy_pct'])
+    df['datetime'] = pd.to_datetime(df['timestamp'], unit='s')
+    return df.pivot_table(index='datetime', columns='core', values='busy_pct', aggfunc='last').sort_index()
+
+def plot_core_cpu(core_df):
+    if core_df.empty:
+        print("No per-core CPU data.")
+        return
+
+    plt.figure(figsize=(12, 5))
+    for core in core_df.columns:
+        plt.plot(core_df.index, core_df[core], label=f"cpu{core}", linewidth=1)
+    plt.title("Per-Core Utilisation")
+    plt.ylabel("Busy (%)")
+    plt.xlabel("Time")
+    plt.legend(fontsize=8)
+    plt.tight_layout()
+    plt.savefig(f"{OUT_DIR}/core_cpu.png")
+    plt.close()
+
+def load_perf_counters():
+    if not os.path.exists(PERF_LOG):
+        return pd.DataFrame()
+
+    def counter(value):
+        return float(value) if value != "n/a" else np.nan
+
+    rows = []
+    with open(PERF_LOG, 'r') as f:
+        for line in f:
+            m = re_perf.match(line.strip())
+            if m:
+                ts, section, cycles, instr, cache, branch = m.groups()
+                rows.append((int(ts), section, counter(cycles), counter(instr), counter(cache), counter(branch)))
+
+    if not rows:
+        return pd.DataFrame()
+
+    df = pd.DataFrame(rows, columns=['timestamp', 'section', 'cycles', 'instructions', 'cache_misses', 'branch_misses'])
+    df['datetime'] = pd.to_datetime(df['timestamp'], unit='s')
+    df['ipc'] = df['instructions'] / df['cycles']
+    df['cache_mpki'] = df['cache_misses'] / df['instructions'] * 1000.0
+    df['branch_mpki'] = df['branch_misses'] / df['instructions'] * 1000.0
+    return df
+
+def plot_perf_counters(perf_df):
+    if perf_df.empty:
+        print("No hardware counter data.")
+        return
+
+    fig, axes = plt.subplots(3, 1, figsize=(12, 10), sharex=True)
+    for section, group in perf_df.groupby('section'):
+        axes[0].plot(group['datetime'], group['ipc'], label=section, linewidth=1)
+        axes[1].plot(group['datetime'], group['cache_mpki'], label=section, linewidth=1)
+        axes[2].plot(group['datetime'], group['branch_mpki'], label=section, linewidth=1)
+    axes[0].set_title("Instructions per Cycle")
+    axes[1].set_title("Cache Misses per 1k Instructions")
+    axes[2].set_title("Branch Misses per 1k Instructions")
+    axes[2].set_xlabel("Time")
+    for ax in axes:
+        ax.legend(fontsize=8)
+    plt.tight_layout()
+    plt.savefig(f"{OUT_DIR}/perf_counters.png")
+    plt.close()
+
+def run_native_analyzer():
+    if not os.path.exists(ANALYZER):
+        return False
+    subprocess.run([ANALYZER, "-o", ANALYSIS_DIR], check=True)
+    return True
+
+def load_native_moving_avg():
+    path = f"{ANALYSIS_DIR}/mavg.csv"
+    if not os.path.exists(path):
+        return pd.DataFrame()
+    df = pd.read_csv(path)
+    df.index = pd.to_datetime(df.pop('timestamp'), unit='s')
+    df.index.name = 'datetime'
+    return df.dropna(axis=1, how='all')
+
+def load_native_corr():
+    path = f"{ANALYSIS_DIR}/corr.csv"
+    if not os.path.exists(path):
+        return None
+    return pd.read_csv(path, index_col=0).astype(float)
+
+def load_native_timings():
+    path = f"{ANALYSIS_DIR}/timings.csv"
+    if not os.path.exists(path):
+        return pd.DataFrame()
+    df = pd.read_csv(path)
+    today = datetime.utcnow().date().isoformat()
+    df['start'] = pd.to_datetime(today + " " + df['start'], format="%Y-%m-%d %H:%M:%S.%f")
+    return df.sort_values('start')
+
+def load_native_cpu_idle():
+    hist_path = f"{ANALYSIS_DIR}/cpu_idle_hist.csv"
+    summary_path = f"{ANALYSIS_DIR}/cpu_idle_summary.csv"
+    if not os.path.exists(hist_path) or not os.path.exists(summary_path):
+        return pd.DataFrame(), 0.0
+    return pd.read_csv(hist_path), float(pd.read_csv(summary_path)['mean_pct'].iloc[0])
+
+def plot_cpu_idle_hist(hist_df, avg_idle):
+    if hist_df.empty:
+        print("No CPU idle data available.")
+        return
+
+    # Same figure as plot_cpu_idle, built from the analyzer's pre-binned counts
+    centers = (hist_df['bin_lo'] + hist_df['bin_hi']) / 2.0
+    plt.figure(figsize=(10, 5))
+    sns.histplot(x=centers, weights=hist_df['count'], bins=20, kde=True)
+    plt.title("Distribution of CPU Idle Percentage")
+    plt.xlabel("CPU Idle (%)")
+    plt.ylabel("Frequency")
+    plt.axvline(x=avg_idle, color='r', linestyle='--', label=f'Avg: {avg_idle:.2f}%')
+    plt.legend()
+    plt.tight_layout()
+    plt.savefig(f"{OUT_DIR}/cpu_idle_histogram.png")
+    plt.close()
+
 def main():
     print("Evaluating project data...")
 
-    ma_df = load_moving_avg()
-    plot_moving_averages(ma_df)
+    # Parsing is done by the native analyzer when it is built, unless --python is given
+    if "--python" not in sys.argv and run_native_analyzer():
+        plot_moving_averages(load_native_moving_avg())
+        plot_heatmap_corr(load_native_corr())
+        plot_timings(load_native_timings())
+        plot_cpu_idle_hist(*load_native_cpu_idle())
+    else:
+        ma_df = load_moving_avg()
+        plot_moving_averages(ma_df)
+
+        corr_df = load_corr()
+        plot_heatmap_corr(corr_df)
+
+        timing_df = load_timings()
+        plot_timings(timing_df)
+
+        cpu_df = load_cpu_idle()
+        plot_cpu_idle(cpu_df)
 
-    corr_df = load_corr()
-    plot_heatmap_corr(corr_df)
+    thread_df = load_thread_cpu()
+    plot_thread_cpu(thread_df)
 
-    timing_df = load_timings()
-    plot_timings(timing_df)
+    core_df = load_core_cpu()
+    plot_core_cpu(core_df)
 
-    cpu_df = load_cpu_idle()
-    plot_cpu_idle(cpu_df)
+    perf_df = load_perf_counters()
+    plot_perf_counters(perf_df)
 
     print(f"Generated assets in {OUT_DIR}")
 
@@ -0,0 +1,293 @@
+#include "book.h"
+#include "../utils/utils.h"
+#include "../utils/records.h"
+#include "../trace/trace.h"
+#include "../metrics/metrics.h"
+
+OrderBook order_books[8];
+int book_enabled = 0;
+
+static uint32_t crc_table[256];
+
+void book_init(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc_table[i] = c;
+    }
+    for (int i = 0; i < 8; i++) {
+        memset(&order_books[i], 0, sizeof(OrderBook));
+        pthread_mutex_init(&order_books[i].lock, NULL);
+    }
+}
+
+// "64012.3" -> 6401230000000 with 1 decimal, more than 8 decimals or a value past int64 is rejected
+int book_parse_fixed(const char* s, int64_t* value, uint8_t* decimals) {
+    int64_t v = 0;
+    uint8_t dec = 0;
+    int seen_dot = 0;
+
+    for (; *s; s++) {
+        if (*s == '.' && !seen_dot) {
+            seen_dot = 1;
+        } else if (*s >= '0' && *s <= '9') {
+            if (seen_dot && ++dec > BOOK_MAX_DECIMALS) return -1;
+            if (v > (INT64_MAX - 9) / 10) return -1;
+            v = v * 10 + (*s - '0');
+        } else {
+            return -1;
+        }
+    }
+    for (int d = dec; d < BOOK_MAX_DECIMALS; d++) {
+        if (v > (INT64_MAX - 9) / 10) return -1;
+        v *= 10;
+    }
+    *value = v;
+    *decimals = dec;
+    return 0;
+}
+
+// Inverse of book_parse_fixed, hand rolled since the checksum formats 100 numbers per update
+static int format_fixed(char* buf, int64_t v, uint8_t dec) {
+    char tmp[24];
+    int n = 0;
+    uint64_t u = (uint64_t)v;
+    for (int d = dec; d < BOOK_MAX_DECIMALS; d++) {
+        u /= 10;
+    }
+    for (int d = 0; d < dec; d++) {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    }
+    if (dec > 0) {
+        tmp[n++] = '.';
+    }
+    do {
+        tmp[n++] = (char)('0' + u % 10);
+        u /= 10;
+    } while (u);
+
+    for (int i = 0; i < n; i++) {
+        buf[i] = tmp[n - 1 - i];
+    }
+    return n;
+}
+
+// Binary search, sets *pos to the match or the insertion point
+static int find_level(const BookSide* side, int64_t px, int descending, int* pos) {
+    int lo = 0, hi = side->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int64_t p = side->levels[mid].px;
+        if (p == px) {
+            *pos = mid;
+            return 1;
+        }
+        if (descending ? p > px : p < px) lo = mid + 1;
+        else hi = mid;
+    }
+    *pos = lo;
+    return 0;
+}
+
+// Size zero removes the level; a full side drops its worst level to make room
+void book_set_level(BookSide* side, const BookLevel* level, int descending) {
+    int pos;
+    int found = find_level(side, level->px, descending, &pos);
+
+    if (level->sz == 0) {
+        if (found) {
+            memmove(&side->levels[pos], &side->levels[pos + 1], (size_t)(side->count - pos - 1) * sizeof(BookLevel));
+            side->count--;
+        }
+        return;
+    }
+    if (found) {
+        side->levels[pos] = *level;
+        return;
+    }
+    if (side->count == BOOK_MAX_LEVELS) {
+        if (pos == BOOK_MAX_LEVELS) return;
+        side->count--;
+    }
+    memmove(&side->levels[pos + 1], &side->levels[pos], (size_t)(side->count - pos) * sizeof(BookLevel));
+    side->levels[pos] = *level;
+    side->count++;
+}
+
+// CRC32 of "bid1px:bid1sz:ask1px:ask1sz:..." over the top 25 levels, as OKX computes it
+int32_t book_checksum(const OrderBook* book) {
+    char buf[BOOK_CHECKSUM_LEVELS * 2 * 48];
+    size_t len = 0;
+    for (int i = 0; i < BOOK_CHECKSUM_LEVELS; i++) {
+        const BookLevel* sides[2] = {
+            i < book->bids.count ? &book->bids.levels[i] : NULL,
+            i < book->asks.count ? &book->asks.levels[i] : NULL,
+        };
+        for (int s = 0; s < 2; s++) {
+            if (!sides[s]) continue;
+            len += (size_t)format_fixed(buf + len, sides[s]->px, sides[s]->px_dec);
+            buf[len++] = ':';
+            len += (size_t)format_fixed(buf + len, sides[s]->sz, sides[s]->sz_dec);
+            buf[len++] = ':';
+        }
+    }
+    if (len > 0) len--;     // No trailing separator
+
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc = crc_table[(crc ^ (uint8_t)buf[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return (int32_t)(crc ^ 0xFFFFFFFFu);
+}
+
+static int apply_side(BookSide* side, cJSON* levels, int descending) {
+    cJSON* level = NULL;
+    cJSON_ArrayForEach(level, levels) {
+        cJSON* px = cJSON_GetArrayItem(level, 0);
+        cJSON* sz = cJSON_GetArrayItem(level, 1);
+        BookLevel l;
+        if (!cJSON_IsString(px) || !cJSON_IsString(sz) ||
+            book_parse_fixed(px->valuestring, &l.px, &l.px_dec) != 0 ||
+            book_parse_fixed(sz->valuestring, &l.sz, &l.sz_dec) != 0) {
+            return -1;
+        }
+        book_set_level(side, &l, descending);
+    }
+    return 0;
+}
+
+static void update_features(OrderBook* book) {
+    if (book->bids.count == 0 || book->asks.count == 0) {
+        return;
+    }
+    int64_t bid = book->bids.levels[0].px;
+    int64_t ask = book->asks.levels[0].px;
+    book->mid = (double)(bid + ask) / 2.0 / BOOK_SCALE;
+    book->spread = (double)(ask - bid) / BOOK_SCALE;
+
+    double bid_sz = 0.0, ask_sz = 0.0;
+    for (int i = 0; i < BOOK_IMBALANCE_LEVELS; i++) {
+        if (i < book->bids.count) bid_sz += (double)book->bids.levels[i].sz;
+        if (i < book->asks.count) ask_sz += (double)book->asks.levels[i].sz;
+    }
+    book->imbalance = (bid_sz + ask_sz) > 0.0 ? (bid_sz - ask_sz) / (bid_sz + ask_sz) : 0.0;
+
+    book->spread_sum += book->spread;
+    book->imbalance_sum += book->imbalance;
+    book->updates++;
+}
+
+// Drops the book until a fresh snapshot arrives and queues an unsubscribe/subscribe round trip
+static void invalidate(OrderBook* book, int symbol) {
+    book->valid = 0;
+    int expected = BOOK_RESYNC_NONE;
+    atomic_compare_exchange_strong(&book->resync, &expected, BOOK_RESYNC_UNSUBSCRIBE);
+    metrics_add_symbol(SYMBOL_METRIC_BOOK_MISMATCHES, symbol, 1);
+}
+
+// One "books" push: snapshot or incremental update for a single instrument
+void book_handle(cJSON* json, uint64_t recv_ns) {
+    cJSON* arg = cJSON_GetObjectItem(json, "arg");
+    cJSON* inst = arg ? cJSON_GetObjectItem(arg, "instId") : NULL;
+    cJSON* action = cJSON_GetObjectItem(json, "action");
+    cJSON* data = cJSON_GetArrayItem(cJSON_GetObjectItem(json, "data"), 0);
+    int symbol = cJSON_IsString(inst) ? symbol_index(inst->valuestring) : -1;
+    if (symbol < 0 || !cJSON_IsString(action) || !cJSON_IsObject(data)) {
+        return;
+    }
+
+    OrderBook* book = &order_books[symbol];
+    cJSON* seq = cJSON_GetObjectItem(data, "seqId");
+    cJSON* prev = cJSON_GetObjectItem(data, "prevSeqId");
+    cJSON* checksum = cJSON_GetObjectItem(data, "checksum");
+    cJSON* ts = cJSON_GetObjectItem(data, "ts");
+    int snapshot = strcmp(action->valuestring, "snapshot") == 0;
+
+    pthread_mutex_lock(&book->lock);
+    if (snapshot) {
+        book->bids.count = book->asks.count = 0;
+        book->valid = 1;
+    } else if (!book->valid) {
+        pthread_mutex_unlock(&book->lock);
+        return;             // Waiting for the resubscribe snapshot
+    } else if (cJSON_IsNumber(prev) && (int64_t)prev->valuedouble != book->seq_id) {
+        invalidate(book, symbol);
+        pthread_mutex_unlock(&book->lock);
+        return;
+    }
+
+    if (apply_side(&book->bids, cJSON_GetObjectItem(data, "bids"), 1) != 0 ||
+        apply_side(&book->asks, cJSON_GetObjectItem(data, "asks"), 0) != 0 ||
+        (cJSON_IsNumber(checksum) && book_checksum(book) != (int32_t)checksum->valuedouble)) {
+        invalidate(book, symbol);
+        pthread_mutex_unlock(&book->lock);
+        return;
+    }
+
+    book->seq_id = cJSON_IsNumber(seq) ? (int64_t)seq->valuedouble : book->seq_id;
+    book->ts = cJSON_IsString(ts) ? strtoull(ts->valuestring, NULL, 10) : book->ts;
+    update_features(book);
+    pthread_mutex_unlock(&book->lock);
+
+    metrics_add_symbol(SYMBOL_METRIC_BOOK_UPDATES, symbol, 1);
+    if (trace_should_sample()) {
+        trace_record(TRACE_BOOK, trace_now_ns() - recv_ns);
+    }
+}
+
+int book_resync_pending(void) {
+    for (int i = 0; i < 8; i++) {
+        if (atomic_load(&order_books[i].resync) != BOOK_RESYNC_NONE) return 1;
+    }
+    return 0;
+}
+
+// Next resync request to send, one websocket frame per call, 0 when nothing is pending
+size_t book_resync_message(char* buf, size_t cap) {
+    for (int i = 0; i < 8; i++) {
+        int step = atomic_load(&order_books[i].resync);
+        if (step == BOOK_RESYNC_NONE) continue;
+
+        atomic_store(&order_books[i].resync, step == BOOK_RESYNC_UNSUBSCRIBE ? BOOK_RESYNC_SUBSCRIBE : BOOK_RESYNC_NONE);
+        return (size_t)snprintf(buf, cap, "{\"op\":\"%s\",\"args\":[{\"channel\":\"books\",\"instId\":\"%s\"}]}",
+                                step == BOOK_RESYNC_UNSUBSCRIBE ? "unsubscribe" : "subscribe", symbols[i]);
+    }
+    return 0;
+}
+
+// Called by the processor once per tick with the features accumulated since the previous call
+void book_publish(time_t minute) {
+    struct stat st = {0};
+    if (stat("data", &st) == -1) mkdir("data", 0755);
+    if (stat(BOOK_DIR, &st) == -1) mkdir(BOOK_DIR, 0755);
+
+    for (int i = 0; i < 8; i++) {
+        OrderBook* book = &order_books[i];
+        pthread_mutex_lock(&book->lock);
+        if (book->updates == 0) {
+            pthread_mutex_unlock(&book->lock);
+            continue;
+        }
+
+        // Copied out so book_handle never waits for the disk
+        double mid = book->mid, spread = book->spread, imbalance = book->imbalance;
+        double spread_mean = book->spread_sum / book->updates;
+        double imbalance_mean = book->imbalance_sum / book->updates;
+        uint64_t updates = book->updates;
+        book->spread_sum = book->imbalance_sum = 0.0;
+        book->updates = 0;
+        pthread_mutex_unlock(&book->lock);
+
+        char filename[128];
+        snprintf(filename, sizeof(filename), BOOK_DIR "/%s.log", symbols[i]);
+        FILE* file = fopen(filename, "a");
+        if (file) {
+            fprintf(file, BOOK_RECORD_FMT, (unsigned long long)minute, mid, spread, imbalance,
+                    spread_mean, imbalance_mean, (unsigned long long)updates);
+            fclose(file);
+        }
+    }
+}
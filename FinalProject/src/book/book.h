@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <cjson/cJSON.h>
+
+#define BOOK_MAX_LEVELS 400         // Depth of the OKX "books" channel
+#define BOOK_CHECKSUM_LEVELS 25     // Levels per side covered by OKX's checksum
+#define BOOK_IMBALANCE_LEVELS 5
+#define BOOK_MAX_DECIMALS 8
+#define BOOK_SCALE 100000000LL      // Prices and sizes held as 1e-8 fixed point
+
+typedef struct {
+    int64_t px;
+    int64_t sz;
+    uint8_t px_dec;     // Decimals as received, the checksum is computed over the original strings
+    uint8_t sz_dec;
+} BookLevel;
+
+// Sorted contiguous levels, best price first
+typedef struct {
+    BookLevel levels[BOOK_MAX_LEVELS];
+    int count;
+} BookSide;
+
+typedef enum {
+    BOOK_RESYNC_NONE,
+    BOOK_RESYNC_UNSUBSCRIBE,
+    BOOK_RESYNC_SUBSCRIBE,
+} BookResync;
+
+typedef struct {
+    pthread_mutex_t lock;
+    BookSide bids;
+    BookSide asks;
+    int64_t seq_id;
+    uint64_t ts;
+    int valid;              // Cleared on a checksum or seqId mismatch until the next snapshot
+    atomic_int resync;      // BookResync step still to be sent
+
+    // Features from the last update and their sums since the last publish
+    double mid;
+    double spread;
+    double imbalance;
+    double spread_sum;
+    double imbalance_sum;
+    uint64_t updates;
+} OrderBook;
+
+extern OrderBook order_books[8];
+extern int book_enabled;
+
+void    book_init(void);
+int     book_parse_fixed(const char* s, int64_t* value, uint8_t* decimals);
+void    book_set_level(BookSide* side, const BookLevel* level, int descending);
+int32_t book_checksum(const OrderBook* book);
+void    book_handle(cJSON* json, uint64_t recv_ns);
+int     book_resync_pending(void);
+size_t  book_resync_message(char* buf, size_t cap);
+void    book_publish(time_t minute);
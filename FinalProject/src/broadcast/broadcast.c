@@ -0,0 +1,175 @@
+#include "broadcast.h"
+#include "../utils/utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Shared-memory broadcast of the trade stream and the per-minute results. Publishing is a slot
+// claim, two sequence stores and a copy, independent of how many readers are attached; readers
+// poll the slot they expect next, so they never write to the region and only touch the ring
+// heads when they need to resynchronise after an overrun. The trade ring is also the query
+// server's record of recent trades, so without a name it is still kept, in private memory.
+
+char broadcast_name[64] = BROADCAST_NAME;   // Empty string keeps the region private to the process
+
+static BroadcastHeader* region = NULL;
+static BroadcastTradeSlot* trade_slots = NULL;
+static BroadcastMinuteSlot* minute_slots = NULL;
+
+// k-th trade of a symbol at ring position pos, seq is k+1 once pos is stored and 0 while it is written
+typedef struct {
+    atomic_uint_fast64_t seq;
+    atomic_uint_fast64_t pos;
+} IndexEntry;
+
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t head;
+    IndexEntry entries[BROADCAST_INDEX_SLOTS];
+} SymbolIndex;
+
+static SymbolIndex trade_index[8];
+
+int broadcast_open(void) {
+    void* p;
+    if (broadcast_name[0] == '\0') {
+        p = mmap(NULL, broadcast_region_size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    } else {
+        int fd = shm_open(broadcast_name, O_CREAT | O_RDWR, 0644);
+        if (fd < 0 || ftruncate(fd, (off_t)broadcast_region_size()) < 0) {
+            perror("broadcast shm_open");
+            if (fd >= 0) close(fd);
+            return -1;
+        }
+        p = mmap(NULL, broadcast_region_size(), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    if (p == MAP_FAILED) {
+        perror("broadcast mmap");
+        return -1;
+    }
+
+    // Stale sequence numbers from a previous run would validate against the restarted positions
+    BroadcastHeader* h = p;
+    atomic_store(&h->writer_active, 0);
+    broadcast_locate(h, &trade_slots, &minute_slots);
+    memset(trade_slots, 0, BROADCAST_TRADE_SLOTS * sizeof(BroadcastTradeSlot));
+    memset(minute_slots, 0, BROADCAST_MINUTE_SLOTS * sizeof(BroadcastMinuteSlot));
+    atomic_store(&h->trade_head, 0);
+    atomic_store(&h->minute_head, 0);
+    memset(trade_index, 0, sizeof(trade_index));
+
+    h->magic = BROADCAST_MAGIC;
+    h->version = BROADCAST_VERSION;
+    h->symbol_count = 8;
+    h->trade_slots = BROADCAST_TRADE_SLOTS;
+    h->minute_slots = BROADCAST_MINUTE_SLOTS;
+    for (int i = 0; i < 8; i++) {
+        strncpy(h->symbols[i], symbols[i], sizeof(h->symbols[i]) - 1);
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    h->epoch = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    atomic_store(&h->writer_active, 1);
+
+    region = h;
+    if (broadcast_name[0]) {
+        printf("Broadcasting trades and minute results on /dev/shm%s\n", broadcast_name);
+    }
+    return 0;
+}
+
+// The region is left in place so attached readers can drain it, the next writer reinitialises it
+void broadcast_close(void) {
+    if (!region) {
+        return;
+    }
+    atomic_store(&region->writer_active, 0);
+    munmap(region, broadcast_region_size());
+    region = NULL;
+}
+
+// Dual feeds publish from two threads, so slots are claimed with fetch_add rather than a plain store
+void broadcast_trade(int symbol, const TradeData* trade, uint64_t recv_ns) {
+    if (!region) {
+        return;
+    }
+    uint64_t pos = atomic_fetch_add_explicit(&region->trade_head, 1, memory_order_relaxed);
+    BroadcastTradeSlot* slot = &trade_slots[pos & (BROADCAST_TRADE_SLOTS - 1)];
+    atomic_store_explicit(&slot->seq, 2 * pos + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->trade = (BroadcastTrade){
+        .symbol = (uint32_t)symbol, .timestamp = trade->timestamp, .trade_id = trade->trade_id,
+        .price = trade->price, .volume = trade->volume, .recv_ns = recv_ns};
+    atomic_store_explicit(&slot->seq, 2 * pos + 2, memory_order_release);
+
+    SymbolIndex* ix = &trade_index[symbol];
+    uint64_t k = atomic_fetch_add_explicit(&ix->head, 1, memory_order_relaxed);
+    IndexEntry* e = &ix->entries[k & (BROADCAST_INDEX_SLOTS - 1)];
+    atomic_store_explicit(&e->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&e->pos, pos, memory_order_relaxed);
+    atomic_store_explicit(&e->seq, k + 1, memory_order_release);
+}
+
+uint64_t broadcast_symbol_head(int symbol) {
+    return region ? atomic_load_explicit(&trade_index[symbol].head, memory_order_acquire) : 0;
+}
+
+int broadcast_symbol_trade(int symbol, uint64_t k, BroadcastTrade* out) {
+    if (!region) {
+        return -1;
+    }
+    SymbolIndex* ix = &trade_index[symbol];
+    if (atomic_load_explicit(&ix->head, memory_order_acquire) - k > BROADCAST_INDEX_SLOTS) {
+        return -1;
+    }
+    IndexEntry* e = &ix->entries[k & (BROADCAST_INDEX_SLOTS - 1)];
+    uint64_t seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+    if (seq != k + 1) {
+        return seq > k + 1 ? -1 : 0;
+    }
+    uint64_t pos = atomic_load_explicit(&e->pos, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&e->seq, memory_order_relaxed) != k + 1) {
+        return -1;
+    }
+
+    // Ring positions are shared by all symbols, a quiet symbol's can be lapped before its index is
+    BroadcastTradeSlot* slot = &trade_slots[pos & (BROADCAST_TRADE_SLOTS - 1)];
+    uint64_t s1 = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (s1 != 2 * pos + 2) {
+        return s1 > 2 * pos + 2 ? -1 : 0;
+    }
+    *out = slot->trade;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->seq, memory_order_relaxed) == 2 * pos + 2 ? 1 : -1;
+}
+
+// Only the processor publishes minute records
+static void publish_minute(const BroadcastMinute* m) {
+    if (!region) {
+        return;
+    }
+    uint64_t pos = atomic_load_explicit(&region->minute_head, memory_order_relaxed);
+    BroadcastMinuteSlot* slot = &minute_slots[pos & (BROADCAST_MINUTE_SLOTS - 1)];
+    atomic_store_explicit(&slot->seq, 2 * pos + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->minute = *m;
+    atomic_store_explicit(&slot->seq, 2 * pos + 2, memory_order_release);
+    atomic_store_explicit(&region->minute_head, pos + 1, memory_order_release);
+}
+
+void broadcast_average(int symbol, time_t minute, double ma, double vwap, uint64_t trades) {
+    publish_minute(&(BroadcastMinute){.kind = BROADCAST_AVERAGE, .symbol = (uint32_t)symbol,
+                                      .minute = (uint64_t)minute, .ma = ma, .vwap = vwap, .trades = trades});
+}
+
+void broadcast_correlation(int symbol, time_t minute, const double* row) {
+    BroadcastMinute m = {.kind = BROADCAST_CORRELATION, .symbol = (uint32_t)symbol, .minute = (uint64_t)minute};
+    memcpy(m.corr, row, sizeof(m.corr));
+    publish_minute(&m);
+}
+
+void broadcast_minute_done(time_t minute) {
+    publish_minute(&(BroadcastMinute){.kind = BROADCAST_MINUTE_DONE, .minute = (uint64_t)minute});
+}
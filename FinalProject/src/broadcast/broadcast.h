@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#define BROADCAST_NAME "/espx_feed"         // shm_open name, the region lives at /dev/shm/espx_feed
+#define BROADCAST_MAGIC 0x5453414344414F52ull
+#define BROADCAST_VERSION 1
+#define BROADCAST_TRADE_SLOTS 65536         // Powers of two
+#define BROADCAST_MINUTE_SLOTS 1024
+#define BROADCAST_INDEX_SLOTS 4096          // Newest ring positions remembered per symbol, power of two
+
+// Region layout: header, trade ring, minute ring. Every slot carries a sequence number that is
+// 2*pos+1 while the record at ring position pos is being written and 2*pos+2 once it is complete,
+// so readers validate a copy without any writer-side knowledge of them.
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t symbol_count;
+    uint32_t trade_slots;
+    uint32_t minute_slots;
+    char symbols[8][16];
+    uint64_t epoch;                         // Changes every time a writer (re)initialises the region
+    atomic_int writer_active;
+    uint32_t reserved;
+    _Alignas(64) atomic_uint_fast64_t trade_head;
+    _Alignas(64) atomic_uint_fast64_t minute_head;
+} BroadcastHeader;
+
+typedef struct {
+    uint32_t symbol;
+    uint32_t reserved;
+    uint64_t timestamp;                     // Exchange time, ms
+    uint64_t trade_id;
+    double price;
+    double volume;
+    uint64_t recv_ns;                       // Monotonic receive time on the publisher
+} BroadcastTrade;
+
+typedef enum {
+    BROADCAST_AVERAGE = 1,                  // ma, vwap, trades of one symbol
+    BROADCAST_CORRELATION,                  // corr row of one symbol
+    BROADCAST_MINUTE_DONE,                  // Every record of `minute` has been published
+} BroadcastKind;
+
+typedef struct {
+    uint32_t kind;
+    uint32_t symbol;
+    uint64_t minute;                        // Unix seconds of the minute boundary
+    double ma;
+    double vwap;
+    uint64_t trades;
+    double corr[8];
+} BroadcastMinute;
+
+// Cache line aligned so a slot being written never shares a line with the one a reader polls
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t seq;
+    BroadcastTrade trade;
+} BroadcastTradeSlot;
+
+typedef struct {
+    _Alignas(64) atomic_uint_fast64_t seq;
+    BroadcastMinute minute;
+} BroadcastMinuteSlot;
+
+typedef enum {
+    BROADCAST_READ_OK,
+    BROADCAST_READ_EMPTY,                   // Nothing new yet
+    BROADCAST_READ_OVERRUN,                 // Reader fell a lap behind, cursor moved to the oldest record
+    BROADCAST_READ_RESTARTED,               // Writer reinitialised the region, cursor moved to its start
+} BroadcastRead;
+
+typedef struct {
+    BroadcastHeader* header;
+    BroadcastTradeSlot* trades;
+    BroadcastMinuteSlot* minutes;
+    size_t map_size;
+    uint64_t epoch;
+    uint64_t trade_pos;
+    uint64_t minute_pos;
+    uint64_t trades_lost;                   // Records skipped by overruns
+    uint64_t minutes_lost;
+} BroadcastReader;
+
+typedef struct TradeData TradeData;
+
+extern char broadcast_name[64];
+
+// Publisher side, no-ops until broadcast_open succeeds
+int  broadcast_open(void);
+void broadcast_close(void);
+void broadcast_trade(int symbol, const TradeData* trade, uint64_t recv_ns);
+void broadcast_average(int symbol, time_t minute, double ma, double vwap, uint64_t trades);
+void broadcast_correlation(int symbol, time_t minute, const double* row);
+void broadcast_minute_done(time_t minute);
+
+// In-process readers of the trade ring: the query server walks one symbol's trades back from its
+// newest through a private index of ring positions. broadcast_symbol_trade returns 1 with the trade,
+// 0 while it is still being written and -1 once it, and every older one, is gone
+uint64_t broadcast_symbol_head(int symbol);
+int      broadcast_symbol_trade(int symbol, uint64_t k, BroadcastTrade* out);
+
+// Region geometry shared by both sides
+size_t broadcast_region_size(void);
+void   broadcast_locate(BroadcastHeader* h, BroadcastTradeSlot** trades, BroadcastMinuteSlot** minutes);
+
+// Reader side (broadcast_reader.c), for consumers in other processes. OVERRUN and RESTARTED
+// carry no record, the cursor has been moved and the next call continues from there
+int  broadcast_reader_open(BroadcastReader* r, const char* name, int from_oldest);
+void broadcast_reader_close(BroadcastReader* r);
+BroadcastRead broadcast_read_trade(BroadcastReader* r, BroadcastTrade* out);
+BroadcastRead broadcast_read_minute(BroadcastReader* r, BroadcastMinute* out);
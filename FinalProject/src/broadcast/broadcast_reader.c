@@ -0,0 +1,115 @@
+#include "broadcast.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Reader side of the broadcast region, kept free of pipeline dependencies so other processes
+// can build it alongside broadcast.h on its own
+
+size_t broadcast_region_size(void) {
+    return sizeof(BroadcastHeader) + BROADCAST_TRADE_SLOTS * sizeof(BroadcastTradeSlot)
+         + BROADCAST_MINUTE_SLOTS * sizeof(BroadcastMinuteSlot);
+}
+
+void broadcast_locate(BroadcastHeader* h, BroadcastTradeSlot** trades, BroadcastMinuteSlot** minutes) {
+    *trades = (BroadcastTradeSlot*)(h + 1);
+    *minutes = (BroadcastMinuteSlot*)(*trades + BROADCAST_TRADE_SLOTS);
+}
+
+int broadcast_reader_open(BroadcastReader* r, const char* name, int from_oldest) {
+    *r = (BroadcastReader){0};
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < broadcast_region_size()) {
+        close(fd);
+        return -1;
+    }
+    void* p = mmap(NULL, broadcast_region_size(), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return -1;
+    }
+
+    BroadcastHeader* h = p;
+    if (h->magic != BROADCAST_MAGIC || h->version != BROADCAST_VERSION ||
+        h->trade_slots != BROADCAST_TRADE_SLOTS || h->minute_slots != BROADCAST_MINUTE_SLOTS) {
+        munmap(p, broadcast_region_size());
+        return -1;
+    }
+    r->header = h;
+    r->map_size = broadcast_region_size();
+    broadcast_locate(h, &r->trades, &r->minutes);
+    r->epoch = h->epoch;
+
+    uint64_t trade_head = atomic_load(&h->trade_head);
+    uint64_t minute_head = atomic_load(&h->minute_head);
+    if (from_oldest) {
+        r->trade_pos = trade_head > BROADCAST_TRADE_SLOTS ? trade_head - BROADCAST_TRADE_SLOTS : 0;
+        r->minute_pos = minute_head > BROADCAST_MINUTE_SLOTS ? minute_head - BROADCAST_MINUTE_SLOTS : 0;
+    } else {
+        r->trade_pos = trade_head;
+        r->minute_pos = minute_head;
+    }
+    return 0;
+}
+
+void broadcast_reader_close(BroadcastReader* r) {
+    if (r->header) {
+        munmap(r->header, r->map_size);
+    }
+    *r = (BroadcastReader){0};
+}
+
+// Copies the record at *pos when it is complete. A slot still holding an older lap means the
+// writer has not got there yet; a newer lap means the reader was overrun and jumps to the oldest
+// record still in the ring
+static BroadcastRead read_ring(BroadcastReader* r, atomic_uint_fast64_t* head, char* slots, size_t slot_size,
+                               uint64_t slot_count, uint64_t* pos, uint64_t* lost, void* out, size_t out_size) {
+    if (r->header->epoch != r->epoch) {
+        r->epoch = r->header->epoch;
+        r->trade_pos = r->minute_pos = 0;
+        return BROADCAST_READ_RESTARTED;
+    }
+
+    char* slot = slots + (*pos & (slot_count - 1)) * slot_size;
+    atomic_uint_fast64_t* seq = (atomic_uint_fast64_t*)slot;
+    uint64_t expected = 2 * *pos + 2;
+    uint64_t s = atomic_load_explicit(seq, memory_order_acquire);
+    if (s == expected) {
+        memcpy(out, slot + sizeof(atomic_uint_fast64_t), out_size);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seq, memory_order_relaxed) == expected) {
+            (*pos)++;
+            return BROADCAST_READ_OK;
+        }
+    } else if (s < expected) {
+        return BROADCAST_READ_EMPTY;
+    }
+
+    uint64_t h = atomic_load_explicit(head, memory_order_acquire);
+    uint64_t oldest = h > slot_count ? h - slot_count : 0;
+    if (oldest > *pos) {
+        *lost += oldest - *pos;
+        *pos = oldest;
+    } else {
+        // Overwritten mid-copy: the writer lapped this slot, skip it
+        *lost += 1;
+        *pos += 1;
+    }
+    return BROADCAST_READ_OVERRUN;
+}
+
+BroadcastRead broadcast_read_trade(BroadcastReader* r, BroadcastTrade* out) {
+    return read_ring(r, &r->header->trade_head, (char*)r->trades, sizeof(BroadcastTradeSlot),
+                     BROADCAST_TRADE_SLOTS, &r->trade_pos, &r->trades_lost, out, sizeof(*out));
+}
+
+BroadcastRead broadcast_read_minute(BroadcastReader* r, BroadcastMinute* out) {
+    return read_ring(r, &r->header->minute_head, (char*)r->minutes, sizeof(BroadcastMinuteSlot),
+                     BROADCAST_MINUTE_SLOTS, &r->minute_pos, &r->minutes_lost, out, sizeof(*out));
+}
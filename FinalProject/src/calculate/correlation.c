@@ -1,6 +1,12 @@
 #include "correlation.h"
 #include "../utils/utils.h"
+#include "../utils/records.h"
+#include "../query/query.h"
+#include "../broadcast/broadcast.h"
+#include "../kernels/kernels.h"
+#include "../tsdb/tsdb.h"
 
+// Scalar reference for a single pair, calculate_correlation uses the kernel matrix instead
 double pearson_correlation(double* x, double* y, int n) {
     if (n < 2) return 0.0;
 
@@ -16,7 +22,7 @@ double pearson_correlation(double* x, double* y, int n) {
     }
     
     double num = sum_xy - (sum_x*sum_y) / n;
-    double den = sqrt((sum_xx - pow(sum_x, 2) / n) * (sum_yy - pow(sum_y, 2) / n));
+    double den = sqrt((sum_xx - sum_x * sum_x / n) * (sum_yy - sum_y * sum_y / n));
     
     return (fabs(den) > 1e-9) ? num / den : 0.0;
 }
@@ -24,66 +30,76 @@ double pearson_correlation(double* x, double* y, int n) {
 void calculate_correlation(time_t time_now) {
     struct stat st = {0};
     if (stat("data", &st) == -1) mkdir("data", 0755);
-    if (stat("data/corr", &st) == -1) mkdir("data/corr", 0755);
+    if (stat(CORR_DIR, &st) == -1) mkdir(CORR_DIR, 0755);
 
     printf("DEBUG: Calculating correlations at %s", ctime(&time_now));
+
+    // Copy the last 8 moving averages of every symbol that has them, oldest first, as the
+    // columns of a time-major matrix
+    double series[8 * 8];
+    int ready[8], ready_count = 0;
     for(int i = 0; i < 8; i++) {
         pthread_mutex_lock(&symbol_histories[i].mutex);
+        if(symbol_histories[i].movingAvg_count >= 8) {
+            for(int k = 0; k < 8; k++) {
+                int idx = (symbol_histories[i].movingAvg_index + k) % 8;
+                series[k * 8 + ready_count] = symbol_histories[i].movingAvg_history[idx];
+            }
+            ready[ready_count++] = i;
+        }
+        pthread_mutex_unlock(&symbol_histories[i].mutex);
+    }
+    if(ready_count == 0) {
+        return;
+    }
 
-        if(symbol_histories[i].movingAvg_count < 8) {
-            pthread_mutex_unlock(&symbol_histories[i].mutex);
-            continue;
+    // Repack with the final column count so rows are contiguous
+    double packed[8 * 8], matrix[8 * 8];
+    for(int k = 0; k < 8; k++) {
+        for(int c = 0; c < ready_count; c++) {
+            packed[k * ready_count + c] = series[k * 8 + c];
         }
+    }
+    kernels->pearson_matrix(packed, ready_count, 8, matrix);
 
+    for(int a = 0; a < ready_count; a++) {
+        int i = ready[a];
         double correlations[8] = {0};
         char max_symbol[32] = "N/A";
         double max_correlation = -2.0;
-        
-        for(int j = 0; j < 8; j++) {
+
+        for(int b = 0; b < ready_count; b++) {
+            int j = ready[b];
             if(j == i) {
                 correlations[j] = 1.0; // Self-correlation
                 continue;
             }
-
-            pthread_mutex_lock(&symbol_histories[j].mutex);
-            if(symbol_histories[j].movingAvg_count >= 8) {
-                double x[8], y[8];
-                
-                // Extract last 8 values in chronological order
-                for(int k = 0; k < 8; k++) {
-                    int idx_i = (symbol_histories[i].movingAvg_index - 8 + k + 8) % 8;
-                    int idx_j = (symbol_histories[j].movingAvg_index - 8 + k + 8) % 8;
-                    x[k] = symbol_histories[i].movingAvg_history[idx_i];
-                    y[k] = symbol_histories[j].movingAvg_history[idx_j];
-                }
-
-                double correlation = pearson_correlation(x, y, 8);
-                correlations[j] = correlation;
-
-                if(j != i && correlation > max_correlation) {
-                    max_correlation = correlation;
-                    strncpy(max_symbol, symbols[j], sizeof(max_symbol) - 1);
-                }
-            } else {
-                correlations[j] = 0.0;
+            correlations[j] = matrix[a * ready_count + b];
+            if(j > i) {
+                char series_name[64];
+                snprintf(series_name, sizeof(series_name), "corr.%s.%s", symbols[i], symbols[j]);
+                tsdb_append(tsdb_series(series_name, 24), time_now, correlations[j]);
+            }
+            if(correlations[j] > max_correlation) {
+                max_correlation = correlations[j];
+                strncpy(max_symbol, symbols[j], sizeof(max_symbol) - 1);
             }
-            pthread_mutex_unlock(&symbol_histories[j].mutex);
         }
+        query_publish_correlation(i, time_now, correlations);
+        broadcast_correlation(i, time_now, correlations);
 
         // Write to file with all correlations
         char corr_filename[128];
-        snprintf(corr_filename, sizeof(corr_filename), "data/corr/%s.log", symbols[i]);
-        FILE* file = fopen(corr_filename, "a");
+        snprintf(corr_filename, sizeof(corr_filename), CORR_DIR "/%s.log", symbols[i]);
+        FILE* file = tsdb_text() ? fopen(corr_filename, "a") : NULL;
         if (file) {
-            fprintf(file, "%llu,%s,%.4f", (unsigned long long)time_now, max_symbol, max_correlation);
+            fprintf(file, CORR_HEAD_FMT, (unsigned long long)time_now, max_symbol, max_correlation);
             for (int k = 0; k < 8; k++) {
-                fprintf(file, ",%.4f", correlations[k]);
+                fprintf(file, CORR_VALUE_FMT, correlations[k]);
             }
             fprintf(file, "\n");
             fflush(file);
             fclose(file);
         }
-
-        pthread_mutex_unlock(&symbol_histories[i].mutex);
     }    
-}
\ No newline at end of file
+}
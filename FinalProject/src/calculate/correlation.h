@@ -3,4 +3,5 @@
 #include <sys/stat.h>
 #include <errno.h>
 
+double pearson_correlation(double* x, double* y, int n);
 void calculate_correlation(time_t time_now);
\ No newline at end of file
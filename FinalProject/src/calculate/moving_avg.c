@@ -1,31 +1,71 @@
 #include "moving_avg.h"
 #include "../utils/utils.h"
+#include "../utils/records.h"
+#include "../trace/trace.h"
+#include "../metrics/metrics.h"
+#include "../reorder/reorder.h"
+#include "../query/query.h"
+#include "../broadcast/broadcast.h"
+#include "../kernels/kernels.h"
+#include "../tsdb/tsdb.h"
+#include "../shard/shard.h"
 
+// Price, volume and price*volume sums over the window, one kernel call per contiguous ring segment
+static void window_sums(SymbolHistory* h, double* sum_price, double* sum_volume, double* sum_pv) {
+    *sum_price = *sum_volume = *sum_pv = 0.0;
+    size_t done = 0;
+    while(done < h->count) {
+        size_t at = (h->head + done) & (h->capacity - 1);
+        size_t len = h->capacity - at < h->count - done ? h->capacity - at : h->count - done;
+        *sum_price  += kernels->sum(h->prices + at, len);
+        *sum_volume += kernels->sum(h->volumes + at, len);
+        *sum_pv     += kernels->dot(h->prices + at, h->volumes + at, len);
+        done += len;
+    }
+}
+
+// time_now is a finalised minute boundary: the average covers trades in [time_now - 15 min, time_now)
 void calculate_moving_avg(time_t time_now) {
     struct stat st = {0};
     if (stat("data", &st) == -1) mkdir("data", 0755);
-    if (stat("data/mavg", &st) == -1) mkdir("data/mavg", 0755);
+    if (stat(MAVG_DIR, &st) == -1) mkdir(MAVG_DIR, 0755);
     
     for(int i = 0; i < 8; i++) {
-        pthread_mutex_lock(&symbol_histories[i].mutex);
-        
-        // Purge old trades
-        size_t new_count = 0;
-        for(size_t j = 0; j < symbol_histories[i].count; j++) {
-            if(symbol_histories[i].trades[j].timestamp >= (uint64_t)time_now - 900) {
-                symbol_histories[i].trades[new_count++] = symbol_histories[i].trades[j];
-            }
+        if(!shard_owns(i)) {
+            continue;
         }
-        symbol_histories[i].count = new_count;
+        pthread_mutex_lock(&symbol_histories[i].mutex);
+
+        // Bring in the closed minute from the reorder buffer, then purge old trades
+        uint64_t end_ms = (uint64_t)time_now * 1000;
+        size_t released = reorder_release(&symbol_histories[i], end_ms);
+        history_evict(&symbol_histories[i], end_ms - WINDOW_MS);
+        metrics_set_window(i, symbol_histories[i].count);
 
         // Calculate moving average
-        double sum_price = 0.0, sum_volume = 0.0;
-        for(size_t j = 0; j < symbol_histories[i].count; j++) {
-            sum_price  += symbol_histories[i].trades[j].price;
-            sum_volume += symbol_histories[i].trades[j].volume;
+        double sum_price, sum_volume, sum_pv;
+        window_sums(&symbol_histories[i], &sum_price, &sum_volume, &sum_pv);
+
+        // Only the trades just released are new to the window, the first average that includes
+        // a sampled one closes its trace
+        uint64_t now_ns = trace_now_ns();
+        size_t fresh = released < symbol_histories[i].count ? released : symbol_histories[i].count;
+        for(size_t j = symbol_histories[i].count - fresh; j < symbol_histories[i].count; j++) {
+            TradeData* trade = history_at(&symbol_histories[i], j);
+            if(trade->trace.sampled && !trade->trace.in_mavg) {
+                trade->trace.in_mavg = 1;
+                trace_record(TRACE_MOVING_AVG, now_ns - trade->trace.queue_ns);
+            }
         }
         
         double current_ma = (symbol_histories[i].count > 0) ? sum_price / symbol_histories[i].count : 0.0;
+        double current_vwap = (sum_volume > 0.0) ? sum_pv / sum_volume : 0.0;
+        query_publish_average(i, time_now, current_ma, current_vwap, symbol_histories[i].count);
+        broadcast_average(i, time_now, current_ma, current_vwap, symbol_histories[i].count);
+        char series_name[64];
+        snprintf(series_name, sizeof(series_name), "mavg.%s", symbols[i]);
+        tsdb_append(tsdb_series(series_name, 44), time_now, current_ma);
+        shard_record_average(i, current_ma, symbol_histories[i].count);
         
         // Store in circular buffer
         symbol_histories[i].movingAvg_history[symbol_histories[i].movingAvg_index] = current_ma;
@@ -33,12 +73,12 @@ void calculate_moving_avg(time_t time_now) {
         symbol_histories[i].movingAvg_index = (symbol_histories[i].movingAvg_index + 1) % 8;
         symbol_histories[i].movingAvg_count = (symbol_histories[i].movingAvg_count < 8) ? symbol_histories[i].movingAvg_count + 1 : 8;
         
-        // Write to file
+        // Write to file, unless the store alone keeps the series
         char filename[128];
-        snprintf(filename, sizeof(filename), "data/mavg/%s.log", symbols[i]);
-        FILE* file = fopen(filename, "a");
+        snprintf(filename, sizeof(filename), MAVG_DIR "/%s.log", symbols[i]);
+        FILE* file = tsdb_text() ? fopen(filename, "a") : NULL;
         if(file) {
-            fprintf(file, "[%llu], MovingAvg: %.8f\n", (unsigned long long)time_now, current_ma);
+            fprintf(file, MAVG_RECORD_FMT, (unsigned long long)time_now, current_ma);
             fflush(file);
             fclose(file);
         }
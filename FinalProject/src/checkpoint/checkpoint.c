@@ -0,0 +1,451 @@
+#include "checkpoint.h"
+#include "../utils/utils.h"
+#include "../utils/records.h"
+#include "../reorder/reorder.h"
+#include "../tsdb/tsdb.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Rolling state survives restarts: the processor snapshots the windows, reorder buffers and
+// moving average rings every few minutes and a writer thread persists them with write, fsync
+// and rename. Startup maps the newest checkpoint and tops it up from the transaction log tails,
+// or rebuilds everything from the logs alone when there is no usable checkpoint.
+
+unsigned int checkpoint_every = 1;      // Minutes between checkpoints, 0 disables them
+
+static pthread_t writer_thread;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+static char* ready_buf = NULL;          // Latest snapshot not yet on disk
+static size_t ready_len = 0;
+static int writer_running = 0;
+static int writer_stop = 0;
+static unsigned int ticks = 0;
+
+static uint64_t fnv1a(const unsigned char* p, size_t n) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static uint64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int compare_trades(const void* a, const void* b) {
+    const CheckpointTrade* x = a;
+    const CheckpointTrade* y = b;
+    if (x->timestamp != y->timestamp) return x->timestamp < y->timestamp ? -1 : 1;
+    return x->trade_id < y->trade_id ? -1 : x->trade_id > y->trade_id;
+}
+
+// Copies the rolling state into one buffer, each symbol under its own history lock
+static char* snapshot(size_t* out_len) {
+    const size_t base = sizeof(CheckpointHeader) + 8 * sizeof(CheckpointSymbol);
+    size_t cap = base + 8192 * sizeof(CheckpointTrade);
+    size_t len = base;
+    char* buf = malloc(cap);
+
+    for (int i = 0; i < 8; i++) {
+        SymbolHistory* h = &symbol_histories[i];
+        pthread_mutex_lock(&h->mutex);
+
+        size_t window = h->count, pending = h->pending_count;
+        if (len + (window + pending) * sizeof(CheckpointTrade) > cap) {
+            cap = (len + (window + pending) * sizeof(CheckpointTrade)) * 2;
+            buf = realloc(buf, cap);
+        }
+
+        CheckpointSymbol* cs = (CheckpointSymbol*)(buf + sizeof(CheckpointHeader)) + i;
+        for (int k = 0; k < 8; k++) {
+            cs->movingAvg_history[k] = h->movingAvg_history[k];
+            cs->movingAvg_timestamps[k] = (int64_t)h->movingAvg_timestamps[k];
+        }
+        cs->movingAvg_index = h->movingAvg_index;
+        cs->movingAvg_count = h->movingAvg_count;
+        cs->trade_count = window + pending;
+
+        CheckpointTrade* out = (CheckpointTrade*)(buf + len);
+        for (size_t j = 0; j < window; j++) {
+            TradeData* t = history_at(h, j);
+            out[j] = (CheckpointTrade){t->timestamp, t->trade_id, t->price, t->volume};
+        }
+        for (size_t j = 0; j < pending; j++) {
+            TradeData* t = &h->pending[j];
+            out[window + j] = (CheckpointTrade){t->timestamp, t->trade_id, t->price, t->volume};
+        }
+        pthread_mutex_unlock(&h->mutex);
+
+        // The reorder buffer is a heap, the file keeps every symbol's trades sorted
+        qsort(out + window, pending, sizeof(CheckpointTrade), compare_trades);
+        len += (window + pending) * sizeof(CheckpointTrade);
+    }
+
+    CheckpointHeader* header = (CheckpointHeader*)buf;
+    *header = (CheckpointHeader){
+        .magic = CHECKPOINT_MAGIC,
+        .version = CHECKPOINT_VERSION,
+        .symbol_count = 8,
+        .written_ms = wall_ms(),
+        .payload_size = len - sizeof(CheckpointHeader),
+        .payload_hash = fnv1a((const unsigned char*)buf + sizeof(CheckpointHeader), len - sizeof(CheckpointHeader)),
+    };
+    *out_len = len;
+    return buf;
+}
+
+// Readers only ever see the previous complete file or the new complete file
+static int write_file(const char* buf, size_t len) {
+    const char* tmp = CHECKPOINT_PATH ".tmp";
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        perror("Failed to open checkpoint");
+        return -1;
+    }
+
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, buf + off, len - off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("Failed to write checkpoint");
+            close(fd);
+            unlink(tmp);
+            return -1;
+        }
+        off += (size_t)n;
+    }
+    if (fsync(fd) != 0 || close(fd) != 0 || rename(tmp, CHECKPOINT_PATH) != 0) {
+        perror("Failed to commit checkpoint");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static void* writer_func(void* arg __attribute__((unused))) {
+    pthread_mutex_lock(&writer_lock);
+    for (;;) {
+        while (!ready_buf && !writer_stop) {
+            pthread_cond_wait(&writer_cond, &writer_lock);
+        }
+        if (!ready_buf) {
+            break;
+        }
+
+        char* buf = ready_buf;
+        size_t len = ready_len;
+        ready_buf = NULL;
+        pthread_mutex_unlock(&writer_lock);
+        write_file(buf, len);
+        free(buf);
+        pthread_mutex_lock(&writer_lock);
+    }
+    pthread_mutex_unlock(&writer_lock);
+    return NULL;
+}
+
+// A snapshot the writer has not picked up yet is superseded by the newer one
+static void hand_over(char* buf, size_t len, int stop) {
+    pthread_mutex_lock(&writer_lock);
+    free(ready_buf);
+    ready_buf = buf;
+    ready_len = len;
+    writer_stop = stop;
+    pthread_cond_signal(&writer_cond);
+    pthread_mutex_unlock(&writer_lock);
+}
+
+void checkpoint_start(void) {
+    if (!checkpoint_every) {
+        return;
+    }
+    struct stat st = {0};
+    if (stat("data", &st) == -1) mkdir("data", 0755);
+    if (pthread_create(&writer_thread, NULL, writer_func, NULL) == 0) {
+        pthread_setname_np(writer_thread, "espx-ckpt");
+        writer_running = 1;
+    }
+}
+
+// Called by the processor after every tick
+void checkpoint_request(void) {
+    if (!writer_running || ++ticks % checkpoint_every != 0) {
+        return;
+    }
+    size_t len;
+    char* buf = snapshot(&len);
+    hand_over(buf, len, 0);
+}
+
+// Final checkpoint at shutdown so a deploy resumes exactly where it stopped
+void checkpoint_stop(void) {
+    if (!writer_running) {
+        return;
+    }
+    size_t len;
+    char* buf = snapshot(&len);
+    hand_over(buf, len, 1);
+    pthread_join(writer_thread, NULL);
+    writer_running = 0;
+}
+
+static void restore_trade(int symbol, uint64_t timestamp, uint64_t trade_id, double price, double volume) {
+    TradeData trade = {.price = price, .volume = volume, .timestamp = timestamp, .trade_id = trade_id};
+    strncpy(trade.symbol, symbols[symbol], sizeof(trade.symbol) - 1);
+    reorder_preload(symbol, &trade);
+}
+
+// Maps the checkpoint and preloads it, newest[i] gets the last trade timestamp per symbol
+static int load_checkpoint(uint64_t now_ms, uint64_t* newest) {
+    int fd = open(CHECKPOINT_PATH, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(CheckpointHeader) + 8 * sizeof(CheckpointSymbol)) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    const unsigned char* map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("Failed to map checkpoint");
+        return -1;
+    }
+
+    const CheckpointHeader* header = (const CheckpointHeader*)map;
+    const char* problem = NULL;
+    if (header->magic != CHECKPOINT_MAGIC || header->version != CHECKPOINT_VERSION || header->symbol_count != 8) {
+        problem = "unknown format";
+    } else if (header->payload_size != size - sizeof(CheckpointHeader) ||
+               fnv1a(map + sizeof(CheckpointHeader), header->payload_size) != header->payload_hash) {
+        problem = "corrupt";
+    } else if (now_ms > header->written_ms + WINDOW_MS) {
+        problem = "older than the window";
+    }
+
+    const CheckpointSymbol* cs = (const CheckpointSymbol*)(map + sizeof(CheckpointHeader));
+    size_t trades = 0;
+    for (int i = 0; !problem && i < 8; i++) {
+        trades += cs[i].trade_count;
+        if (cs[i].movingAvg_index < 0 || cs[i].movingAvg_index >= 8 || cs[i].movingAvg_count < 0 || cs[i].movingAvg_count > 8) {
+            problem = "corrupt";
+        }
+    }
+    if (!problem && trades * sizeof(CheckpointTrade) != size - sizeof(CheckpointHeader) - 8 * sizeof(CheckpointSymbol)) {
+        problem = "corrupt";
+    }
+    if (problem) {
+        printf("Ignoring checkpoint %s: %s\n", CHECKPOINT_PATH, problem);
+        munmap((void*)map, size);
+        return -1;
+    }
+
+    const CheckpointTrade* t = (const CheckpointTrade*)(cs + 8);
+    for (int i = 0; i < 8; i++) {
+        SymbolHistory* h = &symbol_histories[i];
+        pthread_mutex_lock(&h->mutex);
+        for (int k = 0; k < 8; k++) {
+            h->movingAvg_history[k] = cs[i].movingAvg_history[k];
+            h->movingAvg_timestamps[k] = (time_t)cs[i].movingAvg_timestamps[k];
+        }
+        h->movingAvg_index = cs[i].movingAvg_index;
+        h->movingAvg_count = cs[i].movingAvg_count;
+        pthread_mutex_unlock(&h->mutex);
+
+        for (uint64_t j = 0; j < cs[i].trade_count; j++, t++) {
+            restore_trade(i, t->timestamp, t->trade_id, t->price, t->volume);
+            if (t->timestamp > newest[i]) newest[i] = t->timestamp;
+        }
+    }
+
+    munmap((void*)map, size);
+    return 0;
+}
+
+static int parse_trade_line(const char* line, size_t len, CheckpointTrade* out) {
+    char tmp[128];
+    if (len == 0 || len >= sizeof(tmp)) {
+        return -1;
+    }
+    memcpy(tmp, line, len);
+    tmp[len] = '\0';
+
+    unsigned long long ts;
+    if (sscanf(tmp, TRADE_SCAN_FMT, &ts, &out->price, &out->volume) != 3) {
+        return -1;
+    }
+    out->timestamp = ts;
+    out->trade_id = 0;
+    return 0;
+}
+
+// Walks a transaction log backwards in chunks and preloads the trades newer than since_ms.
+// The log is in arrival order, so scanning only stops a minute past the cutoff.
+static size_t load_log_tail(int symbol, uint64_t since_ms) {
+    char path[128];
+    snprintf(path, sizeof(path), TRANSACTIONS_DIR "/%s.log", symbols[symbol]);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+
+    CheckpointTrade* trades = NULL;
+    size_t count = 0, cap = 0;
+    char* buf = malloc(CHECKPOINT_TAIL_CHUNK + 256);
+    size_t carry = 0;       // Start of a line whose end was in the chunk read before
+    off_t pos = lseek(fd, 0, SEEK_END);
+    int done = 0;
+
+    while (pos > 0 && !done) {
+        size_t n = pos >= CHECKPOINT_TAIL_CHUNK ? CHECKPOINT_TAIL_CHUNK : (size_t)pos;
+        pos -= (off_t)n;
+        memmove(buf + n, buf, carry);
+        if (pread(fd, buf, n, pos) != (ssize_t)n) {
+            break;
+        }
+
+        size_t stop = n + carry;
+        for (size_t i = stop; i > 0 || pos == 0; i--) {
+            if (i > 0 && buf[i - 1] != '\n') continue;
+
+            CheckpointTrade trade;
+            if (parse_trade_line(buf + i, stop - i, &trade) == 0) {
+                if (trade.timestamp + REORDER_MINUTE_MS < since_ms) {
+                    done = 1;
+                    break;
+                }
+                if (trade.timestamp >= since_ms) {
+                    if (count == cap) {
+                        cap = cap ? cap * 2 : 4096;
+                        trades = realloc(trades, cap * sizeof(CheckpointTrade));
+                    }
+                    trades[count++] = trade;
+                }
+            }
+            if (i == 0) break;
+            stop = i - 1;
+        }
+        carry = stop <= 256 ? stop : 0;
+    }
+    free(buf);
+    close(fd);
+
+    qsort(trades, count, sizeof(CheckpointTrade), compare_trades);
+    for (size_t i = 0; i < count; i++) {
+        restore_trade(symbol, trades[i].timestamp, 0, trades[i].price, trades[i].volume);
+    }
+    free(trades);
+    return count;
+}
+
+// Newest moving averages in arrival order, the last 8 are kept
+typedef struct {
+    double values[8];
+    time_t stamps[8];
+    int count;
+} MavgTail;
+
+static int collect_mavg(const TsdbPoint* point, void* ctx) {
+    MavgTail* tail = ctx;
+    tail->values[tail->count % 8] = point->value[0];
+    tail->stamps[tail->count % 8] = (time_t)point->ts;
+    tail->count++;
+    return 0;
+}
+
+// From data/mavg, or from the store when it keeps the series without the text copy
+static void read_mavg_tail(int symbol, uint64_t now_ms, MavgTail* tail) {
+    if (!tsdb_text()) {
+        char name[64];
+        snprintf(name, sizeof(name), "mavg.%s", symbols[symbol]);
+        int64_t from = (int64_t)((now_ms - WINDOW_MS) / 1000) - 8 * 60;
+        tsdb_scan(tsdb_dir, name, TSDB_RAW, from, INT64_MAX, collect_mavg, tail);
+        return;
+    }
+
+    char path[128];
+    snprintf(path, sizeof(path), MAVG_DIR "/%s.log", symbols[symbol]);
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, size > 4096 ? size - 4096 : 0, SEEK_SET);
+
+    char line[128];
+    if (size > 4096 && !fgets(line, sizeof(line), file)) {    // Partial first line
+        fclose(file);
+        return;
+    }
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long long ts;
+        double value;
+        if (sscanf(line, "[%llu], " MAVG_VALUE_TAG " %lf", &ts, &value) == 2) {
+            tail->values[tail->count % 8] = value;
+            tail->stamps[tail->count % 8] = (time_t)ts;
+            tail->count++;
+        }
+    }
+    fclose(file);
+}
+
+// Last 8 minutes of moving averages, so correlations resume at once without a checkpoint
+static void load_mavg_tail(int symbol, uint64_t now_ms) {
+    MavgTail tail = {0};
+    read_mavg_tail(symbol, now_ms, &tail);
+    int count = tail.count;
+    if (count == 0 || (uint64_t)tail.stamps[(count - 1) % 8] * 1000 + WINDOW_MS < now_ms) {
+        return;
+    }
+    SymbolHistory* h = &symbol_histories[symbol];
+    int n = count < 8 ? count : 8;
+    pthread_mutex_lock(&h->mutex);
+    for (int k = 0; k < n; k++) {
+        int src = (count - n + k) % 8;
+        h->movingAvg_history[k] = tail.values[src];
+        h->movingAvg_timestamps[k] = tail.stamps[src];
+    }
+    h->movingAvg_index = n % 8;
+    h->movingAvg_count = n;
+    pthread_mutex_unlock(&h->mutex);
+}
+
+// Returns 1 when a checkpoint was used, 0 when state came from the logs only
+int checkpoint_restore(void) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t now_ms = wall_ms();
+    uint64_t newest[8] = {0};
+
+    int from_checkpoint = load_checkpoint(now_ms, newest) == 0;
+    if (!from_checkpoint) {
+        for (int i = 0; i < 8; i++) {
+            load_mavg_tail(i, now_ms);
+        }
+    }
+
+    // Trades logged after the checkpoint was taken, or the whole window without one
+    size_t from_logs = 0;
+    for (int i = 0; i < 8; i++) {
+        uint64_t since = now_ms - WINDOW_MS;
+        if (newest[i] >= since) since = newest[i] + 1;
+        from_logs += load_log_tail(i, since);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Restored rolling state%s, %zu trades from log tails, in %.1f ms\n",
+           from_checkpoint ? " from " CHECKPOINT_PATH : " from logs", from_logs,
+           (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    return from_checkpoint;
+}
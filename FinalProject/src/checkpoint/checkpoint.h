@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#define CHECKPOINT_PATH "data/checkpoint.bin"
+#define CHECKPOINT_MAGIC 0x54504B4358505345ull     // "ESPXCKPT"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_TAIL_CHUNK 65536
+
+// File layout: header, one CheckpointSymbol per symbol, then each symbol's trades in timestamp order
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t symbol_count;
+    uint64_t written_ms;
+    uint64_t payload_size;      // Bytes after the header
+    uint64_t payload_hash;      // FNV-1a over those bytes
+} CheckpointHeader;
+
+typedef struct {
+    double movingAvg_history[8];
+    int64_t movingAvg_timestamps[8];
+    int32_t movingAvg_index;
+    int32_t movingAvg_count;
+    uint64_t trade_count;       // Window followed by the reorder buffer
+} CheckpointSymbol;
+
+typedef struct {
+    uint64_t timestamp;
+    uint64_t trade_id;
+    double price;
+    double volume;
+} CheckpointTrade;
+
+extern unsigned int checkpoint_every;
+
+int  checkpoint_restore(void);
+void checkpoint_start(void);
+void checkpoint_request(void);
+void checkpoint_stop(void);
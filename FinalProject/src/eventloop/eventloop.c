@@ -0,0 +1,136 @@
+#include "eventloop.h"
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "../websocket/websocket.h"
+#include "../logger/logger.h"
+#include "../processor/processor.h"
+#include "../utils/utils.h"
+#include "../instrument/instrument.h"
+
+// Single-threaded runtime: lws sockets, the minute timer and the log writer share one epoll set.
+// Socket events carry (feed id << 32 | fd), the two timers use tags no fd can produce.
+#define TAG_MINUTE       UINT64_MAX
+#define TAG_HOUSEKEEPING (UINT64_MAX - 1)
+
+static int epoll_fd = -1;
+
+static uint32_t poll_to_epoll(int events) {
+    return (events & POLLIN ? EPOLLIN : 0) | (events & POLLOUT ? EPOLLOUT : 0);
+}
+
+static short epoll_to_poll(uint32_t events) {
+    return (short)((events & EPOLLIN ? POLLIN : 0) | (events & EPOLLOUT ? POLLOUT : 0) |
+                   (events & EPOLLERR ? POLLERR : 0) | (events & EPOLLHUP ? POLLHUP : 0));
+}
+
+// lws reports every socket it opens, closes or wants a different direction on
+static int poll_hook(Feed* feed, enum lws_callback_reasons reason, struct lws_pollargs* args) {
+    struct epoll_event ev = {
+        .events = poll_to_epoll(args->events),
+        .data.u64 = (uint64_t)feed->id << 32 | (uint32_t)args->fd,
+    };
+
+    int op = reason == LWS_CALLBACK_ADD_POLL_FD ? EPOLL_CTL_ADD :
+             reason == LWS_CALLBACK_DEL_POLL_FD ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    if (epoll_ctl(epoll_fd, op, args->fd, &ev) < 0 && !(op == EPOLL_CTL_DEL && errno == EBADF)) {
+        perror("epoll_ctl");
+        return 1;
+    }
+    return 0;
+}
+
+static int add_timer(int fd, uint64_t tag) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = tag };
+    return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+// Must run before the feed contexts are created so their listen and client sockets land in the set
+int eventloop_init(void) {
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        perror("epoll_create1");
+        return -1;
+    }
+    websocket_poll_hook = poll_hook;
+    return 0;
+}
+
+int eventloop_run(Feed* feeds, int feed_count, volatile sig_atomic_t* stop) {
+    int minute_fd = processor_timer_create(TFD_NONBLOCK | TFD_CLOEXEC);
+
+    // Reconnects, inactivity checks and lws's own timeouts only need second resolution
+    int housekeeping_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec its = { .it_interval = {1, 0}, .it_value = {1, 0} };
+    timerfd_settime(housekeeping_fd, 0, &its, NULL);
+
+    if (minute_fd < 0 || housekeeping_fd < 0 || add_timer(minute_fd, TAG_MINUTE) < 0 || add_timer(housekeeping_fd, TAG_HOUSEKEEPING) < 0) {
+        perror("eventloop timers");
+        return -1;
+    }
+
+    instrument_init();
+    for (int f = 0; f < feed_count; f++) {
+        feeds[f].last_activity = time(NULL);
+        websocket_maintain(&feeds[f], feeds[f].last_activity);
+    }
+
+    struct epoll_event events[EVENTLOOP_MAX_EVENTS];
+    while (!*stop) {
+        int n = epoll_wait(epoll_fd, events, EVENTLOOP_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            uint64_t tag = events[i].data.u64;
+            uint64_t exp;
+
+            if (tag == TAG_MINUTE) {
+                if (read(minute_fd, &exp, sizeof(exp)) > 0) {
+                    processor_tick();
+                }
+            } else if (tag == TAG_HOUSEKEEPING) {
+                if (read(housekeeping_fd, &exp, sizeof(exp)) > 0) {
+                    time_t now = time(NULL);
+                    for (int f = 0; f < feed_count; f++) {
+                        websocket_maintain(&feeds[f], now);
+                        lws_service_fd(feeds[f].context, NULL);
+                    }
+                }
+            } else {
+                Feed* feed = &feeds[tag >> 32];
+                struct pollfd pfd = {
+                    .fd = (int)(uint32_t)tag,
+                    .events = POLLIN | POLLOUT,
+                    .revents = epoll_to_poll(events[i].events),
+                };
+                lws_service_fd(feed->context, &pfd);     // Closed connections clear feed->wsi in the callback
+            }
+        }
+
+        // TLS can hold decrypted data the socket no longer signals, lws asks for a forced pass then
+        for (int f = 0; f < feed_count; f++) {
+            if (lws_service_adjust_timeout(feeds[f].context, 1, 0) == 0) {
+                lws_service_tsi(feeds[f].context, -1, 0);
+            }
+        }
+
+        // Everything received during this wake goes to disk in one batch per symbol
+        logger_drain(&trade_queue);
+        logger_flush();
+    }
+
+    instrument_close();
+    close(minute_fd);
+    close(housekeeping_fd);
+    close(epoll_fd);
+    websocket_poll_hook = NULL;
+
+    return 0;
+}
@@ -0,0 +1,11 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+#include <sys/epoll.h>
+
+#define EVENTLOOP_MAX_EVENTS 64
+
+typedef struct Feed Feed;
+
+int eventloop_init(void);
+int eventloop_run(Feed* feeds, int feed_count, volatile sig_atomic_t* stop);
@@ -0,0 +1,137 @@
+#include "flow.h"
+#include "../utils/utils.h"
+#include "../utils/records.h"
+#include "../tsdb/tsdb.h"
+#include "../reorder/reorder.h"
+#include <sys/stat.h>
+
+// Order-flow accumulators by aggressor side. Every first-delivered trade adds to the bucket of
+// its exchange second on the ingest thread, so the cost per trade is constant, and all windows
+// read the same ring when a minute closes: a window is the sum of its seconds before the boundary,
+// at most FLOW_BUCKETS slots per symbol however many trades arrived. Buckets are keyed by event
+// time like the moving averages, so trades arriving within the lateness land in the right minute,
+// and clamped like the watermark so a trade stamped in the future cannot take over a slot that
+// seconds still inside the windows use.
+
+FlowConfig flow_config = {
+    .large_multiple = 10.0,
+    .min_trades = 200,
+};
+SymbolFlow symbol_flow[8];
+
+static const int flow_windows[FLOW_WINDOW_COUNT] = FLOW_WINDOWS;
+
+void flow_init(void) {
+    for (int i = 0; i < 8; i++) {
+        symbol_flow[i] = (SymbolFlow){.lock = PTHREAD_MUTEX_INITIALIZER};
+    }
+}
+
+void flow_update(int symbol, uint64_t timestamp, double price, double volume, int side) {
+    if (price <= 0.0 || volume <= 0.0) {
+        return;
+    }
+    SymbolFlow* f = &symbol_flow[symbol];
+    uint64_t second = reorder_event_time(timestamp) / 1000;
+    double notional = price * volume;
+
+    pthread_mutex_lock(&f->lock);
+    FlowBucket* b = &f->buckets[second % FLOW_BUCKETS];
+    if (b->second != second) {
+        if (b->second > second) {
+            pthread_mutex_unlock(&f->lock);
+            return;     // Older than the ring, every window holding it has been published
+        }
+        *b = (FlowBucket){.second = second};
+    }
+    b->volume[side] += volume;
+    b->notional[side] += notional;
+    b->trades[side]++;
+    if (f->large_notional > 0.0 && notional >= f->large_notional) {
+        b->large++;
+    }
+    if (!f->first_second || second < f->first_second) {
+        f->first_second = second;
+    }
+    pthread_mutex_unlock(&f->lock);
+}
+
+// Sums the seconds in [minute - seconds, minute), slots still holding an older second are skipped
+int flow_window(int symbol, time_t minute, int seconds, FlowWindow* out) {
+    SymbolFlow* f = &symbol_flow[symbol];
+    uint64_t end = (uint64_t)minute;
+    uint64_t start = end > (uint64_t)seconds ? end - seconds : 0;
+    *out = (FlowWindow){.seconds = seconds};
+
+    pthread_mutex_lock(&f->lock);
+    uint64_t first = f->first_second;
+    for (uint64_t s = start; s < end; s++) {
+        const FlowBucket* b = &f->buckets[s % FLOW_BUCKETS];
+        if (b->second != s) {
+            continue;
+        }
+        for (int side = FLOW_BUY; side <= FLOW_SELL; side++) {
+            out->trades[side] += b->trades[side];
+            out->volume[side] += b->volume[side];
+            out->notional[side] += b->notional[side];
+        }
+        out->large += b->large;
+    }
+    pthread_mutex_unlock(&f->lock);
+
+    uint64_t trades = out->trades[FLOW_BUY] + out->trades[FLOW_SELL];
+    if (trades == 0) {
+        return 0;
+    }
+    double volume = out->volume[FLOW_BUY] + out->volume[FLOW_SELL];
+    out->imbalance = volume > 0.0 ? (out->volume[FLOW_BUY] - out->volume[FLOW_SELL]) / volume : 0.0;
+    uint64_t covered = first > start ? end - first : end - start;
+    out->rate = (double)trades / (double)(covered ? covered : 1);
+    return 1;
+}
+
+// Called by the processor for every closed minute, right after the moving averages
+void flow_publish(time_t minute) {
+    struct stat st = {0};
+    if (stat("data", &st) == -1) mkdir("data", 0755);
+    if (stat(FLOW_DIR, &st) == -1) mkdir(FLOW_DIR, 0755);
+
+    for (int i = 0; i < 8; i++) {
+        FlowWindow windows[FLOW_WINDOW_COUNT];
+        int any = 0;
+        for (int w = 0; w < FLOW_WINDOW_COUNT; w++) {
+            any |= flow_window(i, minute, flow_windows[w], &windows[w]);
+        }
+        if (!any) {
+            continue;
+        }
+
+        // The large-trade threshold follows the mean notional of the longest window
+        const FlowWindow* longest = &windows[FLOW_WINDOW_COUNT - 1];
+        uint64_t trades = longest->trades[FLOW_BUY] + longest->trades[FLOW_SELL];
+        double threshold = trades >= flow_config.min_trades
+            ? flow_config.large_multiple * (longest->notional[FLOW_BUY] + longest->notional[FLOW_SELL]) / trades
+            : 0.0;
+        pthread_mutex_lock(&symbol_flow[i].lock);
+        symbol_flow[i].large_notional = threshold;
+        pthread_mutex_unlock(&symbol_flow[i].lock);
+
+        char filename[128];
+        snprintf(filename, sizeof(filename), FLOW_DIR "/%s.log", symbols[i]);
+        FILE* file = fopen(filename, "a");
+        if (file) {
+            for (int w = 0; w < FLOW_WINDOW_COUNT; w++) {
+                const FlowWindow* fw = &windows[w];
+                fprintf(file, FLOW_RECORD_FMT, (unsigned long long)minute, fw->seconds,
+                        (unsigned long long)fw->trades[FLOW_BUY], (unsigned long long)fw->trades[FLOW_SELL],
+                        fw->volume[FLOW_BUY], fw->volume[FLOW_SELL], fw->notional[FLOW_BUY] + fw->notional[FLOW_SELL],
+                        fw->imbalance, fw->rate, (unsigned long long)fw->large);
+            }
+            fclose(file);
+        }
+
+        char series_name[64];
+        snprintf(series_name, sizeof(series_name), "flow.%s.imbalance", symbols[i]);
+        tsdb_append(tsdb_series(series_name, 24), minute, windows[0].imbalance);
+    }
+}
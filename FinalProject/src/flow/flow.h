@@ -0,0 +1,51 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#define FLOW_BUCKETS 1024               // One per second, covers the longest window plus the allowed lateness
+#define FLOW_WINDOW_COUNT 3
+#define FLOW_WINDOWS {60, 300, 900}     // Seconds, each must fit in FLOW_BUCKETS
+
+// Aggressor side of a trade, index into the per-side accumulators
+enum { FLOW_BUY, FLOW_SELL };
+
+// One second of trades for one symbol, tagged with the second so a reused slot is recognised
+typedef struct {
+    uint64_t second;
+    double volume[2];
+    double notional[2];
+    uint32_t trades[2];
+    uint32_t large;
+} FlowBucket;
+
+// Sums over one window ending at a minute boundary
+typedef struct {
+    int seconds;
+    uint64_t trades[2];
+    uint64_t large;
+    double volume[2];
+    double notional[2];
+    double imbalance;               // (buy - sell) / (buy + sell) volume, 0 without trades
+    double rate;                    // Trades per second over the part of the window seen so far
+} FlowWindow;
+
+typedef struct {
+    double large_multiple;          // Large trades exceed this many times the mean notional
+    uint64_t min_trades;            // In the longest window before large trades are counted
+} FlowConfig;
+
+typedef struct {
+    pthread_mutex_t lock;
+    FlowBucket buckets[FLOW_BUCKETS];
+    uint64_t first_second;          // Of the first trade, windows are not divided by time before it
+    double large_notional;          // Threshold set at each publish, 0 while unarmed
+} SymbolFlow;
+
+extern FlowConfig flow_config;
+extern SymbolFlow symbol_flow[8];
+
+void flow_init(void);
+void flow_update(int symbol, uint64_t timestamp, double price, double volume, int side);
+int  flow_window(int symbol, time_t minute, int seconds, FlowWindow* out);   // 0 when the window has no trades
+void flow_publish(time_t minute);
@@ -0,0 +1,246 @@
+#include "instrument.h"
+#include <dirent.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+typedef struct {
+    int tid;
+    unsigned long utime;
+    unsigned long stime;
+    unsigned long voluntary;
+    unsigned long involuntary;
+} ThreadSample;
+
+typedef struct {
+    unsigned long long busy;
+    unsigned long long total;
+} CoreSample;
+
+static const char* section_names[SECTION_COUNT] = {"moving_avg", "correlation"};
+static const char* counter_names[PERF_COUNTER_COUNT] = {"cycles", "instructions", "cache_misses", "branch_misses"};
+static const uint64_t counter_configs[PERF_COUNTER_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// Hardware counters, grouped under the first counter that opened
+static int perf_fds[PERF_COUNTER_COUNT] = {-1, -1, -1, -1};
+static int perf_leader = -1;
+static int perf_slot[PERF_COUNTER_COUNT];   // Position inside the group read, -1 if unavailable
+static int perf_members = 0;
+static uint64_t section_totals[SECTION_COUNT][PERF_COUNTER_COUNT];
+static uint64_t section_runs[SECTION_COUNT];
+
+static ThreadSample prev_threads[INSTRUMENT_MAX_THREADS];
+static int prev_thread_count = 0;
+static CoreSample prev_cores[INSTRUMENT_MAX_CORES];
+static int prev_core_count = 0;
+static struct timespec prev_sample_time = {0};
+
+static long perf_event_open(struct perf_event_attr* attr, pid_t pid, int cpu, int group_fd, unsigned long flags) {
+    return syscall(SYS_perf_event_open, attr, pid, cpu, group_fd, flags);
+}
+
+// Opens counters for the calling thread; anything the kernel refuses is reported as unavailable
+void instrument_init(void) {
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        perf_slot[c] = -1;
+
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = counter_configs[c];
+        attr.disabled = perf_leader == -1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP;
+
+        int fd = (int)perf_event_open(&attr, 0, -1, perf_leader, 0);
+        if (fd < 0) {
+            continue;
+        }
+        if (perf_leader == -1) {
+            perf_leader = fd;
+        }
+        perf_fds[c] = fd;
+        perf_slot[c] = perf_members++;
+    }
+
+    if (perf_leader == -1) {
+        printf("Hardware performance counters unavailable, logging CPU time only.\n");
+    }
+}
+
+void instrument_begin(PerfSection section __attribute__((unused))) {
+    if (perf_leader == -1) {
+        return;
+    }
+    ioctl(perf_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(perf_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void instrument_end(PerfSection section) {
+    if (perf_leader == -1) {
+        return;
+    }
+    ioctl(perf_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    uint64_t values[1 + PERF_COUNTER_COUNT];
+    if (read(perf_leader, values, sizeof(values)) < (ssize_t)sizeof(uint64_t)) {
+        return;
+    }
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        if (perf_slot[c] >= 0 && (uint64_t)perf_slot[c] < values[0]) {
+            section_totals[section][c] += values[1 + perf_slot[c]];
+        }
+    }
+    section_runs[section]++;
+}
+
+static int read_thread(int tid, ThreadSample* sample, char* name, size_t name_len) {
+    char path[64], line[512];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/stat", tid);
+    FILE* f = fopen(path, "r");
+    if (!f) return -1;
+    char* ok = fgets(line, sizeof(line), f);
+    fclose(f);
+    if (!ok) return -1;
+
+    // comm may contain spaces, so fields are counted after the closing parenthesis
+    char* open = strchr(line, '(');
+    char* close = strrchr(line, ')');
+    if (!open || !close) return -1;
+    size_t n = (size_t)(close - open - 1) < name_len - 1 ? (size_t)(close - open - 1) : name_len - 1;
+    memcpy(name, open + 1, n);
+    name[n] = '\0';
+
+    sample->tid = tid;
+    if (sscanf(close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &sample->utime, &sample->stime) != 2) {
+        return -1;
+    }
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", tid);
+    f = fopen(path, "r");
+    if (!f) return -1;
+    sample->voluntary = sample->involuntary = 0;
+    while (fgets(line, sizeof(line), f)) {
+        sscanf(line, "voluntary_ctxt_switches: %lu", &sample->voluntary);
+        sscanf(line, "nonvoluntary_ctxt_switches: %lu", &sample->involuntary);
+    }
+    fclose(f);
+    return 0;
+}
+
+static void sample_threads(time_t now, double interval_s) {
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) return;
+    FILE* log = fopen("logs/thread_cpu.log", "a");
+
+    const double ticks = (double)sysconf(_SC_CLK_TCK) * interval_s;
+    ThreadSample current[INSTRUMENT_MAX_THREADS];
+    int count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) && count < INSTRUMENT_MAX_THREADS) {
+        if (entry->d_name[0] == '.') continue;
+
+        char name[32];
+        ThreadSample* s = &current[count];
+        if (read_thread(atoi(entry->d_name), s, name, sizeof(name)) != 0) continue;
+        count++;
+
+        // Threads seen for the first time only establish a baseline
+        for (int p = 0; p < prev_thread_count; p++) {
+            if (prev_threads[p].tid != s->tid) continue;
+            if (log && ticks > 0) {
+                fprintf(log, "[%ld], %s, %d, user: %.2f, system: %.2f, voluntary_cs: %lu, involuntary_cs: %lu\n",
+                    (long)now, name, s->tid,
+                    (s->utime - prev_threads[p].utime) / ticks * 100.0,
+                    (s->stime - prev_threads[p].stime) / ticks * 100.0,
+                    s->voluntary - prev_threads[p].voluntary,
+                    s->involuntary - prev_threads[p].involuntary);
+            }
+            break;
+        }
+    }
+    closedir(dir);
+    if (log) fclose(log);
+
+    memcpy(prev_threads, current, count * sizeof(ThreadSample));
+    prev_thread_count = count;
+}
+
+static void sample_cores(time_t now) {
+    FILE* f = fopen("/proc/stat", "r");
+    if (!f) return;
+    FILE* log = fopen("logs/core_cpu.log", "a");
+
+    char line[256];
+    int core;
+    unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "cpu%d %llu %llu %llu %llu %llu %llu %llu %llu",
+                   &core, &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal) != 9) {
+            continue;   // Skips the aggregate "cpu " line as well
+        }
+        if (core < 0 || core >= INSTRUMENT_MAX_CORES) continue;
+
+        CoreSample cur = {
+            .busy = user + nice + system + irq + softirq + steal,
+            .total = user + nice + system + idle + iowait + irq + softirq + steal,
+        };
+        if (core < prev_core_count && log) {
+            unsigned long long total = cur.total - prev_cores[core].total;
+            double busy = total ? (double)(cur.busy - prev_cores[core].busy) / total * 100.0 : 0.0;
+            fprintf(log, "[%ld], cpu%d, %.2f\n", (long)now, core, busy);
+        }
+        prev_cores[core] = cur;
+        if (core >= prev_core_count) prev_core_count = core + 1;
+    }
+    fclose(f);
+    if (log) fclose(log);
+}
+
+static void log_perf(time_t now) {
+    FILE* log = fopen("logs/perf_counters.log", "a");
+    if (!log) return;
+
+    for (int s = 0; s < SECTION_COUNT; s++) {
+        fprintf(log, "[%ld], %s", (long)now, section_names[s]);
+        for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+            if (perf_slot[c] >= 0 && section_runs[s] > 0) {
+                fprintf(log, ", %s: %llu", counter_names[c], (unsigned long long)section_totals[s][c]);
+            } else {
+                fprintf(log, ", %s: n/a", counter_names[c]);
+            }
+            section_totals[s][c] = 0;
+        }
+        fprintf(log, "\n");
+        section_runs[s] = 0;
+    }
+    fclose(log);
+}
+
+void instrument_sample(time_t now) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    double interval_s = prev_sample_time.tv_sec ? (t.tv_sec - prev_sample_time.tv_sec) + (t.tv_nsec - prev_sample_time.tv_nsec) / 1e9 : 0.0;
+    prev_sample_time = t;
+
+    sample_threads(now, interval_s);
+    sample_cores(now);
+    if (perf_leader != -1) {
+        log_perf(now);
+    }
+}
+
+void instrument_close(void) {
+    for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+        if (perf_fds[c] >= 0) close(perf_fds[c]);
+        perf_fds[c] = -1;
+    }
+    perf_leader = -1;
+}
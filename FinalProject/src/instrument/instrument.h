@@ -0,0 +1,26 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#define INSTRUMENT_MAX_THREADS 32
+#define INSTRUMENT_MAX_CORES 64
+
+typedef enum {
+    SECTION_MOVING_AVG,
+    SECTION_CORRELATION,
+    SECTION_COUNT
+} PerfSection;
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_CACHE_MISSES,
+    PERF_BRANCH_MISSES,
+    PERF_COUNTER_COUNT
+} PerfCounter;
+
+void instrument_init(void);
+void instrument_begin(PerfSection section);
+void instrument_end(PerfSection section);
+void instrument_sample(time_t now);
+void instrument_close(void);
@@ -0,0 +1,342 @@
+#include "kernels.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// Sums and dot products keep four independent accumulators so the adds pipeline, and the
+// Pearson matrix centres the columns once and forms every pair's cross product in one sweep,
+// vectorised across columns rather than along the (short) series.
+
+const KernelOps* kernels = NULL;
+
+typedef void (*GramFn)(const double* c, size_t n, int stride, int series, double* g);
+
+// Shared by every variant: column means and centring are O(n*series), the gram matrix is the
+// O(n*series^2) part and is what each instruction set provides
+static void pearson_driver(const double* x, int series, size_t n, double* out, GramFn gram, int width) {
+    if (series < 1 || series > KERNEL_MAX_SERIES) {
+        return;
+    }
+    if (n == 0) {
+        memset(out, 0, (size_t)series * series * sizeof(double));   // No samples, no correlation
+        return;
+    }
+    int stride = (series + width - 1) / width * width;
+    double means[KERNEL_MAX_SERIES] = {0};
+    for (size_t t = 0; t < n; t++) {
+        for (int s = 0; s < series; s++) {
+            means[s] += x[t * series + s];
+        }
+    }
+    for (int s = 0; s < series; s++) {
+        means[s] /= (double)n;
+    }
+
+    _Alignas(64) double local[1024];
+    double* c = n * stride <= 1024 ? local : malloc(n * stride * sizeof(double));
+    // n > 0 here, written as do-while so the compiler sees c filled before gram reads it
+    size_t t = 0;
+    do {
+        for (int s = 0; s < stride; s++) {
+            c[t * stride + s] = s < series ? x[t * series + s] - means[s] : 0.0;
+        }
+    } while (++t < n);
+
+    double g[KERNEL_MAX_SERIES * KERNEL_MAX_SERIES];
+    gram(c, n, stride, series, g);
+    for (int i = 0; i < series; i++) {
+        for (int j = 0; j < series; j++) {
+            double den = sqrt(g[i * stride + i] * g[j * stride + j]);
+            out[i * series + j] = den > 1e-9 ? g[i * stride + j] / den : 0.0;
+        }
+    }
+    if (c != local) {
+        free(c);
+    }
+}
+
+// ---- portable ----
+
+static double sum_portable(const double* x, size_t n) {
+    double a0 = 0.0, a1 = 0.0, a2 = 0.0, a3 = 0.0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 += x[i];
+        a1 += x[i + 1];
+        a2 += x[i + 2];
+        a3 += x[i + 3];
+    }
+    for (; i < n; i++) {
+        a0 += x[i];
+    }
+    return (a0 + a1) + (a2 + a3);
+}
+
+static double dot_portable(const double* x, const double* y, size_t n) {
+    double a0 = 0.0, a1 = 0.0, a2 = 0.0, a3 = 0.0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        a0 += x[i] * y[i];
+        a1 += x[i + 1] * y[i + 1];
+        a2 += x[i + 2] * y[i + 2];
+        a3 += x[i + 3] * y[i + 3];
+    }
+    for (; i < n; i++) {
+        a0 += x[i] * y[i];
+    }
+    return (a0 + a1) + (a2 + a3);
+}
+
+static double sum_sq_portable(const double* x, size_t n) {
+    return dot_portable(x, x, n);
+}
+
+static void gram_portable(const double* c, size_t n, int stride, int series, double* g) {
+    for (int i = 0; i < series; i++) {
+        for (int j = 0; j < series; j++) {
+            g[i * stride + j] = 0.0;
+        }
+        for (size_t t = 0; t < n; t++) {
+            double ci = c[t * stride + i];
+            for (int j = 0; j < series; j++) {
+                g[i * stride + j] += ci * c[t * stride + j];
+            }
+        }
+    }
+}
+
+static void pearson_portable(const double* x, int series, size_t n, double* out) {
+    pearson_driver(x, series, n, out, gram_portable, 1);
+}
+
+static const KernelOps kernels_portable = {"portable", sum_portable, sum_sq_portable, dot_portable, pearson_portable};
+
+#if defined(__x86_64__)
+
+// ---- AVX2 + FMA ----
+
+__attribute__((target("avx2,fma")))
+static double hsum_avx2(__m256d v) {
+    __m128d lo = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__((target("avx2,fma")))
+static double sum_avx2(const double* x, size_t n) {
+    __m256d a0 = _mm256_setzero_pd(), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(x + i));
+        a1 = _mm256_add_pd(a1, _mm256_loadu_pd(x + i + 4));
+        a2 = _mm256_add_pd(a2, _mm256_loadu_pd(x + i + 8));
+        a3 = _mm256_add_pd(a3, _mm256_loadu_pd(x + i + 12));
+    }
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(x + i));
+    }
+    double s = hsum_avx2(_mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+    for (; i < n; i++) {
+        s += x[i];
+    }
+    return s;
+}
+
+__attribute__((target("avx2,fma")))
+static double dot_avx2(const double* x, const double* y, size_t n) {
+    __m256d a0 = _mm256_setzero_pd(), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), a0);
+        a1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(y + i + 4), a1);
+        a2 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 8), _mm256_loadu_pd(y + i + 8), a2);
+        a3 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 12), _mm256_loadu_pd(y + i + 12), a3);
+    }
+    for (; i + 4 <= n; i += 4) {
+        a0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(y + i), a0);
+    }
+    double s = hsum_avx2(_mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+    for (; i < n; i++) {
+        s += x[i] * y[i];
+    }
+    return s;
+}
+
+__attribute__((target("avx2,fma")))
+static double sum_sq_avx2(const double* x, size_t n) {
+    return dot_avx2(x, x, n);
+}
+
+__attribute__((target("avx2,fma")))
+static void gram_avx2(const double* c, size_t n, int stride, int series, double* g) {
+    for (int i = 0; i < series; i++) {
+        for (int jb = 0; jb < stride; jb += 4) {
+            __m256d acc = _mm256_setzero_pd();
+            for (size_t t = 0; t < n; t++) {
+                acc = _mm256_fmadd_pd(_mm256_set1_pd(c[t * stride + i]), _mm256_loadu_pd(c + t * stride + jb), acc);
+            }
+            _mm256_storeu_pd(g + i * stride + jb, acc);
+        }
+    }
+}
+
+static void pearson_avx2(const double* x, int series, size_t n, double* out) {
+    pearson_driver(x, series, n, out, gram_avx2, 4);
+}
+
+static const KernelOps kernels_avx2 = {"avx2", sum_avx2, sum_sq_avx2, dot_avx2, pearson_avx2};
+
+// ---- AVX-512F ----
+
+__attribute__((target("avx512f")))
+static double sum_avx512(const double* x, size_t n) {
+    __m512d a0 = _mm512_setzero_pd(), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        a0 = _mm512_add_pd(a0, _mm512_loadu_pd(x + i));
+        a1 = _mm512_add_pd(a1, _mm512_loadu_pd(x + i + 8));
+        a2 = _mm512_add_pd(a2, _mm512_loadu_pd(x + i + 16));
+        a3 = _mm512_add_pd(a3, _mm512_loadu_pd(x + i + 24));
+    }
+    for (; i + 8 <= n; i += 8) {
+        a0 = _mm512_add_pd(a0, _mm512_loadu_pd(x + i));
+    }
+    if (i < n) {
+        __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+        a1 = _mm512_add_pd(a1, _mm512_maskz_loadu_pd(m, x + i));
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(a0, a1), _mm512_add_pd(a2, a3)));
+}
+
+__attribute__((target("avx512f")))
+static double dot_avx512(const double* x, const double* y, size_t n) {
+    __m512d a0 = _mm512_setzero_pd(), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        a0 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i), a0);
+        a1 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i + 8), _mm512_loadu_pd(y + i + 8), a1);
+        a2 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i + 16), _mm512_loadu_pd(y + i + 16), a2);
+        a3 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i + 24), _mm512_loadu_pd(y + i + 24), a3);
+    }
+    for (; i + 8 <= n; i += 8) {
+        a0 = _mm512_fmadd_pd(_mm512_loadu_pd(x + i), _mm512_loadu_pd(y + i), a0);
+    }
+    if (i < n) {
+        __mmask8 m = (__mmask8)((1u << (n - i)) - 1);
+        a1 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, x + i), _mm512_maskz_loadu_pd(m, y + i), a1);
+    }
+    return _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(a0, a1), _mm512_add_pd(a2, a3)));
+}
+
+__attribute__((target("avx512f")))
+static double sum_sq_avx512(const double* x, size_t n) {
+    return dot_avx512(x, x, n);
+}
+
+__attribute__((target("avx512f")))
+static void gram_avx512(const double* c, size_t n, int stride, int series, double* g) {
+    for (int i = 0; i < series; i++) {
+        for (int jb = 0; jb < stride; jb += 8) {
+            __m512d acc = _mm512_setzero_pd();
+            for (size_t t = 0; t < n; t++) {
+                acc = _mm512_fmadd_pd(_mm512_set1_pd(c[t * stride + i]), _mm512_loadu_pd(c + t * stride + jb), acc);
+            }
+            _mm512_storeu_pd(g + i * stride + jb, acc);
+        }
+    }
+}
+
+static void pearson_avx512(const double* x, int series, size_t n, double* out) {
+    pearson_driver(x, series, n, out, gram_avx512, 8);
+}
+
+static const KernelOps kernels_avx512 = {"avx512", sum_avx512, sum_sq_avx512, dot_avx512, pearson_avx512};
+
+#elif defined(__aarch64__)
+
+// ---- NEON (Advanced SIMD is mandatory on ARMv8-A, so the Cortex-A53 always has it) ----
+
+static double sum_neon(const double* x, size_t n) {
+    float64x2_t a0 = vdupq_n_f64(0.0), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a0 = vaddq_f64(a0, vld1q_f64(x + i));
+        a1 = vaddq_f64(a1, vld1q_f64(x + i + 2));
+        a2 = vaddq_f64(a2, vld1q_f64(x + i + 4));
+        a3 = vaddq_f64(a3, vld1q_f64(x + i + 6));
+    }
+    double s = vaddvq_f64(vaddq_f64(vaddq_f64(a0, a1), vaddq_f64(a2, a3)));
+    for (; i < n; i++) {
+        s += x[i];
+    }
+    return s;
+}
+
+static double dot_neon(const double* x, const double* y, size_t n) {
+    float64x2_t a0 = vdupq_n_f64(0.0), a1 = a0, a2 = a0, a3 = a0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a0 = vfmaq_f64(a0, vld1q_f64(x + i), vld1q_f64(y + i));
+        a1 = vfmaq_f64(a1, vld1q_f64(x + i + 2), vld1q_f64(y + i + 2));
+        a2 = vfmaq_f64(a2, vld1q_f64(x + i + 4), vld1q_f64(y + i + 4));
+        a3 = vfmaq_f64(a3, vld1q_f64(x + i + 6), vld1q_f64(y + i + 6));
+    }
+    double s = vaddvq_f64(vaddq_f64(vaddq_f64(a0, a1), vaddq_f64(a2, a3)));
+    for (; i < n; i++) {
+        s += x[i] * y[i];
+    }
+    return s;
+}
+
+static double sum_sq_neon(const double* x, size_t n) {
+    return dot_neon(x, x, n);
+}
+
+static void gram_neon(const double* c, size_t n, int stride, int series, double* g) {
+    for (int i = 0; i < series; i++) {
+        for (int jb = 0; jb < stride; jb += 2) {
+            float64x2_t acc = vdupq_n_f64(0.0);
+            for (size_t t = 0; t < n; t++) {
+                acc = vfmaq_n_f64(acc, vld1q_f64(c + t * stride + jb), c[t * stride + i]);
+            }
+            vst1q_f64(g + i * stride + jb, acc);
+        }
+    }
+}
+
+static void pearson_neon(const double* x, int series, size_t n, double* out) {
+    pearson_driver(x, series, n, out, gram_neon, 2);
+}
+
+static const KernelOps kernels_neon = {"neon", sum_neon, sum_sq_neon, dot_neon, pearson_neon};
+
+#endif
+
+int kernels_variants(const KernelOps** out) {
+    int count = 0;
+    out[count++] = &kernels_portable;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        out[count++] = &kernels_avx2;
+    }
+    if (__builtin_cpu_supports("avx512f")) {
+        out[count++] = &kernels_avx512;
+    }
+#elif defined(__aarch64__)
+    out[count++] = &kernels_neon;
+#endif
+    return count;
+}
+
+// Picks the widest variant the CPU supports
+void kernels_init(void) {
+    const KernelOps* variants[KERNEL_MAX_VARIANTS];
+    int count = kernels_variants(variants);
+    kernels = variants[count - 1];
+}
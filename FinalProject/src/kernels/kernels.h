@@ -0,0 +1,23 @@
+#include <stdio.h>
+#include <stddef.h>
+
+#define KERNEL_MAX_SERIES 16    // Columns accepted by pearson_matrix
+#define KERNEL_MAX_VARIANTS 4
+
+// Statistics kernels over structure-of-arrays inputs. One table per instruction set, the
+// best one the CPU supports is picked by kernels_init and used through `kernels`
+typedef struct {
+    const char* name;
+    double (*sum)(const double* x, size_t n);
+    double (*sum_sq)(const double* x, size_t n);
+    double (*dot)(const double* x, const double* y, size_t n);
+
+    // x is time-major: n rows of `series` values, row t at x + t*series. Fills out[series*series]
+    // with the Pearson correlation of every column pair, 0 where a column is constant
+    void (*pearson_matrix)(const double* x, int series, size_t n, double* out);
+} KernelOps;
+
+extern const KernelOps* kernels;
+
+void kernels_init(void);
+int  kernels_variants(const KernelOps** out);     // Every variant this CPU can run, portable first
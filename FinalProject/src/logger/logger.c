@@ -1,40 +1,194 @@
 #include "logger.h"
 #include "../utils/utils.h"
+#include "../utils/records.h"
+#include "../trace/trace.h"
+#include "../metrics/metrics.h"
 
 atomic_int logger_interrupt = 0;
 
-static FILE* log_files[8] = {NULL};
+static LogBuffer log_buffers[8];
 
-void* logger_func(void* arg) {
-    TradeQueue* q = (TradeQueue*)arg;
-    TradeData trade;
-    
-    // Open all log files once
+// Background writer of the event-loop runtime. Regular files ignore O_NONBLOCK, so the loop never
+// calls write() itself: it hands a filled half over and keeps appending to the other one.
+static int writer_running = 0;
+static int writer_stop = 0;
+static pthread_t writer_thread;
+static pthread_mutex_t writer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t writer_cond = PTHREAD_COND_INITIALIZER;
+
+int format_trade(char* buf, size_t cap, const TradeData* trade) {
+    return snprintf(buf, cap, TRADE_RECORD_FMT, (unsigned long long)trade->timestamp, trade->price, trade->volume);
+}
+
+// Writes all of data, blocking; gives up on the rest after an error other than EINTR
+static void write_all(int fd, const char* data, size_t len) {
+    while(len > 0) {
+        ssize_t n = write(fd, data, len);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            perror("logger write");
+            return;
+        }
+        data += n;
+        len -= (size_t)n;
+    }
+}
+
+static void* writer_func(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&writer_lock);
+    while(!writer_stop) {
+        int busy = 0;
+        for(int i = 0; i < 8; i++) {
+            LogBuffer* b = &log_buffers[i];
+            if(b->pending == 0) {
+                continue;
+            }
+            const char* data = b->buf[b->active ^ 1];
+            size_t len = b->pending;
+            pthread_mutex_unlock(&writer_lock);
+            write_all(b->fd, data, len);
+            pthread_mutex_lock(&writer_lock);
+            b->pending = 0;
+            busy = 1;
+        }
+        if(!busy && !writer_stop) {
+            pthread_cond_wait(&writer_cond, &writer_lock);
+        }
+    }
+    pthread_mutex_unlock(&writer_lock);
+    return NULL;
+}
+
+void logger_open(int background) {
     for(int i = 0; i < 8; i++) {
         char name[128];
-        snprintf(name, sizeof(name), "logs/transactions/%s.log", symbols[i]);
-        log_files[i] = fopen(name, "a");
+        snprintf(name, sizeof(name), "%s/%s.log", TRANSACTIONS_DIR, symbols[i]);
+        log_buffers[i].fd = open(name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        log_buffers[i].len = 0;
+        log_buffers[i].active = 0;
+        log_buffers[i].pending = 0;
+    }
+    if(background) {
+        writer_stop = 0;
+        writer_running = pthread_create(&writer_thread, NULL, writer_func, NULL) == 0;
+        if(writer_running) {
+            pthread_setname_np(writer_thread, "espx-logw");
+        }
     }
+}
 
-    while(!logger_interrupt) {
-        queue_pop(q, &trade);
-        
-        // Find the symbol index and write directly
+// Without the writer thread the caller owns the disk and writes in place. With it, the filled
+// half is queued when the writer is done with the other one, otherwise it keeps filling.
+static void flush_buffer(LogBuffer* b) {
+    if(b->fd < 0 || b->len == 0) {
+        return;
+    }
+    if(!writer_running) {
+        write_all(b->fd, b->buf[b->active], b->len);
+        b->len = 0;
+        return;
+    }
+    pthread_mutex_lock(&writer_lock);
+    if(b->pending == 0) {
+        b->pending = b->len;
+        b->active ^= 1;
+        b->len = 0;
+        pthread_cond_signal(&writer_cond);
+    }
+    pthread_mutex_unlock(&writer_lock);
+}
+
+void logger_append(const TradeData* trade) {
+    int i = symbol_index(trade->symbol);
+    if(i < 0 || log_buffers[i].fd < 0) {
+        return;
+    }
+
+    LogBuffer* b = &log_buffers[i];
+    if(LOG_BUFFER_SIZE - b->len < LOG_LINE_MAX) {
+        flush_buffer(b);
+        if(LOG_BUFFER_SIZE - b->len < LOG_LINE_MAX) {
+            metrics_add(METRIC_LOG_DROPPED, 1);
+            return;     // Both halves full, the writer is behind and the event loop must not wait
+        }
+    }
+    // snprintf returns the untruncated length, a line that did not fit is left out whole
+    int n = format_trade(b->buf[b->active] + b->len, LOG_LINE_MAX, trade);
+    if(n < 0 || n >= LOG_LINE_MAX) {
+        metrics_add(METRIC_LOG_DROPPED, 1);
+        return;
+    }
+    b->len += (size_t)n;
+
+    metrics_add(METRIC_TRADES_LOGGED, 1);
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME, &wall);
+    metrics_set(GAUGE_LOGGER_LAG_MS, (int64_t)wall.tv_sec * 1000 + wall.tv_nsec / 1000000 - (int64_t)trade->timestamp);
+    if(trade->trace.sampled) {
+        trace_record(TRACE_LOGGER, trace_now_ns() - trade->trace.queue_ns);
+    }
+}
+
+// Moves every queued trade into the buffers without blocking
+size_t logger_drain(TradeQueue* q) {
+    TradeData trade;
+    size_t count = 0;
+    while(queue_try_pop(q, &trade)) {
+        logger_append(&trade);
+        count++;
+    }
+    return count;
+}
+
+void logger_flush(void) {
+    for(int i = 0; i < 8; i++) {
+        flush_buffer(&log_buffers[i]);
+    }
+}
+
+// Stops the writer first, then writes out whatever it had not reached and the active halves
+void logger_close(void) {
+    if(writer_running) {
+        pthread_mutex_lock(&writer_lock);
+        writer_stop = 1;
+        pthread_cond_signal(&writer_cond);
+        pthread_mutex_unlock(&writer_lock);
+        pthread_join(writer_thread, NULL);
+        writer_running = 0;
         for(int i = 0; i < 8; i++) {
-            if(strcmp(trade.symbol, symbols[i]) == 0) {
-                if(log_files[i]) {
-                    fprintf(log_files[i], "[%llu], Price: %.8f, Volume: %.8f\n", (unsigned long long)trade.timestamp, trade.price, trade.volume);
-                    fflush(log_files[i]); // Ensure data is written
-                }
-                break;
+            LogBuffer* b = &log_buffers[i];
+            if(b->fd >= 0 && b->pending > 0) {
+                write_all(b->fd, b->buf[b->active ^ 1], b->pending);
             }
+            b->pending = 0;
         }
     }
-
-    // Close files on exit
+    logger_flush();
     for(int i = 0; i < 8; i++) {
-        if(log_files[i]) fclose(log_files[i]);
+        if(log_buffers[i].fd >= 0) close(log_buffers[i].fd);
+        log_buffers[i].fd = -1;
     }
-    
+}
+
+void* logger_func(void* arg) {
+    TradeQueue* q = (TradeQueue*)arg;
+    TradeData trade;
+
+    // Open all log files once, this thread writes them itself
+    logger_open(0);
+
+    // Block for one trade, then batch whatever else arrived into a single write per file
+    while(!logger_interrupt) {
+        if(queue_pop(q, &trade)) {
+            logger_append(&trade);
+            logger_drain(q);
+            logger_flush();
+        }
+    }
+
+    // Close files on exit
+    logger_close();
+
     return NULL;
-}
\ No newline at end of file
+}
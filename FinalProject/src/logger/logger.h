@@ -1,8 +1,31 @@
 #include <stdio.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <stdatomic.h>
+#include <errno.h>
+
+#define LOG_BUFFER_SIZE 65536
+#define LOG_LINE_MAX 128
 
 extern atomic_int logger_interrupt;
 
-void* logger_func(void* arg);
\ No newline at end of file
+typedef struct TradeData TradeData;
+typedef struct TradeQueue TradeQueue;
+
+// Per-symbol append buffer in two halves: one fills while the writer thread drains the other
+typedef struct {
+    int fd;
+    int active;                     // Half being filled
+    size_t len;                     // Bytes in the active half
+    size_t pending;                 // Bytes of the other half queued for the writer, 0 once written
+    char buf[2][LOG_BUFFER_SIZE];
+} LogBuffer;
+
+int    format_trade(char* buf, size_t cap, const TradeData* trade);
+void   logger_open(int background);     // background: a writer thread does the disk I/O
+void   logger_append(const TradeData* trade);
+size_t logger_drain(TradeQueue* q);
+void   logger_flush(void);
+void   logger_close(void);
+void*  logger_func(void* arg);
@@ -3,19 +3,32 @@
 #include <pthread.h>
 #include <stdatomic.h>
 #include <unistd.h>
+#include <stdlib.h>
 
 #include "websocket/websocket.h"
 #include "logger/logger.h"
 #include "processor/processor.h"
 #include "utils/utils.h"
+#include "utils/records.h"
+#include "trace/trace.h"
+#include "metrics/metrics.h"
+#include "sequence/sequence.h"
+#include "eventloop/eventloop.h"
+#include "reorder/reorder.h"
+#include "book/book.h"
+#include "checkpoint/checkpoint.h"
+#include "query/query.h"
+#include "broadcast/broadcast.h"
+#include "kernels/kernels.h"
+#include "stats/stats.h"
+#include "tsdb/tsdb.h"
+#include "shard/shard.h"
+#include "flow/flow.h"
 
-const char *symbols[] = {"BTC-USDT", "ADA-USDT", "ETH-USDT", "DOGE-USDT", "XRP-USDT", "SOL-USDT", "LTC-USDT", "BNB-USDT"};
+const char *symbols[] = SYMBOL_NAMES;
 
 volatile sig_atomic_t interrupted = 0;
-static struct lws* current_wsi = NULL;
-const int max_backoff = 60;
-int    backoff      = 2;
-time_t last_connect = 0;
+static Feed feeds[MAX_FEEDS];
 
 void sigint_handler(int sig) {
     (void)sig;
@@ -25,85 +38,306 @@ void sigint_handler(int sig) {
     atomic_store(&processor_interrupt, 1);  // Signal processor to stop
 }
 
-int main() {
-    printf("Starting Real-Time Cryptocurrency Analysis System...\n");
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-t sample_every] [-m port] [-u url] [-d] [-e] [-L ms] [-R] [-B] [-k minutes] [-q path] [-p name] [-H s[,s]] [-Z z[,z]] [-T dir] [-X] [-S k/n] [-a addr] [-A n[,ms]] [-z]\n"
+                    "  -t N     trace every Nth trade's stage latencies (0 = off, 1 = all, default 100)\n"
+                    "  -m PORT  serve Prometheus metrics on 127.0.0.1:PORT/metrics (default 0 = off)\n"
+                    "  -u URL   exchange endpoint (default wss://ws.okx.com:8443/ws/v5/public)\n"
+                    "  -d       two redundant connections, merged and deduplicated by tradeId\n"
+                    "  -e       single-threaded epoll event loop instead of websocket/logger/processor threads\n"
+                    "  -L MS    lateness allowed behind the newest exchange timestamp before a minute closes (default 2000)\n"
+                    "  -R       replayed feed: minutes close on exchange time only, without the wall-clock idle timeout\n"
+                    "  -B       also subscribe to the order book channel and log mid, spread and imbalance per minute\n"
+                    "  -k N     checkpoint rolling state every N minutes for warm restarts (0 = off, default 1)\n"
+                    "  -q PATH  serve binary queries on a UNIX socket at PATH (\"\" = off, default " QUERY_SOCKET_PATH ")\n"
+                    "  -p NAME  broadcast trades and minute results in shared memory /dev/shm/NAME (\"\" = not shared, default " BROADCAST_NAME ")\n"
+                    "  -H P,V   half-lives in seconds of the price/return and size statistics (default 60,300)\n"
+                    "  -Z P,V   z-score thresholds of price jump and volume spike alerts (0 = off, default 8,6)\n"
+                    "  -T DIR   compressed store of the minute series with hour and day rollups (\"\" = off, default " TSDB_DIR ")\n"
+                    "  -X       keep moving averages, correlations, CPU idle and tick timings in the store only,\n"
+                    "           without their text logs (ignored while the store is off)\n"
+                    "  -S K/N   shard K of N: only symbols i with i %% N == K, averages go to the aggregator instead of\n"
+                    "           correlating locally. Query and broadcast names get a -K suffix and the metrics port\n"
+                    "           is offset by K, run each shard in its own directory\n"
+                    "  -a ADDR  aggregator address, unix:PATH or HOST:PORT (default " SHARD_ADDRESS ")\n"
+                    "  -A N,MS  run as the aggregator of N shards, closing a minute MS after its first shard (default grace 10000)\n"
+                    "  -z       negotiate permessage-deflate, wire/inflated bytes and inflate CPU time in espx_deflate_*\n", prog);
+}
 
-    // Set up signal handler
-    signal(SIGINT, sigint_handler);
+// Threaded runtime: websocket on the main thread, logger and processor on their own
+static void run_threads(int feed_count) {
+    pthread_t logger_thread, processor_thread;
+    pthread_create(&logger_thread, NULL, logger_func, &trade_queue);
+    pthread_create(&processor_thread, NULL, processor_func, NULL);
 
-    // Initialize Components
-    struct lws_context* context = websocket_init();
-    queue_init(&trade_queue, 4096); //Queue Size -> 4096
+    // Thread names show up in logs/thread_cpu.log
+    pthread_setname_np(pthread_self(), "espx-ws");
+    pthread_setname_np(logger_thread, "espx-logger");
+    pthread_setname_np(processor_thread, "espx-proc");
+
+    // Redundant feeds get their own thread, the first one runs on the main thread
+    pthread_t feed_threads[MAX_FEEDS];
+    for(int f = 1; f < feed_count; f++) {
+        pthread_create(&feed_threads[f], NULL, websocket_thread, &feeds[f]);
+        pthread_setname_np(feed_threads[f], "espx-ws2");
+    }
+    websocket_run(&feeds[0]);
+
+    // Clean up for graceful shutdown
+    for(int f = 1; f < feed_count; f++) {
+        pthread_join(feed_threads[f], NULL);
+    }
+    pthread_join(logger_thread, NULL);
+    printf("Logger thread has stopped.\n");
+    pthread_join(processor_thread, NULL);
+    printf("Processor thread has stopped.\n");
+}
+
+// Event-loop runtime: every feed, the minute timer and the log buffers on the main thread, disk writes on a helper
+static void run_event_loop(int feed_count) {
+    pthread_setname_np(pthread_self(), "espx-loop");
+    logger_open(1);
+    eventloop_run(feeds, feed_count, &interrupted);
+    logger_close();
+    printf("Event loop has stopped.\n");
+}
 
-    // Initialize symbol hystory data
+// Initialize symbol hystory data
+static void init_histories(void) {
     for(int i = 0; i < 8; i++) {
         symbol_histories[i] = (SymbolHistory){
             .trades = NULL,
+            .prices = NULL,
+            .volumes = NULL,
+            .head = 0,
             .count = 0,
             .capacity = 0,
+            .pending = NULL,
             .mutex = PTHREAD_MUTEX_INITIALIZER,
             .movingAvg_history = {0},
             .movingAvg_timestamps = {0},
             .movingAvg_index = 0,
         };
+        seq_init(&seq_trackers[i]);
     }
+}
 
-    // Create logger and processor threads
-    pthread_t logger_thread, processor_thread;
-    pthread_create(&logger_thread, NULL, logger_func, &trade_queue);
-    pthread_create(&processor_thread, NULL, processor_func, NULL);
+static void free_histories(void) {
+    for(int i = 0; i < 8; i++) {
+        free(symbol_histories[i].trades);
+        free(symbol_histories[i].prices);
+        free(symbol_histories[i].volumes);
+        free(symbol_histories[i].pending);
+    }
+}
+
+// Aggregator runtime: no feed, the shards' averages fill the moving average rings and the
+// correlation outputs are written here
+static int run_aggregator(int shards) {
+    signal(SIGINT, sigint_handler);
+    kernels_init();
+    tsdb_open();
+    init_histories();
+    query_start();
+    broadcast_open();
+    int status = aggregator_run(shards, &interrupted);
+    query_stop();
+    broadcast_close();
+    tsdb_close();
+    free_histories();
+    return status;
+}
 
-    // Monitor connection
-    last_activity = time(NULL);
-    while(!interrupted) {
-        time_t now = time(NULL);
-
-        // Check if we need to reconnect
-        if (!current_wsi && !atomic_load(&is_connected)) {
-            if (now - last_connect >= backoff) {
-                current_wsi = websocket_connect(context);
-                last_connect = now;
-                if (current_wsi) {
-                    printf("Connected to WebSocket server.\n");
-                    last_activity = now;  // reset timer on connect attempt
-                    backoff = 2;
-                } else {
-                    printf("Connection failed, retrying...\n");
-                    backoff = backoff < max_backoff ? backoff * 2 : max_backoff;
+int main(int argc, char* argv[]) {
+    int opt;
+    int feed_count = 1;
+    int event_loop = 0;
+    int aggregate_shards = 0;
+    while((opt = getopt(argc, argv, "t:m:u:deL:RBk:q:p:H:Z:T:S:a:A:Xzh")) != -1) {
+        switch(opt) {
+            case 't':
+                trace_sample_every = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 'm':
+                metrics_port = atoi(optarg);
+                break;
+            case 'u':
+                if (websocket_parse_url(optarg, &feed_endpoint) != 0) {
+                    fprintf(stderr, "Invalid endpoint URL: %s\n", optarg);
+                    return 1;
                 }
+                break;
+            case 'd':
+                feed_count = 2;
+                break;
+            case 'e':
+                event_loop = 1;
+                break;
+            case 'L':
+                reorder_lateness_ms = strtoull(optarg, NULL, 10);
+                break;
+            case 'R':
+                reorder_wall_clock = 0;
+                break;
+            case 'B':
+                book_enabled = 1;
+                break;
+            case 'k':
+                checkpoint_every = (unsigned int)strtoul(optarg, NULL, 10);
+                break;
+            case 'q':
+                if (strlen(optarg) >= sizeof(query_socket_path)) {
+                    fprintf(stderr, "Query socket path too long: %s\n", optarg);
+                    return 1;
+                }
+                strcpy(query_socket_path, optarg);
+                break;
+            case 'p':
+                // shm_open names start with a single slash
+                if (strlen(optarg) + 2 > sizeof(broadcast_name)) {
+                    fprintf(stderr, "Broadcast name too long: %s\n", optarg);
+                    return 1;
+                }
+                snprintf(broadcast_name, sizeof(broadcast_name), "%s%s", optarg[0] == '/' || optarg[0] == '\0' ? "" : "/", optarg);
+                break;
+            case 'H': {
+                // A single value sets both half-lives
+                double price_s, volume_s;
+                int n = sscanf(optarg, "%lf,%lf", &price_s, &volume_s);
+                if (n < 1 || price_s <= 0 || (n == 2 && volume_s <= 0)) {
+                    fprintf(stderr, "Invalid half-lives: %s\n", optarg);
+                    return 1;
+                }
+                stats_config.price_half_life_ms = price_s * 1000.0;
+                stats_config.volume_half_life_ms = (n == 2 ? volume_s : price_s) * 1000.0;
+                break;
             }
+            case 'Z': {
+                double price_z, volume_z;
+                int n = sscanf(optarg, "%lf,%lf", &price_z, &volume_z);
+                if (n < 1) {
+                    fprintf(stderr, "Invalid z-score thresholds: %s\n", optarg);
+                    return 1;
+                }
+                stats_config.price_z = price_z;
+                stats_config.volume_z = n == 2 ? volume_z : price_z;
+                break;
+            }
+            case 'T':
+                if (strlen(optarg) >= sizeof(tsdb_dir)) {
+                    fprintf(stderr, "Store directory too long: %s\n", optarg);
+                    return 1;
+                }
+                strcpy(tsdb_dir, optarg);
+                break;
+            case 'X':
+                tsdb_text_copies = 0;
+                break;
+            case 'z':
+                websocket_deflate = true;
+                break;
+            case 'S':
+                if (shard_parse(optarg) != 0) {
+                    fprintf(stderr, "Invalid shard, expected K/N with N <= %d: %s\n", SHARD_MAX, optarg);
+                    return 1;
+                }
+                break;
+            case 'a':
+                if (shard_parse_address(optarg) != 0) {
+                    fprintf(stderr, "Aggregator address too long: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'A': {
+                unsigned int grace_ms;
+                int n = sscanf(optarg, "%d,%u", &aggregate_shards, &grace_ms);
+                if (n < 1 || aggregate_shards < 1 || aggregate_shards > SHARD_MAX) {
+                    fprintf(stderr, "Invalid shard count, expected 1 to %d: %s\n", SHARD_MAX, optarg);
+                    return 1;
+                }
+                if (n == 2) {
+                    shard_grace_ms = grace_ms;
+                }
+                break;
+            }
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
         }
+    }
 
-        if(current_wsi) {
-            int n = lws_service(context, 50);
-            if (n < 0) {
-                atomic_store(&is_connected, false);
-                current_wsi = NULL;
-                continue;
-            }
+    if (aggregate_shards) {
+        return run_aggregator(aggregate_shards);
+    }
 
-            // Check for inactivity
-            if (now - last_activity > 90) {
-                atomic_store(&is_connected, false);
-                current_wsi = NULL;
-            }
-        } else {
-            usleep(100000); // Sleep for 100ms if not connected
+    // Shards on one host must not fight over the default socket, region and metrics port
+    if (shard_count) {
+        if (metrics_port > 0) {
+            metrics_port += shard_index;
+        }
+        char suffix[8];
+        snprintf(suffix, sizeof(suffix), "-%d", shard_index);
+        if (query_socket_path[0] && strlen(query_socket_path) + strlen(suffix) < sizeof(query_socket_path)) {
+            strcat(query_socket_path, suffix);
         }
-            
+        if (broadcast_name[0] && strlen(broadcast_name) + strlen(suffix) < sizeof(broadcast_name)) {
+            strcat(broadcast_name, suffix);
+        }
+        printf("Shard %d of %d, sending averages to %s\n", shard_index, shard_count, shard_address);
     }
 
-    // Clean up for graceful shutdown
-    lws_context_destroy(context);
-    pthread_join(logger_thread, NULL);
-    printf("Logger thread has stopped.\n");
-    pthread_join(processor_thread, NULL);
-    printf("Processor thread has stopped.\n");
+    printf("Starting Real-Time Cryptocurrency Analysis System...\n");
 
-    // Cleanup history data
-    for(int i = 0; i < 8; i++) {
-        free(symbol_histories[i].trades);
+    // Set up signal handler
+    signal(SIGINT, sigint_handler);
+
+    // The event loop has to own the sockets from the moment lws creates them
+    if (event_loop && eventloop_init() != 0) {
+        return 1;
     }
 
+    // Initialize Components
+    for(int f = 0; f < feed_count; f++) {
+        feeds[f].id = f;
+        feeds[f].stop = &interrupted;
+        if (!websocket_init(&feeds[f], f == 0 ? metrics_port : 0)) {
+            fprintf(stderr, "Failed to create WebSocket context for feed %d\n", f);
+            return 1;
+        }
+    }
+    queue_init(&trade_queue, 4096); //Queue Size -> 4096
+    kernels_init();
+    printf("Statistics kernels: %s\n", kernels->name);
+    book_init();
+    stats_init();
+    flow_init();
+    tsdb_open();
+
+    init_histories();
+
+    // Windows and moving average rings from the last checkpoint or the log tails
+    checkpoint_restore();
+    checkpoint_start();
+    query_start();
+    broadcast_open();
+
+    if (event_loop) {
+        run_event_loop(feed_count);
+    } else {
+        run_threads(feed_count);
+    }
+    for(int f = 0; f < feed_count; f++) {
+        lws_context_destroy(feeds[f].context);
+        free(feeds[f].rx_buf);
+    }
+    query_stop();
+    broadcast_close();
+    stats_close();
+    checkpoint_stop();
+    tsdb_close();
+
+    shard_close();
+    free_histories();
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,167 @@
+#include "metrics.h"
+#include "../utils/utils.h"
+
+int metrics_port = 0;       // 0 -> endpoint disabled
+
+static MetricSlot slots[METRICS_MAX_THREADS];
+static atomic_uint next_slot = 0;
+static _Thread_local MetricSlot* thread_slot = NULL;
+
+static atomic_int_fast64_t gauges[GAUGE_COUNT];
+static atomic_int_fast64_t feed_gauges[FEED_GAUGE_COUNT][METRICS_MAX_FEEDS];
+static atomic_uint_fast64_t window_sizes[8];
+
+static const struct {
+    const char* name;
+    const char* help;
+} counter_info[METRIC_COUNTER_COUNT] = {
+    {"espx_connect_attempts_total",   "WebSocket connection attempts made by the backoff loop."},
+    {"espx_connect_failures_total",   "WebSocket connection attempts that failed immediately."},
+    {"espx_disconnects_total",        "Established connections lost to errors or inactivity."},
+    {"espx_messages_total",           "WebSocket messages received."},
+    {"espx_received_bytes_total",     "WebSocket payload bytes received."},
+    {"espx_trades_total",             "Trades decoded from received messages."},
+    {"espx_queue_overwrites_total",   "Trades dropped because the logger queue was full."},
+    {"espx_trades_logged_total",      "Trades written to the transaction logs."},
+    {"espx_log_dropped_total",        "Trades left out of the transaction logs because the disk writer fell behind the event loop or the line did not fit."},
+    {"espx_ticks_total",              "Minute ticks completed by the processor."},
+    {"espx_deflate_wire_bytes_total", "Compressed payload bytes consumed by permessage-deflate."},
+    {"espx_deflate_inflated_bytes_total", "Payload bytes inflated from them, also part of espx_received_bytes_total."},
+    {"espx_deflate_cpu_ns_total",     "Thread CPU time spent inflating, in nanoseconds."},
+};
+
+static const struct {
+    const char* name;
+    const char* help;
+} gauge_info[GAUGE_COUNT] = {
+    {"espx_queue_depth",              "Trades waiting in the logger queue."},
+    {"espx_logger_lag_ms",            "Age of the last logged trade relative to its exchange timestamp."},
+    {"espx_tick_duration_us",         "Duration of the last minute tick."},
+    {"espx_watermark_lag_ms",         "Wall clock minus the event-time watermark at the last tick."},
+};
+
+static const struct {
+    const char* name;
+    const char* help;
+} symbol_counter_info[SYMBOL_METRIC_COUNT] = {
+    {"espx_seq_gaps_total",           "Trade ids skipped when a symbol's highest tradeId jumped ahead."},
+    {"espx_seq_filled_total",         "Skipped trade ids that arrived later."},
+    {"espx_seq_duplicates_total",     "Trades dropped because their tradeId was already seen."},
+    {"espx_seq_stale_total",          "Trades dropped because their tradeId fell behind the tracking window."},
+    {"espx_late_trades_total",        "Trades that arrived behind the watermark and were left out of the window."},
+    {"espx_book_updates_total",       "Order book snapshots and updates applied and validated."},
+    {"espx_book_mismatches_total",    "Order book checksum or seqId mismatches, each followed by a resubscribe."},
+    {"espx_alerts_total",             "Price jump and volume spike alerts raised by the online statistics."},
+};
+
+static const struct {
+    const char* name;
+    const char* help;
+} feed_counter_info[FEED_METRIC_COUNT] = {
+    {"espx_feed_messages_total",      "WebSocket messages received per feed."},
+    {"espx_feed_first_deliveries_total", "Trades a feed delivered before any other feed."},
+};
+
+static const struct {
+    const char* name;
+    const char* help;
+} feed_gauge_info[FEED_GAUGE_COUNT] = {
+    {"espx_connected",                "1 while the feed's WebSocket connection is established."},
+};
+
+static MetricSlot* get_slot(void) {
+    if (!thread_slot) {
+        unsigned int idx = atomic_fetch_add(&next_slot, 1);
+        thread_slot = &slots[idx % METRICS_MAX_THREADS];
+    }
+    return thread_slot;
+}
+
+void metrics_add(MetricCounter counter, uint64_t n) {
+    atomic_fetch_add_explicit(&get_slot()->counters[counter], n, memory_order_relaxed);
+}
+
+void metrics_add_symbol(MetricSymbolCounter counter, int symbol, uint64_t n) {
+    atomic_fetch_add_explicit(&get_slot()->symbol_counters[counter][symbol], n, memory_order_relaxed);
+}
+
+void metrics_add_feed(MetricFeedCounter counter, int feed, uint64_t n) {
+    atomic_fetch_add_explicit(&get_slot()->feed_counters[counter][feed], n, memory_order_relaxed);
+}
+
+void metrics_set(MetricGauge gauge, int64_t value) {
+    atomic_store_explicit(&gauges[gauge], value, memory_order_relaxed);
+}
+
+void metrics_set_feed(MetricFeedGauge gauge, int feed, int64_t value) {
+    atomic_store_explicit(&feed_gauges[gauge][feed], value, memory_order_relaxed);
+}
+
+void metrics_set_window(int symbol, uint64_t trades) {
+    atomic_store_explicit(&window_sizes[symbol], trades, memory_order_relaxed);
+}
+
+// Prometheus text exposition format, built only from atomics so scrapes never block the pipeline
+size_t metrics_render(char* buf, size_t cap) {
+    size_t len = 0;
+#define APPEND(...) do { \
+        int n = snprintf(buf + len, cap - len, __VA_ARGS__); \
+        if (n < 0 || (size_t)n >= cap - len) return len; \
+        len += (size_t)n; \
+    } while (0)
+
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++) {
+        uint64_t total = 0;
+        for (int s = 0; s < METRICS_MAX_THREADS; s++) {
+            total += atomic_load_explicit(&slots[s].counters[c], memory_order_relaxed);
+        }
+        APPEND("# HELP %s %s\n# TYPE %s counter\n%s %llu\n",
+            counter_info[c].name, counter_info[c].help, counter_info[c].name,
+            counter_info[c].name, (unsigned long long)total);
+    }
+
+    for (int c = 0; c < SYMBOL_METRIC_COUNT; c++) {
+        APPEND("# HELP %s %s\n# TYPE %s counter\n", symbol_counter_info[c].name, symbol_counter_info[c].help, symbol_counter_info[c].name);
+        for (int i = 0; i < 8; i++) {
+            uint64_t total = 0;
+            for (int s = 0; s < METRICS_MAX_THREADS; s++) {
+                total += atomic_load_explicit(&slots[s].symbol_counters[c][i], memory_order_relaxed);
+            }
+            APPEND("%s{symbol=\"%s\"} %llu\n", symbol_counter_info[c].name, symbols[i], (unsigned long long)total);
+        }
+    }
+
+    for (int c = 0; c < FEED_METRIC_COUNT; c++) {
+        APPEND("# HELP %s %s\n# TYPE %s counter\n", feed_counter_info[c].name, feed_counter_info[c].help, feed_counter_info[c].name);
+        for (int f = 0; f < METRICS_MAX_FEEDS; f++) {
+            uint64_t total = 0;
+            for (int s = 0; s < METRICS_MAX_THREADS; s++) {
+                total += atomic_load_explicit(&slots[s].feed_counters[c][f], memory_order_relaxed);
+            }
+            APPEND("%s{feed=\"%d\"} %llu\n", feed_counter_info[c].name, f, (unsigned long long)total);
+        }
+    }
+
+    for (int g = 0; g < FEED_GAUGE_COUNT; g++) {
+        APPEND("# HELP %s %s\n# TYPE %s gauge\n", feed_gauge_info[g].name, feed_gauge_info[g].help, feed_gauge_info[g].name);
+        for (int f = 0; f < METRICS_MAX_FEEDS; f++) {
+            APPEND("%s{feed=\"%d\"} %lld\n", feed_gauge_info[g].name, f,
+                (long long)atomic_load_explicit(&feed_gauges[g][f], memory_order_relaxed));
+        }
+    }
+
+    for (int g = 0; g < GAUGE_COUNT; g++) {
+        APPEND("# HELP %s %s\n# TYPE %s gauge\n%s %lld\n",
+            gauge_info[g].name, gauge_info[g].help, gauge_info[g].name,
+            gauge_info[g].name, (long long)atomic_load_explicit(&gauges[g], memory_order_relaxed));
+    }
+
+    APPEND("# HELP espx_window_trades Trades held in the 15 minute window per symbol.\n# TYPE espx_window_trades gauge\n");
+    for (int i = 0; i < 8; i++) {
+        APPEND("espx_window_trades{symbol=\"%s\"} %llu\n", symbols[i],
+            (unsigned long long)atomic_load_explicit(&window_sizes[i], memory_order_relaxed));
+    }
+
+#undef APPEND
+    return len;
+}
@@ -0,0 +1,75 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define METRICS_MAX_THREADS 16
+
+typedef enum {
+    METRIC_CONNECT_ATTEMPTS,
+    METRIC_CONNECT_FAILURES,
+    METRIC_DISCONNECTS,
+    METRIC_MESSAGES,
+    METRIC_BYTES_RECEIVED,
+    METRIC_TRADES,
+    METRIC_QUEUE_OVERWRITES,
+    METRIC_TRADES_LOGGED,
+    METRIC_LOG_DROPPED,
+    METRIC_TICKS,
+    METRIC_DEFLATE_WIRE_BYTES,
+    METRIC_DEFLATE_INFLATED_BYTES,
+    METRIC_DEFLATE_CPU_NS,
+    METRIC_COUNTER_COUNT
+} MetricCounter;
+
+typedef enum {
+    GAUGE_QUEUE_DEPTH,
+    GAUGE_LOGGER_LAG_MS,
+    GAUGE_TICK_DURATION_US,
+    GAUGE_WATERMARK_LAG_MS,
+    GAUGE_COUNT
+} MetricGauge;
+
+// Counters labelled by symbol
+typedef enum {
+    SYMBOL_METRIC_SEQ_GAPS,
+    SYMBOL_METRIC_SEQ_FILLED,
+    SYMBOL_METRIC_SEQ_DUPLICATES,
+    SYMBOL_METRIC_SEQ_STALE,
+    SYMBOL_METRIC_LATE,
+    SYMBOL_METRIC_BOOK_UPDATES,
+    SYMBOL_METRIC_BOOK_MISMATCHES,
+    SYMBOL_METRIC_ALERTS,
+    SYMBOL_METRIC_COUNT
+} MetricSymbolCounter;
+
+// Counters labelled by websocket feed
+typedef enum {
+    FEED_METRIC_MESSAGES,
+    FEED_METRIC_FIRST_DELIVERIES,
+    FEED_METRIC_COUNT
+} MetricFeedCounter;
+
+// Gauges labelled by websocket feed
+typedef enum {
+    FEED_GAUGE_CONNECTED,
+    FEED_GAUGE_COUNT
+} MetricFeedGauge;
+
+#define METRICS_MAX_FEEDS 2
+
+// One cache line aligned block per thread so hot-path increments never share a line
+typedef struct {
+    atomic_uint_fast64_t counters[METRIC_COUNTER_COUNT];
+    atomic_uint_fast64_t symbol_counters[SYMBOL_METRIC_COUNT][8];
+    atomic_uint_fast64_t feed_counters[FEED_METRIC_COUNT][METRICS_MAX_FEEDS];
+} __attribute__((aligned(64))) MetricSlot;
+
+extern int metrics_port;
+
+void   metrics_add(MetricCounter counter, uint64_t n);
+void   metrics_add_symbol(MetricSymbolCounter counter, int symbol, uint64_t n);
+void   metrics_add_feed(MetricFeedCounter counter, int feed, uint64_t n);
+void   metrics_set(MetricGauge gauge, int64_t value);
+void   metrics_set_feed(MetricFeedGauge gauge, int feed, int64_t value);
+void   metrics_set_window(int symbol, uint64_t trades);
+size_t metrics_render(char* buf, size_t cap);
@@ -0,0 +1,345 @@
+#include "pca.h"
+#include "../utils/utils.h"
+#include "../utils/records.h"
+#include "../kernels/kernels.h"
+#include "../tsdb/tsdb.h"
+#include <math.h>
+#include <sys/stat.h>
+
+// The covariance costs O(n^2) per minute: one rank-one update for the newest return vector and
+// one downdate for the vector leaving the window, with the sums rebuilt from the ring once per
+// window so cancellation error cannot accumulate. The components cost O(k n^2) per iteration
+// of the subspace iteration, and since the covariance moves little between minutes the
+// previous vectors are usually within a few iterations of the new ones.
+
+static PcaState pipeline;
+static int pipeline_ready = 0;
+
+int pca_init(PcaState* s, int n, int k, int window) {
+    if (n < 1 || k < 1 || k > n || k > PCA_MAX_COMPONENTS || window < 2) {
+        return -1;
+    }
+    if (!kernels) {
+        kernels_init();
+    }
+    *s = (PcaState){.n = n, .k = k, .window = window};
+    size_t nn = (size_t)n * n, kn = (size_t)k * n;
+    s->returns = calloc((size_t)window * n, sizeof(double));
+    s->levels = calloc(n, sizeof(double));
+    s->sum = calloc(n, sizeof(double));
+    s->sum_sq = calloc(nn, sizeof(double));
+    s->cov = calloc(nn, sizeof(double));
+    s->vectors = calloc(kn, sizeof(double));
+    s->values = calloc(k, sizeof(double));
+    s->work = calloc(kn, sizeof(double));
+    s->previous = calloc(kn, sizeof(double));
+    if (!s->returns || !s->levels || !s->sum || !s->sum_sq || !s->cov || !s->vectors || !s->values || !s->work || !s->previous) {
+        pca_free(s);
+        return -1;
+    }
+    return 0;
+}
+
+void pca_free(PcaState* s) {
+    free(s->returns);
+    free(s->levels);
+    free(s->sum);
+    free(s->sum_sq);
+    free(s->cov);
+    free(s->vectors);
+    free(s->values);
+    free(s->work);
+    free(s->previous);
+    *s = (PcaState){0};
+}
+
+static void add_outer(PcaState* s, const double* x, double sign) {
+    int n = s->n;
+    for (int i = 0; i < n; i++) {
+        s->sum[i] += sign * x[i];
+        if (x[i] == 0.0) {
+            continue;
+        }
+        double xi = sign * x[i];
+        double* row = s->sum_sq + (size_t)i * n;
+        for (int j = 0; j < n; j++) {
+            row[j] += xi * x[j];
+        }
+    }
+}
+
+static void rebuild(PcaState* s) {
+    memset(s->sum, 0, (size_t)s->n * sizeof(double));
+    memset(s->sum_sq, 0, (size_t)s->n * s->n * sizeof(double));
+    for (size_t t = 0; t < s->count; t++) {
+        add_outer(s, s->returns + (size_t)t * s->n, 1.0);
+    }
+    s->since_rebuild = 0;
+}
+
+void pca_push(PcaState* s, const double* levels) {
+    int n = s->n, known = 0;
+    for (int i = 0; i < n; i++) {
+        known |= s->levels[i] > 0.0;
+    }
+
+    // The first levels only anchor the returns
+    double* x = s->returns + s->head * n;
+    if (known && s->count == (size_t)s->window) {
+        add_outer(s, x, -1.0);
+    }
+    for (int i = 0; i < n; i++) {
+        double r = levels[i] > 0.0 && s->levels[i] > 0.0 ? log(levels[i] / s->levels[i]) : 0.0;
+        if (known) {
+            x[i] = r;
+        }
+        if (levels[i] > 0.0) {
+            s->levels[i] = levels[i];
+        }
+    }
+    if (!known) {
+        return;
+    }
+    add_outer(s, x, 1.0);
+    s->head = (s->head + 1) % (size_t)s->window;
+    if (s->count < (size_t)s->window) {
+        s->count++;
+    }
+    if (++s->since_rebuild >= (size_t)s->window) {
+        rebuild(s);
+    }
+}
+
+// Cyclic Jacobi on the small k x k projected matrix, eigenvectors in the columns of v
+static void jacobi(double a[PCA_MAX_COMPONENTS][PCA_MAX_COMPONENTS], int k, double v[PCA_MAX_COMPONENTS][PCA_MAX_COMPONENTS]) {
+    for (int i = 0; i < k; i++) {
+        for (int j = 0; j < k; j++) {
+            v[i][j] = i == j;
+        }
+    }
+    for (int sweep = 0; sweep < 50; sweep++) {
+        double off = 0.0, diag = 0.0;
+        for (int p = 0; p < k; p++) {
+            diag += a[p][p] * a[p][p];
+            for (int q = p + 1; q < k; q++) {
+                off += a[p][q] * a[p][q];
+            }
+        }
+        if (off <= 1e-30 * diag || off == 0.0) {
+            return;
+        }
+        for (int p = 0; p < k; p++) {
+            for (int q = p + 1; q < k; q++) {
+                if (a[p][q] == 0.0) {
+                    continue;
+                }
+                double theta = (a[q][q] - a[p][p]) / (2.0 * a[p][q]);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0), sn = t * c;
+                for (int r = 0; r < k; r++) {
+                    double arp = a[r][p], arq = a[r][q];
+                    a[r][p] = c * arp - sn * arq;
+                    a[r][q] = sn * arp + c * arq;
+                }
+                for (int r = 0; r < k; r++) {
+                    double apr = a[p][r], aqr = a[q][r];
+                    a[p][r] = c * apr - sn * aqr;
+                    a[q][r] = sn * apr + c * aqr;
+                }
+                for (int r = 0; r < k; r++) {
+                    double vrp = v[r][p], vrq = v[r][q];
+                    v[r][p] = c * vrp - sn * vrq;
+                    v[r][q] = sn * vrp + c * vrq;
+                }
+            }
+        }
+    }
+}
+
+static void multiply(PcaState* s) {
+    int n = s->n;
+    for (int a = 0; a < s->k; a++) {
+        const double* q = s->vectors + (size_t)a * n;
+        double* w = s->work + (size_t)a * n;
+        for (int i = 0; i < n; i++) {
+            w[i] = kernels->dot(s->cov + (size_t)i * n, q, (size_t)n);
+        }
+    }
+}
+
+// Modified Gram-Schmidt of the work rows into vectors. A direction the covariance does not
+// have (rank below k) keeps its previous estimate so the block stays orthonormal
+static void orthonormalize(PcaState* s) {
+    int n = s->n;
+    for (int a = 0; a < s->k; a++) {
+        double* q = s->vectors + (size_t)a * n;
+        for (int attempt = 0; attempt < 2; attempt++) {
+            memcpy(q, (attempt ? s->previous : s->work) + (size_t)a * n, (size_t)n * sizeof(double));
+            for (int b = 0; b < a; b++) {
+                const double* p = s->vectors + (size_t)b * n;
+                double d = kernels->dot(q, p, (size_t)n);
+                for (int i = 0; i < n; i++) {
+                    q[i] -= d * p[i];
+                }
+            }
+            double norm = sqrt(kernels->sum_sq(q, (size_t)n));
+            if (norm > 1e-150) {
+                for (int i = 0; i < n; i++) {
+                    q[i] /= norm;
+                }
+                break;
+            }
+            memset(q, 0, (size_t)n * sizeof(double));
+        }
+    }
+}
+
+// Deterministic cold start: the constant vector (a market factor guess) and cosine modes
+static void seed(PcaState* s) {
+    int n = s->n;
+    for (int a = 0; a < s->k; a++) {
+        double* q = s->vectors + (size_t)a * n;
+        for (int i = 0; i < n; i++) {
+            q[i] = cos(M_PI * (i + 0.5) * a / n);
+        }
+    }
+    memcpy(s->work, s->vectors, (size_t)s->k * n * sizeof(double));
+    memcpy(s->previous, s->vectors, (size_t)s->k * n * sizeof(double));
+    orthonormalize(s);
+}
+
+int pca_solve(PcaState* s) {
+    int n = s->n, k = s->k;
+    if (s->count < 2) {
+        return -1;
+    }
+    double m = (double)s->count;
+    s->total_variance = 0.0;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            s->cov[(size_t)i * n + j] = (s->sum_sq[(size_t)i * n + j] - s->sum[i] * s->sum[j] / m) / (m - 1.0);
+        }
+        s->total_variance += s->cov[(size_t)i * n + i];
+    }
+    if (!s->warm) {
+        seed(s);
+    }
+
+    double t[PCA_MAX_COMPONENTS][PCA_MAX_COMPONENTS], v[PCA_MAX_COMPONENTS][PCA_MAX_COMPONENTS];
+    double rotated[PCA_MAX_COMPONENTS];
+    multiply(s);
+    int it = 0;
+    while (it < PCA_MAX_ITERATIONS) {
+        it++;
+        memcpy(s->previous, s->vectors, (size_t)k * n * sizeof(double));
+        orthonormalize(s);
+        multiply(s);
+
+        // Rayleigh-Ritz: best vectors within the block and their eigenvalues
+        for (int a = 0; a < k; a++) {
+            for (int b = a; b < k; b++) {
+                t[a][b] = t[b][a] = kernels->dot(s->vectors + (size_t)a * n, s->work + (size_t)b * n, (size_t)n);
+            }
+        }
+        jacobi(t, k, v);
+        int order[PCA_MAX_COMPONENTS];
+        for (int a = 0; a < k; a++) {
+            order[a] = a;
+        }
+        for (int a = 1; a < k; a++) {
+            for (int b = a; b > 0 && t[order[b]][order[b]] > t[order[b - 1]][order[b - 1]]; b--) {
+                int tmp = order[b];
+                order[b] = order[b - 1];
+                order[b - 1] = tmp;
+            }
+        }
+        for (double* block = s->vectors; block; block = block == s->vectors ? s->work : NULL) {
+            for (int i = 0; i < n; i++) {
+                for (int a = 0; a < k; a++) {
+                    rotated[a] = 0.0;
+                    for (int b = 0; b < k; b++) {
+                        rotated[a] += v[b][order[a]] * block[(size_t)b * n + i];
+                    }
+                }
+                for (int a = 0; a < k; a++) {
+                    block[(size_t)a * n + i] = rotated[a];
+                }
+            }
+        }
+
+        // Keep each component's sign from the previous minute. A component is settled once its
+        // vector stops turning, or its eigenvalue stops changing when it sits in a near-degenerate
+        // (noise) eigenspace where the vector is not determined
+        double moved = 0.0;
+        double scale = fabs(t[order[0]][order[0]]);
+        for (int a = 0; a < k; a++) {
+            double* q = s->vectors + (size_t)a * n;
+            double* w = s->work + (size_t)a * n;
+            double c = kernels->dot(q, s->previous + (size_t)a * n, (size_t)n);
+            if (c < 0.0) {
+                for (int i = 0; i < n; i++) {
+                    q[i] = -q[i];
+                    w[i] = -w[i];
+                }
+            }
+            double value = t[order[a]][order[a]];
+            double change = it > 1 ? fabs(value - s->values[a]) / (scale > 0.0 ? scale : 1.0) : 1.0;
+            s->values[a] = value;
+            double turn = 1.0 - fabs(c);
+            if ((turn < change ? turn : change) > moved) {
+                moved = turn < change ? turn : change;
+            }
+        }
+        if (moved < PCA_TOLERANCE) {
+            break;
+        }
+    }
+    s->iterations = it;
+    s->warm = 1;
+    return it;
+}
+
+// Called once per closed minute after the moving averages (or, in the aggregator, after the
+// shards' averages) are in the rings
+void pca_publish(time_t minute) {
+    if (!pipeline_ready) {
+        if (pca_init(&pipeline, 8, PCA_COMPONENTS, PCA_WINDOW) != 0) {
+            return;
+        }
+        pipeline_ready = 1;
+    }
+
+    // Only this minute's averages, a symbol without one contributes no return
+    double levels[8];
+    for (int i = 0; i < 8; i++) {
+        SymbolHistory* h = &symbol_histories[i];
+        pthread_mutex_lock(&h->mutex);
+        int last = (h->movingAvg_index + 7) % 8;
+        levels[i] = h->movingAvg_count > 0 && h->movingAvg_timestamps[last] == minute ? h->movingAvg_history[last] : 0.0;
+        pthread_mutex_unlock(&h->mutex);
+    }
+    pca_push(&pipeline, levels);
+    if (pca_solve(&pipeline) < 0) {
+        return;
+    }
+
+    struct stat st = {0};
+    if (stat("data", &st) == -1) mkdir("data", 0755);
+    if (stat(PCA_DIR, &st) == -1) mkdir(PCA_DIR, 0755);
+    for (int a = 0; a < pipeline.k; a++) {
+        double explained = pipeline.total_variance > 0.0 ? pipeline.values[a] / pipeline.total_variance : 0.0;
+        char name[64];
+        snprintf(name, sizeof(name), PCA_DIR "/pc%d.log", a + 1);
+        FILE* file = fopen(name, "a");
+        if (file) {
+            fprintf(file, PCA_RECORD_FMT, (unsigned long long)minute, pipeline.values[a], explained, pipeline.iterations);
+            for (int i = 0; i < pipeline.n; i++) {
+                fprintf(file, PCA_LOADING_FMT, pipeline.vectors[(size_t)a * pipeline.n + i]);
+            }
+            fprintf(file, "\n");
+            fclose(file);
+        }
+        snprintf(name, sizeof(name), "pca.pc%d.explained", a + 1);
+        tsdb_append(tsdb_series(name, 24), minute, explained);
+    }
+}
@@ -0,0 +1,41 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+
+#define PCA_WINDOW 60               // Minutes of returns in the rolling covariance
+#define PCA_COMPONENTS 3            // Market factor and the two strongest sector factors
+#define PCA_MAX_COMPONENTS 8
+#define PCA_MAX_ITERATIONS 100
+#define PCA_TOLERANCE 1e-10         // 1 - |cos| between successive estimates of every component
+
+// Rolling covariance of per-minute log returns of the moving averages, kept as running sums
+// under rank-one updates, and its top components by subspace iteration warm-started from the
+// previous minute's vectors. Matrices are row-major n x n, vectors[j] is row j of a k x n block
+typedef struct {
+    int n;
+    int k;
+    int window;
+    double* returns;                // window x n ring
+    double* levels;                 // Last level of every series, 0 while unknown
+    double* sum;                    // n
+    double* sum_sq;                 // n x n, sum of x x^T
+    double* cov;                    // n x n, filled by pca_solve
+    double* vectors;                // k x n, unit rows sorted by eigenvalue
+    double* values;                 // k
+    double* work;                   // k x n, the covariance times vectors
+    double* previous;               // k x n, vectors before the current iteration
+    size_t head;
+    size_t count;
+    size_t since_rebuild;
+    int warm;                       // vectors hold the previous solution
+    int iterations;                 // Of the last pca_solve
+    double total_variance;          // Trace of the covariance
+} PcaState;
+
+int  pca_init(PcaState* s, int n, int k, int window);
+void pca_free(PcaState* s);
+void pca_push(PcaState* s, const double* levels);  // Next minute's levels, <= 0 for missing
+int  pca_solve(PcaState* s);                        // Iterations used, -1 until two returns are in
+
+// Pipeline entry point for a closed minute, reads the moving average rings and writes data/pca
+void pca_publish(time_t minute);
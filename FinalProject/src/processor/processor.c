@@ -1,54 +1,122 @@
 #include "processor.h"
 #include "../utils/utils.h"
+#include "../utils/records.h"
 #include "../calculate/moving_avg.h"
 #include "../calculate/correlation.h"
+#include "../trace/trace.h"
+#include "../metrics/metrics.h"
+#include "../instrument/instrument.h"
+#include "../sequence/sequence.h"
+#include "../reorder/reorder.h"
+#include "../book/book.h"
+#include "../checkpoint/checkpoint.h"
+#include "../broadcast/broadcast.h"
+#include "../stats/stats.h"
+#include "../tsdb/tsdb.h"
+#include "../shard/shard.h"
+#include "../pca/pca.h"
+#include "../flow/flow.h"
 
 atomic_int processor_interrupt = 0;
 
-void* processor_func(void* arg __attribute__((unused))) {
+static CpuData previous_data = {0};
 
-    // Initialize timer for periodic data processing
+// Timer firing on every wall-clock minute boundary, delayed by the allowed lateness and a little
+// slack so the watermark has passed the boundary by the time the tick runs
+int processor_timer_create(int flags) {
     struct itimerspec its;
     struct timespec time_now;
     clock_gettime(CLOCK_REALTIME, &time_now);
 
-    int timer_fd = timerfd_create(CLOCK_REALTIME, 0);
-    its.it_value.tv_sec = (time_now.tv_sec / 60 + 1) * 60;
-    its.it_value.tv_nsec = 0;
+    uint64_t delay_ms = reorder_lateness_ms + REORDER_TIMER_SLACK_MS;
+    int timer_fd = timerfd_create(CLOCK_REALTIME, flags);
+    its.it_value.tv_sec = (time_now.tv_sec / 60 + 1) * 60 + delay_ms / 1000;
+    its.it_value.tv_nsec = (delay_ms % 1000) * 1000000;
     its.it_interval.tv_sec = 60;
     its.it_interval.tv_nsec = 0;
     timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+    return timer_fd;
+}
 
+void processor_tick(void) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_REALTIME, &start);
+
+    // Process every minute the watermark has passed, stamped with the minute's own boundary
+    time_t current_time = time(NULL);
+    uint64_t boundary_ms;
+    while(reorder_next_minute(&boundary_ms)) {
+        instrument_begin(SECTION_MOVING_AVG);
+        calculate_moving_avg((time_t)(boundary_ms / 1000));
+        instrument_end(SECTION_MOVING_AVG);
+        flow_publish((time_t)(boundary_ms / 1000));
+        if(book_enabled) {
+            book_publish((time_t)(boundary_ms / 1000));
+        }
+        stats_publish((time_t)(boundary_ms / 1000));
+        // A shard only holds some symbols, the aggregator correlates them all
+        if(shard_count) {
+            shard_publish_minute((time_t)(boundary_ms / 1000));
+            continue;
+        }
+        instrument_begin(SECTION_CORRELATION);
+        calculate_correlation((time_t)(boundary_ms / 1000));
+        instrument_end(SECTION_CORRELATION);
+        pca_publish((time_t)(boundary_ms / 1000));
+        broadcast_minute_done((time_t)(boundary_ms / 1000));
+    }
+    checkpoint_request();
+    uint64_t watermark = reorder_watermark();
+    if(watermark) {
+        metrics_set(GAUGE_WATERMARK_LAG_MS, (int64_t)current_time * 1000 - (int64_t)watermark);
+    }
+
+    // Get calculation times
+    clock_gettime(CLOCK_REALTIME, &end);
+    if(tsdb_text()) {
+        log_time(&start, &end);
+    }
+    metrics_add(METRIC_TICKS, 1);
+    metrics_set(GAUGE_TICK_DURATION_US, (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_nsec - start.tv_nsec) / 1000);
+    trace_dump(current_time);
+    seq_log(current_time);
+
+    // Get CPU data and log idle time
     CpuData current_data = {0};
-    CpuData previous_data = {0};
+    get_cpu_data(&current_data);
+    float idle_time = get_cpu_idle(&current_data, &previous_data);
+    previous_data = current_data;
+    FILE* file = tsdb_text() ? fopen(CPU_IDLE_LOG, "a") : NULL;
+    if (file) {
+        fprintf(file, CPU_IDLE_RECORD_FMT, time(NULL), idle_time);
+        fclose(file);
+    }
+    tsdb_append(tsdb_series("cpu_idle", 16), current_time, idle_time);
+    tsdb_append(tsdb_series("tick_ms", 24), current_time,
+                (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    tsdb_flush();
 
-    while(!processor_interrupt) {
-        // Wait for the timer to expire
-        uint64_t exp;
-        read(timer_fd, &exp, sizeof(exp));
+    // Per-thread, per-core and hardware counter samples for the same interval
+    instrument_sample(current_time);
+}
 
-        struct timespec start, end;
-        clock_gettime(CLOCK_REALTIME, &start);
+void* processor_func(void* arg __attribute__((unused))) {
 
-        // Process data
-        time_t current_time = time(NULL);
-        calculate_moving_avg(current_time);
-        calculate_correlation(current_time);
+    // Initialize timer for periodic data processing
+    int timer_fd = processor_timer_create(0);
 
-        // Get calculation times
-        clock_gettime(CLOCK_REALTIME, &end);
-        log_time(&start, &end);
+    // Hardware counters are per thread, so they are opened from the processor thread itself
+    instrument_init();
 
-        // Get CPU data and log idle time
-        get_cpu_data(&current_data);
-        float idle_time = get_cpu_idle(&current_data, &previous_data);
-        previous_data = current_data;
-        FILE* file = fopen("logs/cpu_idle.log", "a");
-        if (file) {
-            fprintf(file, "[%ld], %.2f\n", time(NULL), idle_time);
-            fclose(file);
-        }
+    while(!processor_interrupt) {
+        // Wait for the timer to expire
+        uint64_t exp;
+        read(timer_fd, &exp, sizeof(exp));
+        processor_tick();
     }
 
+    instrument_close();
+    close(timer_fd);
+
     return NULL;
-}
\ No newline at end of file
+}
@@ -8,4 +8,6 @@
 
 extern atomic_int processor_interrupt;
 
+int   processor_timer_create(int flags);
+void  processor_tick(void);
 void* processor_func(void* arg);
\ No newline at end of file
@@ -0,0 +1,388 @@
+#include "query.h"
+#include "../utils/utils.h"
+#include "../broadcast/broadcast.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// Local query API: a UNIX socket server answering fixed-size binary requests from published
+// snapshots. Recent trades are read back from the broadcast trade ring, which ingest already
+// writes for every first-delivered trade, and the processor publishes each finalised average and
+// correlation row behind a seqlock, so a query never takes the history locks and never stalls
+// the parser or the minute tick.
+
+char query_socket_path[QUERY_PATH_MAX] = QUERY_SOCKET_PATH;    // Empty string disables the server
+
+// Single writer (the processor), odd seq while an update is in flight
+typedef struct {
+    atomic_uint seq;
+    QueryAverage value;
+} AverageSnapshot;
+
+typedef struct {
+    atomic_uint seq;
+    QueryCorrelationRow value;
+} CorrelationSnapshot;
+
+typedef struct {
+    int fd;
+    unsigned char in[sizeof(QueryRequest)];
+    size_t in_len;
+    unsigned char* out;
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+    int want_out;           // EPOLLOUT armed instead of EPOLLIN
+} Client;
+
+static AverageSnapshot averages[8];
+static CorrelationSnapshot correlations[8];
+
+static pthread_t server_thread;
+static int server_running = 0;
+static int listen_fd = -1;
+static int stop_fd = -1;
+static int epoll_fd = -1;
+static Client clients[QUERY_MAX_CLIENTS];
+
+static void snapshot_write_begin(atomic_uint* seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void snapshot_write_end(atomic_uint* seq) {
+    atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_release);
+}
+
+void query_publish_average(int symbol, time_t minute, double ma, double vwap, uint64_t trades) {
+    AverageSnapshot* s = &averages[symbol];
+    snapshot_write_begin(&s->seq);
+    s->value = (QueryAverage){.symbol = (uint32_t)symbol, .minute = (uint64_t)minute,
+                              .ma = ma, .vwap = vwap, .trades = trades};
+    snapshot_write_end(&s->seq);
+}
+
+void query_publish_correlation(int symbol, time_t minute, const double* row) {
+    CorrelationSnapshot* s = &correlations[symbol];
+    snapshot_write_begin(&s->seq);
+    s->value.symbol = (uint32_t)symbol;
+    s->value.minute = (uint64_t)minute;
+    memcpy(s->value.corr, row, sizeof(s->value.corr));
+    snapshot_write_end(&s->seq);
+}
+
+// Seqlock read, retries while the processor is mid-update. Returns the seq, 0 if never published
+static unsigned int snapshot_read(atomic_uint* seq, const void* src, void* dst, size_t size) {
+    for (;;) {
+        unsigned int s1 = atomic_load_explicit(seq, memory_order_acquire);
+        if (s1 & 1) {
+            continue;
+        }
+        memcpy(dst, src, size);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seq, memory_order_relaxed) == s1) {
+            return s1;
+        }
+    }
+}
+
+static void* reserve(Client* c, size_t len) {
+    if (c->out_len + len > c->out_cap) {
+        c->out_cap = (c->out_len + len) * 2;
+        c->out = realloc(c->out, c->out_cap);
+    }
+    void* p = c->out + c->out_len;
+    c->out_len += len;
+    return p;
+}
+
+static int compare_trades(const void* a, const void* b) {
+    const QueryTrade* x = a;
+    const QueryTrade* y = b;
+    if (x->timestamp != y->timestamp) return x->timestamp < y->timestamp ? -1 : 1;
+    return x->trade_id < y->trade_id ? -1 : x->trade_id > y->trade_id;
+}
+
+// Appends up to `limit` of the `wanted` newest trades of one symbol, walking its own positions in the
+// broadcast ring back from the newest, then sorts them by event time. Range queries keep walking a
+// minute past from_ms since arrival order is only roughly event order. Sets *cut when trades the
+// request covers were left out, because they did not fit or are no longer held; a range whose walk
+// already passed from_ms before running out counts as complete
+static uint32_t collect_trades(int symbol, QueryTrade* out, uint32_t limit, uint32_t wanted, int range,
+                               uint64_t from_ms, uint64_t to_ms, int* cut) {
+    uint32_t n = 0;
+    uint64_t oldest = UINT64_MAX;
+    *cut = 0;
+
+    for (uint64_t k = broadcast_symbol_head(symbol); k > 0 && (range || n < wanted); k--) {
+        BroadcastTrade b;
+        int found = broadcast_symbol_trade(symbol, k - 1, &b);
+        if (found < 0) {
+            *cut = !range || oldest >= from_ms;
+            break;
+        }
+        if (found == 0) {
+            continue;
+        }
+        QueryTrade t = {b.timestamp, b.trade_id, b.price, b.volume};
+        if (t.timestamp < oldest) {
+            oldest = t.timestamp;
+        }
+        if (range) {
+            if (t.timestamp + 60000 < from_ms) {
+                break;
+            }
+            if (t.timestamp < from_ms || t.timestamp > to_ms) {
+                continue;
+            }
+        }
+        if (n == limit) {
+            *cut = 1;
+            break;
+        }
+        out[n++] = t;
+    }
+    qsort(out, n, sizeof(QueryTrade), compare_trades);
+    return n;
+}
+
+static void answer(Client* c, const QueryRequest* req) {
+    size_t start = c->out_len;
+    QueryResponse* head = reserve(c, sizeof(QueryResponse));
+    *head = (QueryResponse){.type = req->type, .status = QUERY_OK, .count = 0};
+
+    int all = req->symbol == QUERY_ALL_SYMBOLS;
+    if (!all && req->symbol >= 8) {
+        head->status = QUERY_BAD_REQUEST;
+        return;
+    }
+    int first = all ? 0 : req->symbol;
+    int last = all ? 7 : req->symbol;
+    uint32_t count = 0;
+    int cut = 0;
+
+    switch (req->type) {
+        case QUERY_AVERAGES:
+            for (int i = first; i <= last; i++) {
+                QueryAverage v;
+                if (snapshot_read(&averages[i].seq, &averages[i].value, &v, sizeof(v))) {
+                    *(QueryAverage*)reserve(c, sizeof(v)) = v;
+                    count++;
+                }
+            }
+            break;
+        case QUERY_CORRELATION:
+            for (int i = first; i <= last; i++) {
+                QueryCorrelationRow v;
+                if (snapshot_read(&correlations[i].seq, &correlations[i].value, &v, sizeof(v))) {
+                    *(QueryCorrelationRow*)reserve(c, sizeof(v)) = v;
+                    count++;
+                }
+            }
+            break;
+        case QUERY_LAST_TRADES:
+        case QUERY_TRADE_RANGE: {
+            if (all) {
+                break;
+            }
+            int range = req->type == QUERY_TRADE_RANGE;
+            uint32_t wanted = req->count ? req->count : QUERY_RECENT_TRADES;
+            uint32_t limit = range || wanted > QUERY_RECENT_TRADES ? QUERY_RECENT_TRADES : wanted;
+            QueryTrade* out = reserve(c, limit * sizeof(QueryTrade));
+            count = collect_trades(first, out, limit, wanted, range, req->from_ms, req->to_ms, &cut);
+            c->out_len -= (limit - count) * sizeof(QueryTrade);
+            break;
+        }
+        default:
+            break;
+    }
+
+    // reserve may have moved the buffer
+    head = (QueryResponse*)(c->out + start);
+    if (req->type < QUERY_AVERAGES || req->type > QUERY_TRADE_RANGE ||
+        (all && (req->type == QUERY_LAST_TRADES || req->type == QUERY_TRADE_RANGE))) {
+        head->status = QUERY_BAD_REQUEST;
+    } else if (count == 0 && (req->type == QUERY_AVERAGES || req->type == QUERY_CORRELATION)) {
+        head->status = QUERY_NOT_READY;
+    } else if (cut) {
+        head->status = QUERY_TRUNCATED;
+    }
+    head->count = count;
+}
+
+static void close_client(Client* c) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    free(c->out);
+    *c = (Client){.fd = -1};
+}
+
+// Writes what the socket takes, arming EPOLLOUT only while a response is left over
+static int flush_client(Client* c) {
+    while (c->out_sent < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return -1;
+        }
+        c->out_sent += (size_t)n;
+    }
+    int pending = c->out_sent < c->out_len;
+    if (!pending) {
+        c->out_len = c->out_sent = 0;
+    }
+    if (pending != c->want_out) {
+        struct epoll_event ev = {.events = pending ? EPOLLOUT : EPOLLIN, .data.u32 = (uint32_t)(c - clients)};
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->want_out = pending;
+    }
+    return 0;
+}
+
+static int read_client(Client* c) {
+    for (;;) {
+        ssize_t n = recv(c->fd, c->in + c->in_len, sizeof(c->in) - c->in_len, 0);
+        if (n == 0) {
+            return -1;
+        }
+        if (n < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+        c->in_len += (size_t)n;
+        if (c->in_len == sizeof(QueryRequest)) {
+            QueryRequest req;
+            memcpy(&req, c->in, sizeof(req));
+            c->in_len = 0;
+            answer(c, &req);
+
+            // Stop reading until a large backlog has drained, the client is behind anyway
+            if (c->out_len > QUERY_OUT_HIGH) {
+                return 0;
+            }
+        }
+    }
+}
+
+static void accept_clients(void) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        int slot = -1;
+        for (int i = 0; i < QUERY_MAX_CLIENTS; i++) {
+            if (clients[i].fd < 0) {
+                slot = i;
+                break;
+            }
+        }
+        if (slot < 0) {
+            close(fd);
+            continue;
+        }
+        clients[slot] = (Client){.fd = fd};
+        struct epoll_event ev = {.events = EPOLLIN, .data.u32 = (uint32_t)slot};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+#define LISTEN_TAG UINT32_MAX
+#define STOP_TAG (UINT32_MAX - 1)
+
+static void* server_func(void* arg __attribute__((unused))) {
+    struct epoll_event events[32];
+    for (;;) {
+        int n = epoll_wait(epoll_fd, events, 32, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("query epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            uint32_t tag = events[i].data.u32;
+            if (tag == STOP_TAG) {
+                return NULL;
+            }
+            if (tag == LISTEN_TAG) {
+                accept_clients();
+                continue;
+            }
+            Client* c = &clients[tag];
+            if (c->fd < 0) {
+                continue;
+            }
+            // Level triggered: requests left unread behind a backlog fire again once EPOLLIN is rearmed
+            if ((events[i].events & (EPOLLERR | EPOLLHUP)) ||
+                ((events[i].events & EPOLLIN) && read_client(c) < 0) ||
+                flush_client(c) < 0) {
+                close_client(c);
+            }
+        }
+    }
+    return NULL;
+}
+
+int query_start(void) {
+    if (query_socket_path[0] == '\0') {
+        return 0;
+    }
+    for (int i = 0; i < QUERY_MAX_CLIENTS; i++) {
+        clients[i].fd = -1;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    memcpy(addr.sun_path, query_socket_path, strlen(query_socket_path) + 1);    // -q checked the length
+    unlink(query_socket_path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listen_fd, 16) < 0) {
+        perror("query socket");
+        if (listen_fd >= 0) close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+
+    stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = LISTEN_TAG};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.u32 = STOP_TAG;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, stop_fd, &ev);
+
+    if (pthread_create(&server_thread, NULL, server_func, NULL) != 0) {
+        perror("query thread");
+        return -1;
+    }
+    pthread_setname_np(server_thread, "espx-query");
+    server_running = 1;
+    printf("Query API listening on %s\n", query_socket_path);
+    return 0;
+}
+
+void query_stop(void) {
+    if (!server_running) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(stop_fd, &one, sizeof(one)) < 0) {
+        perror("query stop");
+    }
+    pthread_join(server_thread, NULL);
+    server_running = 0;
+
+    for (int i = 0; i < QUERY_MAX_CLIENTS; i++) {
+        if (clients[i].fd >= 0) {
+            close_client(&clients[i]);
+        }
+    }
+    close(epoll_fd);
+    close(stop_fd);
+    close(listen_fd);
+    unlink(query_socket_path);
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/un.h>
+
+#define QUERY_SOCKET_PATH "/tmp/espx_query.sock"
+#define QUERY_PATH_MAX sizeof(((struct sockaddr_un*)0)->sun_path)    // Including the terminator
+#define QUERY_RECENT_TRADES 4096    // Cap on trades in one response, read back through the broadcast ring
+#define QUERY_ALL_SYMBOLS 0xFFFF
+#define QUERY_MAX_CLIENTS 64
+#define QUERY_OUT_HIGH (256 * 1024)  // Unsent response bytes before a client's requests are left in the socket
+
+// Wire protocol, host byte order: fixed size requests, each answered by a QueryResponse
+// header followed by `count` records of the type's record struct.
+typedef enum {
+    QUERY_AVERAGES = 1,     // QueryAverage per symbol, or all symbols
+    QUERY_CORRELATION,      // QueryCorrelationRow per symbol, or the full matrix
+    QUERY_LAST_TRADES,      // Last `count` QueryTrade of one symbol, oldest first
+    QUERY_TRADE_RANGE,      // QueryTrade of one symbol with from_ms <= ts <= to_ms
+} QueryType;
+
+typedef enum {
+    QUERY_OK,
+    QUERY_BAD_REQUEST,
+    QUERY_NOT_READY,        // No minute has been finalised yet
+    QUERY_TRUNCATED,        // Trades asked for are older than the ring still holds or past the cap, the newest are sent
+} QueryStatus;
+
+typedef struct {
+    uint16_t type;
+    uint16_t symbol;
+    uint32_t count;
+    uint64_t from_ms;
+    uint64_t to_ms;
+} QueryRequest;
+
+typedef struct {
+    uint16_t type;
+    uint16_t status;
+    uint32_t count;
+} QueryResponse;
+
+typedef struct {
+    uint32_t symbol;
+    uint32_t reserved;
+    uint64_t minute;
+    double ma;
+    double vwap;
+    uint64_t trades;
+} QueryAverage;
+
+typedef struct {
+    uint32_t symbol;
+    uint32_t reserved;
+    uint64_t minute;
+    double corr[8];
+} QueryCorrelationRow;
+
+typedef struct {
+    uint64_t timestamp;
+    uint64_t trade_id;
+    double price;
+    double volume;
+} QueryTrade;
+
+
+extern char query_socket_path[QUERY_PATH_MAX];
+
+void query_publish_average(int symbol, time_t minute, double ma, double vwap, uint64_t trades);
+void query_publish_correlation(int symbol, time_t minute, const double* row);
+int  query_start(void);
+void query_stop(void);
@@ -0,0 +1,175 @@
+#include "reorder.h"
+#include "../utils/utils.h"
+#include "../metrics/metrics.h"
+#include <time.h>
+
+// Event-time ordering in front of the moving average windows. Trades wait in a per-symbol
+// min-heap until the minute they belong to is finalised; the watermark (highest exchange
+// timestamp seen on any symbol minus the allowed lateness) decides when that is. Anything
+// arriving at or behind the watermark, or behind a finalised minute, is late and left out, so
+// a result never changes once written and a replay produces the same minutes regardless of
+// network jitter. On a live feed exchange timestamps are only trusted up to REORDER_MAX_SKEW_MS
+// ahead of the wall clock, and once no trade has arrived for longer than the lateness the event
+// clock is carried forward by the idle wall time, so a quiet market or a dead feed still closes
+// its minutes. A replay turns both off (reorder_wall_clock = 0) and runs on exchange time alone.
+
+uint64_t reorder_lateness_ms = 2000;
+int reorder_wall_clock = 1;
+
+static atomic_uint_fast64_t max_event_ms = 0;
+static atomic_uint_fast64_t closed_ms = 0;     // Last finalised boundary, trades before it are late
+static atomic_uint_fast64_t last_insert_ms = 0; // Wall clock of the newest accepted trade
+static uint64_t next_boundary = 0;      // Only touched by whoever finalises minutes
+
+static inline int before(const TradeData* a, const TradeData* b) {
+    return a->timestamp < b->timestamp || (a->timestamp == b->timestamp && a->trade_id < b->trade_id);
+}
+
+static void heap_push(SymbolHistory* h, const TradeData* trade) {
+    if (h->pending_count == h->pending_capacity) {
+        h->pending_capacity = h->pending_capacity ? h->pending_capacity * 2 : 128;
+        h->pending = realloc(h->pending, h->pending_capacity * sizeof(TradeData));
+    }
+
+    size_t i = h->pending_count++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!before(trade, &h->pending[parent])) break;
+        h->pending[i] = h->pending[parent];
+        i = parent;
+    }
+    h->pending[i] = *trade;
+}
+
+static void heap_pop(SymbolHistory* h, TradeData* out) {
+    *out = h->pending[0];
+    TradeData last = h->pending[--h->pending_count];
+
+    size_t i = 0;
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= h->pending_count) break;
+        if (child + 1 < h->pending_count && before(&h->pending[child + 1], &h->pending[child])) child++;
+        if (!before(&h->pending[child], &last)) break;
+        h->pending[i] = h->pending[child];
+        i = child;
+    }
+    if (h->pending_count > 0) {
+        h->pending[i] = last;
+    }
+}
+
+// Coarse clock, a tick of error is far below the skew and lateness and it is read for every trade
+static uint64_t wall_now_ms(void) {
+    struct timespec wall;
+    clock_gettime(CLOCK_REALTIME_COARSE, &wall);
+    return (uint64_t)wall.tv_sec * 1000 + wall.tv_nsec / 1000000;
+}
+
+static uint64_t clamp_event(uint64_t timestamp, uint64_t wall_ms) {
+    uint64_t skew = REORDER_MAX_SKEW_MS < reorder_lateness_ms / 2 ? REORDER_MAX_SKEW_MS : reorder_lateness_ms / 2;
+    return timestamp < wall_ms + skew ? timestamp : wall_ms + skew;
+}
+
+// Exchange time as far as the watermark trusts it: on a live feed no more than the skew ahead of the
+// wall clock, so one trade stamped in the future cannot push other trades or buckets out
+uint64_t reorder_event_time(uint64_t timestamp) {
+    return reorder_wall_clock ? clamp_event(timestamp, wall_now_ms()) : timestamp;
+}
+
+uint64_t reorder_watermark(void) {
+    uint64_t max = atomic_load(&max_event_ms);
+    return max > reorder_lateness_ms ? max - reorder_lateness_ms : 0;
+}
+
+// Returns -1 when the trade is late and was dropped
+int reorder_insert(int symbol, const TradeData* trade) {
+    SymbolHistory* h = &symbol_histories[symbol];
+    pthread_mutex_lock(&h->mutex);
+
+    // Read under the lock so a minute released by the processor is always behind what we compare to
+    uint64_t watermark = reorder_watermark();
+    if ((watermark && trade->timestamp <= watermark) || trade->timestamp < atomic_load(&closed_ms)) {
+        pthread_mutex_unlock(&h->mutex);
+        metrics_add_symbol(SYMBOL_METRIC_LATE, symbol, 1);
+        return -1;
+    }
+    heap_push(h, trade);
+    pthread_mutex_unlock(&h->mutex);
+
+    // A single trade stamped in the future must not make every other symbol's trades late
+    uint64_t event = trade->timestamp;
+    if (reorder_wall_clock) {
+        uint64_t wall_ms = wall_now_ms();
+        event = clamp_event(event, wall_ms);
+        atomic_store(&last_insert_ms, wall_ms);
+    }
+    uint64_t max = atomic_load(&max_event_ms);
+    while (event > max && !atomic_compare_exchange_weak(&max_event_ms, &max, event));
+    return 0;
+}
+
+// Restored state at startup: no lateness check, the trades are released at the first boundary
+void reorder_preload(int symbol, const TradeData* trade) {
+    SymbolHistory* h = &symbol_histories[symbol];
+    pthread_mutex_lock(&h->mutex);
+    heap_push(h, trade);
+    pthread_mutex_unlock(&h->mutex);
+
+    if (trade->timestamp > atomic_load(&max_event_ms)) {
+        atomic_store(&max_event_ms, trade->timestamp);
+    }
+}
+
+// Moves pending trades older than until_ms into the window, in timestamp order. Caller holds h->mutex.
+size_t reorder_release(SymbolHistory* h, uint64_t until_ms) {
+    size_t released = 0;
+    TradeData trade;
+    while (h->pending_count > 0 && h->pending[0].timestamp < until_ms) {
+        heap_pop(h, &trade);
+        history_push(h, &trade);
+        released++;
+    }
+    return released;
+}
+
+// Next minute boundary the watermark has passed, one per call until caught up. After more than
+// the lateness without a trade the watermark moves on by the idle time, so the minute a live
+// feed went quiet in closes about when it would have with trades still arriving
+int reorder_next_minute(uint64_t* boundary_ms) {
+    uint64_t watermark = reorder_watermark();
+    if (!watermark) {
+        return 0;
+    }
+    if (!next_boundary) {
+        next_boundary = (watermark / REORDER_MINUTE_MS + 1) * REORDER_MINUTE_MS;
+    }
+    uint64_t last = atomic_load(&last_insert_ms);
+    if (reorder_wall_clock && last) {
+        uint64_t now = wall_now_ms();
+        if (now > last + reorder_lateness_ms) {
+            watermark += now - last;
+        }
+    }
+    if (watermark < next_boundary) {
+        return 0;
+    }
+
+    // Published before the windows are released, inserts after this see the minute as closed
+    *boundary_ms = next_boundary;
+    atomic_store(&closed_ms, next_boundary);
+    next_boundary += REORDER_MINUTE_MS;
+    return 1;
+}
+
+void reorder_reset(void) {
+    for (int i = 0; i < 8; i++) {
+        pthread_mutex_lock(&symbol_histories[i].mutex);
+        symbol_histories[i].pending_count = 0;
+        pthread_mutex_unlock(&symbol_histories[i].mutex);
+    }
+    atomic_store(&max_event_ms, 0);
+    atomic_store(&closed_ms, 0);
+    atomic_store(&last_insert_ms, 0);
+    next_boundary = 0;
+}
@@ -0,0 +1,22 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define REORDER_MINUTE_MS 60000
+#define WINDOW_MS 900000    // 15 minute moving average window
+#define REORDER_MAX_SKEW_MS 100     // Exchange clock lead accepted by the watermark, at most half the lateness
+#define REORDER_TIMER_SLACK_MS 250  // Tick delay past boundary + lateness, so the last late trades have arrived
+
+typedef struct TradeData TradeData;
+typedef struct SymbolHistory SymbolHistory;
+
+extern uint64_t reorder_lateness_ms;
+extern int reorder_wall_clock;         // 0 for replays: no skew limit and no idle timeout
+
+uint64_t reorder_event_time(uint64_t timestamp);
+uint64_t reorder_watermark(void);
+int      reorder_insert(int symbol, const TradeData* trade);
+void     reorder_preload(int symbol, const TradeData* trade);
+size_t   reorder_release(SymbolHistory* h, uint64_t until_ms);
+int      reorder_next_minute(uint64_t* boundary_ms);
+void     reorder_reset(void);
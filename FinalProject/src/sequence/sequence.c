@@ -0,0 +1,116 @@
+#include "sequence.h"
+#include "../utils/utils.h"
+#include "../metrics/metrics.h"
+
+SeqTracker seq_trackers[8];
+
+static inline int test_bit(const SeqTracker* t, uint64_t id) {
+    uint64_t bit = id % SEQ_WINDOW;
+    return (t->seen[bit / 64] >> (bit % 64)) & 1;
+}
+
+static inline void set_bit(SeqTracker* t, uint64_t id) {
+    uint64_t bit = id % SEQ_WINDOW;
+    t->seen[bit / 64] |= 1ull << (bit % 64);
+}
+
+static inline void clear_bit(SeqTracker* t, uint64_t id) {
+    uint64_t bit = id % SEQ_WINDOW;
+    t->seen[bit / 64] &= ~(1ull << (bit % 64));
+}
+
+void seq_init(SeqTracker* t) {
+    pthread_mutex_init(&t->lock, NULL);
+    seq_reset(t);
+}
+
+void seq_reset(SeqTracker* t) {
+    pthread_mutex_lock(&t->lock);
+    t->highest = 0;
+    memset(t->seen, 0, sizeof(t->seen));
+    t->gaps = t->filled = t->duplicates = t->stale = 0;
+    pthread_mutex_unlock(&t->lock);
+}
+
+// OKX aggregates fills into one trade whose tradeId is the last of count ids, the batch is
+// accepted or rejected by that last id and all of its ids are marked as seen
+SeqResult seq_check(SeqTracker* t, int symbol, uint64_t id, uint64_t count) {
+    SeqResult result = SEQ_NEW;
+    if (count == 0 || count > id) {
+        count = 1;
+    }
+    if (count > SEQ_WINDOW) {
+        count = SEQ_WINDOW;
+    }
+    uint64_t first = id - count + 1;
+    pthread_mutex_lock(&t->lock);
+
+    if (t->highest == 0) {
+        t->highest = id;
+        for (uint64_t k = first; k <= id; k++) {
+            set_bit(t, k);
+        }
+    } else if (id > t->highest) {
+        // Slide the window forward, forgetting the slots the new ids reuse
+        uint64_t skipped = first > t->highest + 1 ? first - t->highest - 1 : 0;
+        if (id - t->highest >= SEQ_WINDOW) {
+            memset(t->seen, 0, sizeof(t->seen));
+        } else {
+            for (uint64_t k = t->highest + 1; k < first; k++) {
+                clear_bit(t, k);
+            }
+        }
+        for (uint64_t k = first > t->highest ? first : t->highest + 1; k <= id; k++) {
+            set_bit(t, k);
+        }
+        t->highest = id;
+        if (skipped) {
+            t->gaps += skipped;
+            metrics_add_symbol(SYMBOL_METRIC_SEQ_GAPS, symbol, skipped);
+        }
+    } else if (t->highest - id >= SEQ_WINDOW) {
+        t->stale++;
+        metrics_add_symbol(SYMBOL_METRIC_SEQ_STALE, symbol, 1);
+        result = SEQ_STALE;
+    } else if (test_bit(t, id)) {
+        t->duplicates++;
+        metrics_add_symbol(SYMBOL_METRIC_SEQ_DUPLICATES, symbol, 1);
+        result = SEQ_DUPLICATE;
+    } else {
+        // Ids older than the first one seen were never counted as gaps
+        uint64_t filled = 0;
+        for (uint64_t k = first; k <= id; k++) {
+            if (t->highest - k < SEQ_WINDOW && !test_bit(t, k)) {
+                set_bit(t, k);
+                filled++;
+            }
+        }
+        if (filled > t->gaps - t->filled) {
+            filled = t->gaps - t->filled;
+        }
+        if (filled) {
+            t->filled += filled;
+            metrics_add_symbol(SYMBOL_METRIC_SEQ_FILLED, symbol, filled);
+        }
+    }
+
+    pthread_mutex_unlock(&t->lock);
+    return result;
+}
+
+void seq_log(time_t now) {
+    FILE* f = fopen("logs/sequence.log", "a");
+    if (!f) {
+        return;
+    }
+    for (int i = 0; i < 8; i++) {
+        SeqTracker* t = &seq_trackers[i];
+        pthread_mutex_lock(&t->lock);
+        fprintf(f, "[%ld], %s, highest: %llu, gaps: %llu, filled: %llu, missing: %llu, duplicates: %llu, stale: %llu\n",
+            (long)now, symbols[i], (unsigned long long)t->highest, (unsigned long long)t->gaps,
+            (unsigned long long)t->filled, (unsigned long long)(t->gaps - t->filled),
+            (unsigned long long)t->duplicates, (unsigned long long)t->stale);
+        pthread_mutex_unlock(&t->lock);
+    }
+    fclose(f);
+}
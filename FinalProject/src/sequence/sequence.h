@@ -0,0 +1,31 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#define SEQ_WINDOW 1024     // Trade ids remembered below the highest one seen
+
+typedef enum {
+    SEQ_NEW,
+    SEQ_DUPLICATE,
+    SEQ_STALE,              // Too far behind the window to tell, treated as already seen
+} SeqResult;
+
+// Per-symbol tradeId tracker: highest id plus a ring bitmap of the ids below it
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t highest;
+    uint64_t seen[SEQ_WINDOW / 64];
+
+    uint64_t gaps;          // Ids skipped when the highest id jumped ahead
+    uint64_t filled;        // Skipped ids that arrived later
+    uint64_t duplicates;
+    uint64_t stale;
+} SeqTracker;
+
+extern SeqTracker seq_trackers[8];
+
+void      seq_init(SeqTracker* t);
+void      seq_reset(SeqTracker* t);
+SeqResult seq_check(SeqTracker* t, int symbol, uint64_t id, uint64_t count);   // ids id - count + 1 .. id
+void      seq_log(time_t now);
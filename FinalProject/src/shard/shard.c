@@ -0,0 +1,392 @@
+#include "shard.h"
+#include "../utils/utils.h"
+#include "../calculate/correlation.h"
+#include "../broadcast/broadcast.h"
+#include "../tsdb/tsdb.h"
+#include "../pca/pca.h"
+#include <errno.h>
+#include <poll.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Symbol sharding: every ingest process owns the symbols i with i % N == K, computes their
+// windows and moving averages as usual and sends one ShardMinute per closed minute to the
+// aggregator. The aggregator rebuilds the moving average rings of all symbols and runs the
+// unchanged calculate_correlation on them, so data/corr matches a single process whenever
+// every shard reports. A minute is closed when all shards have sent it, or shard_grace_ms
+// after the first one did.
+
+int shard_index = 0;
+int shard_count = 0;
+char shard_address[128] = SHARD_ADDRESS;
+unsigned int shard_grace_ms = 10000;
+
+int shard_parse(const char* spec) {
+    int k, n;
+    if (sscanf(spec, "%d/%d", &k, &n) != 2 || n < 1 || n > SHARD_MAX || k < 0 || k >= n) {
+        return -1;
+    }
+    shard_index = k;
+    shard_count = n;
+    return 0;
+}
+
+// Rejects UNIX paths that would not fit sun_path rather than truncating them
+int shard_parse_address(const char* address) {
+    if (strlen(address) >= sizeof(shard_address) ||
+        (strncmp(address, "unix:", 5) == 0 && strlen(address + 5) >= sizeof(((struct sockaddr_un*)0)->sun_path))) {
+        return -1;
+    }
+    strcpy(shard_address, address);
+    return 0;
+}
+
+int shard_owns(int symbol) {
+    return shard_count == 0 || symbol % shard_count == shard_index;
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// unix:PATH or HOST:PORT, an empty host listens on every interface
+static int open_socket(const char* address, int listening) {
+    int fd;
+    if (strncmp(address, "unix:", 5) == 0) {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        size_t len = strlen(address + 5);
+        if (len >= sizeof(addr.sun_path)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memcpy(addr.sun_path, address + 5, len + 1);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (listening) {
+            unlink(addr.sun_path);
+            if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 && listen(fd, SHARD_MAX) == 0) {
+                return fd;
+            }
+        } else if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
+            return fd;
+        }
+        close(fd);
+        return -1;
+    }
+
+    char host[128];
+    const char* colon = strrchr(address, ':');
+    if (!colon || (size_t)(colon - address) >= sizeof(host)) {
+        errno = EINVAL;
+        return -1;
+    }
+    memcpy(host, address, (size_t)(colon - address));
+    host[colon - address] = '\0';
+
+    struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM, .ai_flags = listening ? AI_PASSIVE : 0};
+    struct addrinfo* res;
+    if (getaddrinfo(host[0] ? host : NULL, colon + 1, &hints, &res) != 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    fd = -1;
+    for (struct addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int one = 1;
+        if (listening) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, SHARD_MAX) == 0) {
+                break;
+            }
+        } else {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            // Bounded wait so a missing aggregator never stalls the minute tick for long
+            int err = 0;
+            socklen_t err_len = sizeof(err);
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+            if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 ||
+                (errno == EINPROGRESS && poll(&pfd, 1, 200) == 1 &&
+                 getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &err_len) == 0 && err == 0)) {
+                break;
+            }
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    return fd;
+}
+
+// ---- shard side ----
+
+static int client_fd = -1;
+static ShardMinute current;
+static ShardMinute backlog[SHARD_BACKLOG];
+static unsigned int backlog_head = 0, backlog_count = 0;
+
+void shard_record_average(int symbol, double ma, uint64_t trades) {
+    current.symbols |= 1u << symbol;
+    current.ma[symbol] = ma;
+    current.trades[symbol] = trades;
+}
+
+// Queues the minute, then sends as much of the backlog as the socket takes without blocking.
+// Minutes older than the backlog are lost, the aggregator treats them as a missing shard
+void shard_publish_minute(time_t minute) {
+    current.magic = SHARD_MAGIC;
+    current.version = SHARD_VERSION;
+    current.shard = (uint8_t)shard_index;
+    current.shard_count = (uint8_t)shard_count;
+    current.minute = (uint64_t)minute;
+    if (backlog_count == SHARD_BACKLOG) {
+        backlog_head = (backlog_head + 1) % SHARD_BACKLOG;
+        backlog_count--;
+    }
+    backlog[(backlog_head + backlog_count++) % SHARD_BACKLOG] = current;
+    current = (ShardMinute){0};
+
+    if (client_fd < 0) {
+        client_fd = open_socket(shard_address, 0);
+        if (client_fd < 0) {
+            fprintf(stderr, "Aggregator %s unreachable, %u minute(s) queued\n", shard_address, backlog_count);
+            return;
+        }
+    }
+    while (backlog_count > 0) {
+        ssize_t n = send(client_fd, &backlog[backlog_head], sizeof(ShardMinute), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n == (ssize_t)sizeof(ShardMinute)) {
+            backlog_head = (backlog_head + 1) % SHARD_BACKLOG;
+            backlog_count--;
+            continue;
+        }
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+
+        // A partial record would desynchronise the stream, resend it whole on a new connection
+        close(client_fd);
+        client_fd = -1;
+        break;
+    }
+}
+
+void shard_close(void) {
+    if (client_fd >= 0) {
+        close(client_fd);
+        client_fd = -1;
+    }
+}
+
+// ---- aggregator side ----
+
+typedef struct {
+    int used;
+    uint64_t minute;
+    uint32_t shards;                // Shards that have reported
+    uint32_t symbols;
+    double ma[8];
+    uint64_t opened_ms;
+} PendingMinute;
+
+typedef struct {
+    int fd;
+    size_t len;
+    unsigned char buf[sizeof(ShardMinute)];
+} ShardConn;
+
+static PendingMinute pending[SHARD_PENDING];
+static ShardConn conns[SHARD_MAX * 2];
+static uint64_t last_closed = 0;
+static int missed[8];
+
+static void push_average(SymbolHistory* h, uint64_t minute, double ma) {
+    h->movingAvg_history[h->movingAvg_index] = ma;
+    h->movingAvg_timestamps[h->movingAvg_index] = (time_t)minute;
+    h->movingAvg_index = (h->movingAvg_index + 1) % 8;
+    h->movingAvg_count = h->movingAvg_count < 8 ? h->movingAvg_count + 1 : 8;
+}
+
+static void close_minute(PendingMinute* p, int shards) {
+    for (int i = 0; i < 8; i++) {
+        SymbolHistory* h = &symbol_histories[i];
+        pthread_mutex_lock(&h->mutex);
+        if (p->symbols & (1u << i)) {
+            push_average(h, p->minute, p->ma[i]);
+            missed[i] = 0;
+        } else if (h->movingAvg_count > 0 && ++missed[i] <= SHARD_MAX_CARRY) {
+            // A short gap keeps the symbol aligned with the others by repeating its last average
+            push_average(h, p->minute, h->movingAvg_history[(h->movingAvg_index + 7) % 8]);
+        } else {
+            h->movingAvg_count = 0;
+        }
+        pthread_mutex_unlock(&h->mutex);
+    }
+    uint32_t all = (1u << shards) - 1;
+    if (p->shards != all) {
+        fprintf(stderr, "Minute %llu closed without shard mask 0x%x\n", (unsigned long long)p->minute, all & ~p->shards);
+    }
+
+    calculate_correlation((time_t)p->minute);
+    pca_publish((time_t)p->minute);
+    broadcast_minute_done((time_t)p->minute);
+    tsdb_flush();
+    last_closed = p->minute;
+    p->used = 0;
+}
+
+// Closes every open minute up to and including `minute`, oldest first
+static void close_through(uint64_t minute, int shards) {
+    for (;;) {
+        PendingMinute* oldest = NULL;
+        for (int i = 0; i < SHARD_PENDING; i++) {
+            if (pending[i].used && pending[i].minute <= minute && (!oldest || pending[i].minute < oldest->minute)) {
+                oldest = &pending[i];
+            }
+        }
+        if (!oldest) {
+            return;
+        }
+        close_minute(oldest, shards);
+    }
+}
+
+static void handle_minute(const ShardMinute* m, int shards) {
+    if (m->magic != SHARD_MAGIC || m->version != SHARD_VERSION || m->shard_count != shards || m->shard >= shards) {
+        fprintf(stderr, "Dropping record from shard %u/%u, expected %d shards\n", m->shard, m->shard_count, shards);
+        return;
+    }
+    if (m->minute <= last_closed) {
+        fprintf(stderr, "Shard %u late for minute %llu\n", m->shard, (unsigned long long)m->minute);
+        return;
+    }
+
+    PendingMinute* p = NULL;
+    PendingMinute* oldest = NULL;
+    for (int i = 0; i < SHARD_PENDING && !p; i++) {
+        if (pending[i].used && pending[i].minute == m->minute) {
+            p = &pending[i];
+        } else if (pending[i].used && (!oldest || pending[i].minute < oldest->minute)) {
+            oldest = &pending[i];
+        }
+    }
+    if (!p) {
+        for (int i = 0; i < SHARD_PENDING && !p; i++) {
+            if (!pending[i].used) p = &pending[i];
+        }
+        if (!p) {
+            close_through(oldest->minute, shards);
+            p = oldest;
+        }
+        *p = (PendingMinute){.used = 1, .minute = m->minute, .opened_ms = now_ms()};
+    }
+
+    p->shards |= 1u << m->shard;
+    for (int i = 0; i < 8; i++) {
+        if (m->symbols & (1u << i)) {
+            p->symbols |= 1u << i;
+            p->ma[i] = m->ma[i];
+        }
+    }
+
+    // Each connection is in minute order, so a complete minute also closes the older ones
+    if (p->shards == (1u << shards) - 1) {
+        close_through(p->minute, shards);
+    }
+}
+
+static void read_conn(ShardConn* c, int shards) {
+    for (;;) {
+        ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+        if (n <= 0) {
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                close(c->fd);
+                c->fd = -1;
+            }
+            return;
+        }
+        c->len += (size_t)n;
+        if (c->len == sizeof(ShardMinute)) {
+            ShardMinute m;
+            memcpy(&m, c->buf, sizeof(m));
+            c->len = 0;
+            handle_minute(&m, shards);
+        }
+    }
+}
+
+#define LISTEN_TAG UINT32_MAX
+
+int aggregator_run(int shards, volatile sig_atomic_t* stop) {
+    int listen_fd = open_socket(shard_address, 1);
+    if (listen_fd < 0) {
+        perror("aggregator socket");
+        return 1;
+    }
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = LISTEN_TAG};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+    for (int i = 0; i < SHARD_MAX * 2; i++) {
+        conns[i].fd = -1;
+    }
+    printf("Aggregating %d shards on %s, grace %u ms\n", shards, shard_address, shard_grace_ms);
+
+    // Short timeout so grace deadlines and the stop flag are checked without a timer
+    while (!*stop) {
+        struct epoll_event events[16];
+        int n = epoll_wait(epoll_fd, events, 16, 100);
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.u32 != LISTEN_TAG) {
+                ShardConn* c = &conns[events[i].data.u32];
+                if (c->fd >= 0) {
+                    read_conn(c, shards);
+                }
+                continue;
+            }
+            int fd;
+            while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                int slot = -1;
+                for (int k = 0; k < SHARD_MAX * 2 && slot < 0; k++) {
+                    if (conns[k].fd < 0) slot = k;
+                }
+                if (slot < 0) {
+                    close(fd);
+                    continue;
+                }
+                conns[slot] = (ShardConn){.fd = fd};
+                struct epoll_event cev = {.events = EPOLLIN, .data.u32 = (uint32_t)slot};
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &cev);
+            }
+        }
+
+        uint64_t now = now_ms();
+        for (int i = 0; i < SHARD_PENDING; i++) {
+            if (pending[i].used && now - pending[i].opened_ms >= shard_grace_ms) {
+                close_through(pending[i].minute, shards);
+            }
+        }
+    }
+
+    // Minutes still open are dropped rather than closed with shards missing
+    for (int i = 0; i < SHARD_MAX * 2; i++) {
+        if (conns[i].fd >= 0) close(conns[i].fd);
+    }
+    close(epoll_fd);
+    close(listen_fd);
+    if (strncmp(shard_address, "unix:", 5) == 0) {
+        unlink(shard_address + 5);
+    }
+    return 0;
+}
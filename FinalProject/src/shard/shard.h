@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <signal.h>
+#include <time.h>
+
+#define SHARD_ADDRESS "unix:/tmp/espx_shard.sock"
+#define SHARD_MAGIC 0x44524853u     // "SHRD"
+#define SHARD_VERSION 1
+#define SHARD_MAX 8                 // At least one symbol per shard
+#define SHARD_BACKLOG 32            // Minutes a shard keeps for resending while the aggregator is away
+#define SHARD_PENDING 16            // Minutes the aggregator holds open at once
+#define SHARD_MAX_CARRY 2           // Missed minutes carried forward before a symbol leaves the matrix
+
+// Wire protocol, host byte order like the query API: one fixed record per shard and closed
+// minute, in minute order on each connection
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint8_t shard;
+    uint8_t shard_count;
+    uint64_t minute;                // Unix seconds of the minute boundary
+    uint32_t symbols;               // Bit i set for every symbol the shard owns
+    uint32_t reserved;
+    double ma[8];
+    uint64_t trades[8];
+} ShardMinute;
+
+extern int shard_index;
+extern int shard_count;             // 0 runs unsharded
+extern char shard_address[128];     // unix:PATH or HOST:PORT
+extern unsigned int shard_grace_ms;
+
+int shard_parse(const char* spec);  // "K/N"
+int shard_parse_address(const char* address);
+int shard_owns(int symbol);
+
+// Shard side, called from the processor thread
+void shard_record_average(int symbol, double ma, uint64_t trades);
+void shard_publish_minute(time_t minute);
+void shard_close(void);
+
+// Aggregator side: merges every shard's averages per minute and runs the correlation on them
+// until *stop is set
+int aggregator_run(int shards, volatile sig_atomic_t* stop);
@@ -0,0 +1,154 @@
+#include "stats.h"
+#include "../utils/utils.h"
+#include "../utils/records.h"
+#include "../metrics/metrics.h"
+#include <math.h>
+#include <sys/stat.h>
+
+// Online per-trade statistics, updated on the ingest thread as each first-delivered trade is
+// decoded so alerts fire on the trade that triggers them rather than at the next minute tick.
+// The minute tick only writes the interval's realised volatility and the current EWMAs.
+
+StatsConfig stats_config = {
+    .price_half_life_ms = 60000.0,
+    .volume_half_life_ms = 300000.0,
+    .price_z = 8.0,
+    .volume_z = 6.0,
+    .min_samples = 200,
+    .cooldown_ms = 1000,
+};
+SymbolStats symbol_stats[8];
+StatsAlertHook stats_alert_hook = NULL;
+
+static FILE* alerts_log = NULL;
+static const char* alert_names[ALERT_KIND_COUNT] = {"price_jump", "volume_spike"};
+
+void stats_init(void) {
+    for (int i = 0; i < 8; i++) {
+        symbol_stats[i] = (SymbolStats){.lock = PTHREAD_MUTEX_INITIALIZER};
+    }
+    struct stat st = {0};
+    if (stat("logs", &st) == -1) mkdir("logs", 0755);
+    alerts_log = fopen(ALERTS_LOG, "a");
+    if (alerts_log) {
+        setvbuf(alerts_log, NULL, _IOLBF, 0);
+    }
+}
+
+static void decayed_push(DecayedStat* s, double x, double decay) {
+    s->weight = s->weight * decay + 1.0;
+    double delta = x - s->mean;
+    s->mean += delta / s->weight;
+    s->m2 = s->m2 * decay + delta * (x - s->mean);
+}
+
+// z of x against the distribution before x is added, 0 while it has no spread
+static double decayed_z(const DecayedStat* s, double x) {
+    double var = s->weight > 0.0 ? s->m2 / s->weight : 0.0;
+    return var > 1e-24 ? (x - s->mean) / sqrt(var) : 0.0;
+}
+
+static void raise_alert(const StatsAlert* alert) {
+    metrics_add_symbol(SYMBOL_METRIC_ALERTS, alert->symbol, 1);
+    if (alerts_log) {
+        fprintf(alerts_log, ALERT_RECORD_FMT, (unsigned long long)alert->timestamp, symbols[alert->symbol],
+                alert_names[alert->kind], alert->price, alert->volume, alert->z);
+    }
+    if (stats_alert_hook) {
+        stats_alert_hook(alert);
+    }
+}
+
+void stats_update(int symbol, uint64_t timestamp, uint64_t trade_id, double price, double volume) {
+    if (price <= 0.0 || volume <= 0.0) {
+        return;
+    }
+    SymbolStats* s = &symbol_stats[symbol];
+    StatsAlert alerts[ALERT_KIND_COUNT];
+    int alert_count = 0;
+
+    pthread_mutex_lock(&s->lock);
+
+    // Decay by exchange time, trades arriving out of order do not rewind it
+    double dt = s->trades && timestamp > s->last_ts ? (double)(timestamp - s->last_ts) : 0.0;
+    double price_decay = dt > 0.0 ? exp2(-dt / stats_config.price_half_life_ms) : 1.0;
+    double volume_decay = dt > 0.0 ? exp2(-dt / stats_config.volume_half_life_ms) : 1.0;
+    int armed = s->trades >= stats_config.min_samples;
+
+    if (s->trades) {
+        double r = log(price / s->last_price);
+        double z = decayed_z(&s->returns, r);
+        if (armed && stats_config.price_z > 0.0 && fabs(z) >= stats_config.price_z &&
+            timestamp >= s->last_alert[ALERT_PRICE_JUMP] + stats_config.cooldown_ms) {
+            s->last_alert[ALERT_PRICE_JUMP] = timestamp;
+            alerts[alert_count++] = (StatsAlert){symbol, ALERT_PRICE_JUMP, timestamp, trade_id, price, volume, z};
+        }
+        decayed_push(&s->returns, r, price_decay);
+        s->interval_sum_sq += r * r;
+    }
+
+    double lv = log(volume);
+    double z = decayed_z(&s->log_volume, lv);
+    if (armed && stats_config.volume_z > 0.0 && z >= stats_config.volume_z &&
+        timestamp >= s->last_alert[ALERT_VOLUME_SPIKE] + stats_config.cooldown_ms) {
+        s->last_alert[ALERT_VOLUME_SPIKE] = timestamp;
+        alerts[alert_count++] = (StatsAlert){symbol, ALERT_VOLUME_SPIKE, timestamp, trade_id, price, volume, z};
+    }
+    decayed_push(&s->log_volume, lv, volume_decay);
+    decayed_push(&s->price, price, price_decay);
+    decayed_push(&s->volume, volume, volume_decay);
+
+    if (timestamp > s->last_ts) {
+        s->last_ts = timestamp;
+    }
+    s->last_price = price;
+    s->trades++;
+    s->interval_trades++;
+    pthread_mutex_unlock(&s->lock);
+
+    for (int a = 0; a < alert_count; a++) {
+        raise_alert(&alerts[a]);
+    }
+}
+
+// Called by the processor once per tick with the volatility accumulated since the previous call
+void stats_publish(time_t minute) {
+    struct stat st = {0};
+    if (stat("data", &st) == -1) mkdir("data", 0755);
+    if (stat(STATS_DIR, &st) == -1) mkdir(STATS_DIR, 0755);
+
+    for (int i = 0; i < 8; i++) {
+        SymbolStats* s = &symbol_stats[i];
+        pthread_mutex_lock(&s->lock);
+        if (s->interval_trades == 0) {
+            pthread_mutex_unlock(&s->lock);
+            continue;
+        }
+
+        // Copied out so the ingest thread never waits for the disk in stats_update
+        double ewma_vol = s->returns.weight > 0.0 ? sqrt(s->returns.m2 / s->returns.weight) : 0.0;
+        double realised = sqrt(s->interval_sum_sq);
+        double price_mean = s->price.mean;
+        double volume_mean = s->volume.mean;
+        uint64_t trades = s->interval_trades;
+        s->interval_sum_sq = 0.0;
+        s->interval_trades = 0;
+        pthread_mutex_unlock(&s->lock);
+
+        char filename[128];
+        snprintf(filename, sizeof(filename), STATS_DIR "/%s.log", symbols[i]);
+        FILE* file = fopen(filename, "a");
+        if (file) {
+            fprintf(file, STATS_RECORD_FMT, (unsigned long long)minute, realised, ewma_vol,
+                    price_mean, volume_mean, (unsigned long long)trades);
+            fclose(file);
+        }
+    }
+}
+
+void stats_close(void) {
+    if (alerts_log) {
+        fclose(alerts_log);
+        alerts_log = NULL;
+    }
+}
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+// Exponentially decayed weighted mean and variance (West's incremental form): every sample
+// enters with weight 1 and older weight decays by 2^(-dt / half-life), so a burst of trades in
+// the same millisecond accumulates like plain Welford
+typedef struct {
+    double weight;
+    double mean;
+    double m2;              // Decayed sum of squared deviations, variance is m2 / weight
+} DecayedStat;
+
+typedef enum {
+    ALERT_PRICE_JUMP,       // |z| of the log return against its decayed distribution
+    ALERT_VOLUME_SPIKE,     // z of the log size against its decayed distribution
+    ALERT_KIND_COUNT
+} AlertKind;
+
+typedef struct {
+    int symbol;
+    AlertKind kind;
+    uint64_t timestamp;     // Exchange time of the triggering trade, ms
+    uint64_t trade_id;
+    double price;
+    double volume;
+    double z;
+} StatsAlert;
+
+typedef struct {
+    double price_half_life_ms;      // EWMA price and the return distribution
+    double volume_half_life_ms;     // EWMA volume and the log size distribution
+    double price_z;                 // 0 disables the alert
+    double volume_z;
+    uint64_t min_samples;           // Trades seen before alerts are armed
+    uint64_t cooldown_ms;           // Per symbol and kind
+} StatsConfig;
+
+typedef struct {
+    pthread_mutex_t lock;
+    uint64_t trades;
+    uint64_t last_ts;
+    double last_price;
+    DecayedStat price;
+    DecayedStat volume;
+    DecayedStat returns;            // Log returns between consecutive trades
+    DecayedStat log_volume;
+    uint64_t last_alert[ALERT_KIND_COUNT];
+
+    // Since the last stats_publish
+    uint64_t interval_trades;
+    double interval_sum_sq;         // Realised variance of the log returns
+} SymbolStats;
+
+typedef void (*StatsAlertHook)(const StatsAlert* alert);
+
+extern StatsConfig stats_config;
+extern SymbolStats symbol_stats[8];
+extern StatsAlertHook stats_alert_hook;     // Called on the ingest thread, keep it short
+
+void stats_init(void);
+void stats_update(int symbol, uint64_t timestamp, uint64_t trade_id, double price, double volume);
+void stats_publish(time_t minute);
+void stats_close(void);
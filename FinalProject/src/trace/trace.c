@@ -0,0 +1,91 @@
+#include "trace.h"
+
+unsigned int trace_sample_every = 100;  // 0 -> off, 1 -> every trade, N -> every Nth trade
+
+static LatencyHistogram histograms[TRACE_STAGE_COUNT];
+static const char* stage_names[TRACE_STAGE_COUNT] = {"exchange", "decode", "queue", "logger", "mavg", "book"};
+static _Thread_local unsigned int sample_counter = 0;
+
+static inline unsigned int bucket_index(uint64_t v) {
+    if (v < TRACE_SUB_COUNT) {
+        return (unsigned int)v;
+    }
+    unsigned int exp = (63 - __builtin_clzll(v)) - TRACE_SUB_BITS + 1;
+    return exp * TRACE_SUB_COUNT + (unsigned int)((v >> (exp - 1)) & (TRACE_SUB_COUNT - 1));
+}
+
+static inline uint64_t bucket_upper(unsigned int idx) {
+    unsigned int exp = idx / TRACE_SUB_COUNT;
+    uint64_t sub = idx % TRACE_SUB_COUNT;
+    if (exp == 0) {
+        return sub;
+    }
+    return ((TRACE_SUB_COUNT + sub + 1) << (exp - 1)) - 1;
+}
+
+int trace_should_sample(void) {
+    if (trace_sample_every == 0) {
+        return 0;
+    }
+    if (++sample_counter >= trace_sample_every) {
+        sample_counter = 0;
+        return 1;
+    }
+    return 0;
+}
+
+void trace_record(TraceStage stage, uint64_t ns) {
+    LatencyHistogram* h = &histograms[stage];
+    atomic_fetch_add_explicit(&h->counts[bucket_index(ns)], 1, memory_order_relaxed);
+
+    uint64_t prev = atomic_load_explicit(&h->max, memory_order_relaxed);
+    while (ns > prev && !atomic_compare_exchange_weak_explicit(&h->max, &prev, ns, memory_order_relaxed, memory_order_relaxed)) {
+    }
+}
+
+static double percentile_us(const uint64_t* counts, uint64_t total, uint64_t max, double q) {
+    uint64_t rank = (uint64_t)(q * (double)total);
+    if (rank >= total) rank = total - 1;
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < TRACE_BUCKETS; i++) {
+        seen += counts[i];
+        if (seen > rank) {
+            uint64_t upper = bucket_upper(i);
+            return (upper < max ? upper : max) / 1000.0;
+        }
+    }
+    return 0.0;
+}
+
+void trace_dump(time_t now) {
+    if (trace_sample_every == 0) {
+        return;
+    }
+
+    FILE* f = fopen("logs/latency.log", "a");
+    if (!f) {
+        return;
+    }
+
+    // Drain each histogram so every line covers one interval
+    static uint64_t counts[TRACE_BUCKETS];
+    for (int s = 0; s < TRACE_STAGE_COUNT; s++) {
+        uint64_t total = 0;
+        for (unsigned int i = 0; i < TRACE_BUCKETS; i++) {
+            counts[i] = atomic_exchange_explicit(&histograms[s].counts[i], 0, memory_order_relaxed);
+            total += counts[i];
+        }
+        uint64_t max = atomic_exchange_explicit(&histograms[s].max, 0, memory_order_relaxed);
+        if (total == 0) {
+            continue;
+        }
+
+        fprintf(f, "[%ld], %s, count: %llu, p50: %.3f us, p90: %.3f us, p99: %.3f us, p999: %.3f us, max: %.3f us\n",
+            (long)now, stage_names[s], (unsigned long long)total,
+            percentile_us(counts, total, max, 0.50), percentile_us(counts, total, max, 0.90),
+            percentile_us(counts, total, max, 0.99), percentile_us(counts, total, max, 0.999),
+            max / 1000.0);
+    }
+    fclose(f);
+}
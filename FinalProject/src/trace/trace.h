@@ -0,0 +1,36 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Log-linear histogram: exact below 16ns, then 16 linear sub-buckets per power of two
+#define TRACE_SUB_BITS 4
+#define TRACE_SUB_COUNT (1 << TRACE_SUB_BITS)
+#define TRACE_BUCKETS ((64 - TRACE_SUB_BITS + 1) * TRACE_SUB_COUNT)
+
+typedef enum {
+    TRACE_EXCHANGE,     // Exchange ts -> socket receive (wall clock)
+    TRACE_DECODE,       // Socket receive -> JSON decoded
+    TRACE_QUEUE,        // Decoded -> pushed to logger queue
+    TRACE_LOGGER,       // Queued -> written by logger
+    TRACE_MOVING_AVG,   // Queued -> included in a moving average
+    TRACE_BOOK,         // Socket receive -> order book update applied and validated
+    TRACE_STAGE_COUNT
+} TraceStage;
+
+typedef struct {
+    atomic_uint_fast64_t counts[TRACE_BUCKETS];
+    atomic_uint_fast64_t max;
+} LatencyHistogram;
+
+extern unsigned int trace_sample_every;
+
+static inline uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int  trace_should_sample(void);
+void trace_record(TraceStage stage, uint64_t ns);
+void trace_dump(time_t now);
@@ -0,0 +1,576 @@
+#include "tsdb.h"
+#include "../utils/records.h"
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Embedded store for the computed per-minute series: one file per series and resolution under
+// <dir>/1m, <dir>/1h and <dir>/1d. Appends go to an in-memory head block whose new bytes are
+// written back on every flush, so a tick costs a couple of small pwrites per series instead of
+// rewriting a block. Hour and day rollups are produced as periods complete and are rebuilt from
+// the finer resolution after a restart.
+
+#define STREAM_OFFSET sizeof(TsdbBlockHeader)
+#define STREAM_BITS ((TSDB_BLOCK_SIZE - STREAM_OFFSET) * 8)
+#define POINT_MAX_BITS (4 + 32 + TSDB_MAX_FIELDS * (2 + 5 + 6 + 64))
+#define ROLLUP_FIELDS 4
+#define STREAM_CORRUPT UINT32_MAX   // Stream position left by a point that cannot be decoded
+
+char tsdb_dir[128] = TSDB_DIR;     // Empty string disables the store
+int tsdb_text_copies = 1;
+
+static const int64_t periods[TSDB_RESOLUTIONS] = {0, 3600, 86400};
+static const char* resolution_names[TSDB_RESOLUTIONS] = {"1m", "1h", "1d"};
+
+// Encoder state, mirrored exactly by the decoder
+typedef struct {
+    int64_t prev_ts;
+    int64_t prev_delta;
+    uint64_t prev_bits[TSDB_MAX_FIELDS];
+    int lead[TSDB_MAX_FIELDS];      // -1 until the field's first non-zero XOR
+    int trail[TSDB_MAX_FIELDS];
+} Codec;
+
+typedef struct {
+    int fd;
+    uint32_t block;                 // Index of the block being filled
+    unsigned char data[TSDB_BLOCK_SIZE];
+    uint32_t flushed_bits;
+    int dirty;
+    int has_last;
+    int64_t last_ts;
+    Codec codec;
+} Writer;
+
+typedef struct {
+    int active;
+    int64_t start;
+    double min, max, sum, count;
+} Rollup;
+
+typedef struct {
+    char name[64];
+    int mantissa_bits;
+    Writer writers[TSDB_RESOLUTIONS];
+    Rollup rollups[TSDB_RESOLUTIONS];
+} Series;
+
+static Series* series_table[TSDB_MAX_SERIES];
+static int series_count = 0;
+static int store_open = 0;
+
+const char* tsdb_resolution_name(TsdbResolution res) {
+    return resolution_names[res];
+}
+
+// ---- bit stream ----
+
+static void put_bits(unsigned char* s, uint32_t* pos, uint64_t v, int n) {
+    while (n > 0) {
+        int room = 8 - (int)(*pos & 7);
+        int take = n < room ? n : room;
+        uint8_t chunk = (uint8_t)((v >> (n - take)) & ((1u << take) - 1));
+        s[*pos >> 3] |= (uint8_t)(chunk << (room - take));
+        *pos += (uint32_t)take;
+        n -= take;
+    }
+}
+
+// Reads through a big-endian 64-bit window, the stream needs 8 bytes of slack after its end
+static uint64_t get_bits(const unsigned char* s, uint32_t* pos, int n) {
+    if (n == 0) {
+        return 0;
+    }
+    if (n > 56) {
+        uint64_t hi = get_bits(s, pos, n - 32);
+        return (hi << 32) | get_bits(s, pos, 32);
+    }
+    const unsigned char* p = s + (*pos >> 3);
+    uint64_t w = 0;
+    for (int i = 0; i < 8; i++) {
+        w = (w << 8) | p[i];
+    }
+    w = (w << (*pos & 7)) >> (64 - n);
+    *pos += (uint32_t)n;
+    return w;
+}
+
+static uint64_t double_bits(double v) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    return u;
+}
+
+// Rounds away the low mantissa bits so consecutive XORs end in long runs of zeros
+static double round_mantissa(double v, int bits) {
+    if (bits >= TSDB_LOSSLESS) {
+        return v;
+    }
+    uint64_t u = double_bits(v);
+    if (((u >> 52) & 0x7ff) == 0x7ff) {
+        return v;
+    }
+    int drop = TSDB_LOSSLESS - bits;
+    u += 1ull << (drop - 1);
+    u &= ~((1ull << drop) - 1);
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+// ---- Gorilla codec ----
+
+static void encode_point(Codec* c, unsigned char* s, uint32_t* pos, int fields, int first, int64_t ts, const uint64_t* bits) {
+    if (first) {
+        *c = (Codec){.prev_ts = ts};
+        for (int f = 0; f < fields; f++) {
+            put_bits(s, pos, bits[f], 64);
+            c->prev_bits[f] = bits[f];
+            c->lead[f] = -1;
+        }
+        return;
+    }
+
+    int64_t delta = ts - c->prev_ts;
+    int64_t dod = delta - c->prev_delta;
+    if (dod == 0) {
+        put_bits(s, pos, 0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        put_bits(s, pos, 0x2, 2);
+        put_bits(s, pos, (uint64_t)(dod + 63), 7);
+    } else if (dod >= -255 && dod <= 256) {
+        put_bits(s, pos, 0x6, 3);
+        put_bits(s, pos, (uint64_t)(dod + 255), 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        put_bits(s, pos, 0xE, 4);
+        put_bits(s, pos, (uint64_t)(dod + 2047), 12);
+    } else {
+        put_bits(s, pos, 0xF, 4);
+        put_bits(s, pos, (uint32_t)(int32_t)dod, 32);
+    }
+    c->prev_delta = delta;
+    c->prev_ts = ts;
+
+    for (int f = 0; f < fields; f++) {
+        uint64_t x = bits[f] ^ c->prev_bits[f];
+        c->prev_bits[f] = bits[f];
+        if (x == 0) {
+            put_bits(s, pos, 0, 1);
+            continue;
+        }
+        int lead = __builtin_clzll(x), trail = __builtin_ctzll(x);
+        if (lead > 31) lead = 31;
+        if (c->lead[f] >= 0 && lead >= c->lead[f] && trail >= c->trail[f]) {
+            put_bits(s, pos, 0x2, 2);
+            put_bits(s, pos, x >> c->trail[f], 64 - c->lead[f] - c->trail[f]);
+        } else {
+            int len = 64 - lead - trail;
+            put_bits(s, pos, 0x3, 2);
+            put_bits(s, pos, (uint64_t)lead, 5);
+            put_bits(s, pos, (uint64_t)(len & 63), 6);
+            put_bits(s, pos, x >> trail, len);
+            c->lead[f] = lead;
+            c->trail[f] = trail;
+        }
+    }
+}
+
+static int64_t decode_point(Codec* c, const unsigned char* s, uint32_t* pos, int fields, int first, double* values) {
+    if (first) {
+        c->prev_delta = 0;
+        for (int f = 0; f < fields; f++) {
+            c->prev_bits[f] = get_bits(s, pos, 64);
+            c->lead[f] = -1;
+        }
+    } else {
+        int64_t dod;
+        if (get_bits(s, pos, 1) == 0) {
+            dod = 0;
+        } else if (get_bits(s, pos, 1) == 0) {
+            dod = (int64_t)get_bits(s, pos, 7) - 63;
+        } else if (get_bits(s, pos, 1) == 0) {
+            dod = (int64_t)get_bits(s, pos, 9) - 255;
+        } else if (get_bits(s, pos, 1) == 0) {
+            dod = (int64_t)get_bits(s, pos, 12) - 2047;
+        } else {
+            dod = (int32_t)(uint32_t)get_bits(s, pos, 32);
+        }
+        c->prev_delta += dod;
+        c->prev_ts += c->prev_delta;
+
+        for (int f = 0; f < fields; f++) {
+            if (get_bits(s, pos, 1) == 0) {
+                continue;
+            }
+            uint64_t x;
+            if (get_bits(s, pos, 1) == 0) {
+                if (c->lead[f] < 0) {
+                    *pos = STREAM_CORRUPT;  // Window reused before one was set
+                    return c->prev_ts;
+                }
+                x = get_bits(s, pos, 64 - c->lead[f] - c->trail[f]) << c->trail[f];
+            } else {
+                int lead = (int)get_bits(s, pos, 5);
+                int len = (int)get_bits(s, pos, 6);
+                if (len == 0) len = 64;
+                if (lead + len > 64) {
+                    *pos = STREAM_CORRUPT;
+                    return c->prev_ts;
+                }
+                c->lead[f] = lead;
+                c->trail[f] = 64 - lead - len;
+                x = get_bits(s, pos, len) << c->trail[f];
+            }
+            c->prev_bits[f] ^= x;
+        }
+    }
+    for (int f = 0; f < fields; f++) {
+        memcpy(&values[f], &c->prev_bits[f], sizeof(double));
+    }
+    return c->prev_ts;
+}
+
+// Header fields the decoder relies on, anything else is a corrupt or torn block
+static int block_valid(const TsdbBlockHeader* h) {
+    return h->magic == TSDB_MAGIC && h->count > 0 && h->fields >= 1 && h->fields <= TSDB_MAX_FIELDS &&
+           h->bits <= STREAM_BITS;
+}
+
+// Decodes one block, visiting the points in [from, to]. Leaves the codec at the last point. A block
+// that fails validation, or a stream that runs past its bit count, ends the scan at that point
+static long decode_block(const unsigned char* raw, size_t raw_len, Codec* c, int64_t from, int64_t to,
+                         TsdbVisitor visit, void* ctx, int* stop) {
+    // Padded so a point starting anywhere in the stream can be read whole before it is rejected
+    unsigned char buf[TSDB_BLOCK_SIZE + POINT_MAX_BITS / 8 + 16] = {0};
+    memcpy(buf, raw, raw_len < TSDB_BLOCK_SIZE ? raw_len : TSDB_BLOCK_SIZE);
+    const TsdbBlockHeader* h = (const TsdbBlockHeader*)buf;
+    const unsigned char* s = buf + STREAM_OFFSET;
+    uint32_t pos = 0;
+    long visited = 0;
+
+    if (!block_valid(h)) {
+        *stop = 1;
+        return 0;
+    }
+    c->prev_ts = h->first_ts;
+    for (uint32_t i = 0; i < h->count; i++) {
+        if (pos >= h->bits) {
+            *stop = 1;
+            break;
+        }
+        TsdbPoint p = {0};
+        p.ts = decode_point(c, s, &pos, h->fields, i == 0, p.value);
+        if (pos > h->bits) {
+            *stop = 1;
+            break;
+        }
+        if (visit && p.ts >= from && p.ts <= to) {
+            visited++;
+            if (visit(&p, ctx)) {
+                *stop = 1;
+                break;
+            }
+        }
+        if (p.ts > to) {
+            *stop = 1;
+            break;
+        }
+    }
+    return visited;
+}
+
+long tsdb_scan(const char* dir, const char* name, TsdbResolution res, int64_t from, int64_t to,
+               TsdbVisitor visit, void* ctx) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s/%s.tsb", dir, resolution_names[res], name);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)STREAM_OFFSET) {
+        close(fd);
+        return 0;
+    }
+    size_t size = (size_t)st.st_size;
+    unsigned char* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    // Blocks are in time order: find the first that reaches `from` from the headers alone
+    size_t nblocks = (size + TSDB_BLOCK_SIZE - 1) / TSDB_BLOCK_SIZE;
+    size_t lo = 0, hi = nblocks;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const TsdbBlockHeader* h = (const TsdbBlockHeader*)(map + mid * TSDB_BLOCK_SIZE);
+        if (mid * TSDB_BLOCK_SIZE + STREAM_OFFSET <= size && h->magic == TSDB_MAGIC && h->count && h->last_ts < from) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    long visited = 0;
+    int stop = 0;
+    for (size_t b = lo; b < nblocks && !stop; b++) {
+        size_t off = b * TSDB_BLOCK_SIZE;
+        const TsdbBlockHeader* h = (const TsdbBlockHeader*)(map + off);
+        if (off + STREAM_OFFSET > size || !block_valid(h) || h->first_ts > to) {
+            break;
+        }
+        Codec c = {0};
+        visited += decode_block(map + off, size - off, &c, from, to, visit, ctx, &stop);
+    }
+    munmap(map, size);
+    return visited;
+}
+
+// ---- writer ----
+
+static TsdbBlockHeader* head(Writer* w) {
+    return (TsdbBlockHeader*)w->data;
+}
+
+static int writer_open(Writer* w, const char* path) {
+    memset(w, 0, sizeof(*w));
+    w->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (w->fd < 0) {
+        perror("tsdb open");
+        return -1;
+    }
+    struct stat st;
+    fstat(w->fd, &st);
+    uint32_t nblocks = (uint32_t)(((size_t)st.st_size + TSDB_BLOCK_SIZE - 1) / TSDB_BLOCK_SIZE);
+    if (nblocks == 0) {
+        return 0;
+    }
+
+    // Continue an unsealed last block; a torn or corrupt one is overwritten
+    uint32_t last = nblocks - 1;
+    ssize_t n = pread(w->fd, w->data, TSDB_BLOCK_SIZE, (off_t)last * TSDB_BLOCK_SIZE);
+    TsdbBlockHeader* h = head(w);
+    int stop = 1;
+    if (n >= (ssize_t)STREAM_OFFSET && block_valid(h)) {
+        if (h->sealed) {
+            w->has_last = 1;
+            w->last_ts = h->last_ts;
+            memset(w->data, 0, sizeof(w->data));
+            w->block = last + 1;
+            return 0;
+        }
+        stop = 0;
+        decode_block(w->data, TSDB_BLOCK_SIZE, &w->codec, INT64_MIN, INT64_MAX, NULL, NULL, &stop);
+    }
+    if (!stop) {
+        w->has_last = 1;
+        w->last_ts = h->last_ts;
+
+        // Bytes past the header's bit count may hold a write the header never acknowledged
+        unsigned char* s = w->data + STREAM_OFFSET;
+        if (h->bits & 7) s[h->bits >> 3] &= (uint8_t)(0xFF << (8 - (h->bits & 7)));
+        memset(s + (h->bits + 7) / 8, 0, TSDB_BLOCK_SIZE - STREAM_OFFSET - (h->bits + 7) / 8);
+        w->block = last;
+        w->flushed_bits = h->bits;
+        return 0;
+    }
+
+    memset(w->data, 0, sizeof(w->data));
+    w->block = last;
+    TsdbBlockHeader prev;
+    if (last > 0 && pread(w->fd, &prev, sizeof(prev), (off_t)(last - 1) * TSDB_BLOCK_SIZE) == sizeof(prev) &&
+        prev.magic == TSDB_MAGIC) {
+        w->has_last = 1;
+        w->last_ts = prev.last_ts;
+    }
+    return 0;
+}
+
+static void writer_flush(Writer* w) {
+    if (!w->dirty) {
+        return;
+    }
+    TsdbBlockHeader* h = head(w);
+    off_t base = (off_t)w->block * TSDB_BLOCK_SIZE;
+    size_t start = STREAM_OFFSET + w->flushed_bits / 8;
+    size_t end = STREAM_OFFSET + (h->bits + 7) / 8;
+
+    // Stream bytes first, then the header that makes them visible
+    if (pwrite(w->fd, w->data + start, end - start, base + (off_t)start) < 0 ||
+        pwrite(w->fd, w->data, STREAM_OFFSET, base) < 0) {
+        perror("tsdb write");
+        return;
+    }
+    w->flushed_bits = h->bits;
+    w->dirty = 0;
+}
+
+static void writer_seal(Writer* w) {
+    head(w)->sealed = 1;
+    if (pwrite(w->fd, w->data, TSDB_BLOCK_SIZE, (off_t)w->block * TSDB_BLOCK_SIZE) < 0) {
+        perror("tsdb write");
+    }
+    memset(w->data, 0, sizeof(w->data));
+    w->block++;
+    w->flushed_bits = 0;
+    w->dirty = 0;
+}
+
+static int writer_append(Writer* w, int fields, int64_t ts, const double* values, int mantissa_bits) {
+    if (w->has_last && ts <= w->last_ts) {
+        return -1;
+    }
+    TsdbBlockHeader* h = head(w);
+    if (h->count > 0 && (h->bits + POINT_MAX_BITS > STREAM_BITS || h->count == UINT16_MAX)) {
+        writer_seal(w);
+    }
+
+    // Rollup counts stay exact
+    uint64_t bits[TSDB_MAX_FIELDS];
+    for (int f = 0; f < fields; f++) {
+        bits[f] = double_bits(f < 3 ? round_mantissa(values[f], mantissa_bits) : values[f]);
+    }
+    if (h->count == 0) {
+        *h = (TsdbBlockHeader){.magic = TSDB_MAGIC, .fields = (uint8_t)fields, .first_ts = ts};
+    }
+    encode_point(&w->codec, w->data + STREAM_OFFSET, &h->bits, fields, h->count == 0, ts, bits);
+    h->count++;
+    h->last_ts = ts;
+    w->has_last = 1;
+    w->last_ts = ts;
+    w->dirty = 1;
+    return 0;
+}
+
+// ---- rollups ----
+
+static void rollup_feed(Series* s, TsdbResolution res, int64_t ts, double min, double max, double sum, double count) {
+    Rollup* r = &s->rollups[res];
+    int64_t start = ts - ts % periods[res];
+    if (r->active && start != r->start) {
+        if (start < r->start) {
+            return;
+        }
+        double values[ROLLUP_FIELDS] = {r->min, r->max, r->sum / r->count, r->count};
+        writer_append(&s->writers[res], ROLLUP_FIELDS, r->start, values, s->mantissa_bits);
+        if (res + 1 < TSDB_RESOLUTIONS) {
+            rollup_feed(s, res + 1, r->start, r->min, r->max, r->sum, r->count);
+        }
+        r->active = 0;
+    }
+    if (!r->active) {
+        *r = (Rollup){1, start, min, max, sum, count};
+        return;
+    }
+    if (min < r->min) r->min = min;
+    if (max > r->max) r->max = max;
+    r->sum += sum;
+    r->count += count;
+}
+
+static int rebuild_day(const TsdbPoint* p, void* ctx) {
+    rollup_feed(ctx, TSDB_DAY, p->ts, p->value[0], p->value[1], p->value[2] * p->value[3], p->value[3]);
+    return 0;
+}
+
+static int rebuild_hour(const TsdbPoint* p, void* ctx) {
+    rollup_feed(ctx, TSDB_HOUR, p->ts, p->value[0], p->value[0], p->value[0], 1.0);
+    return 0;
+}
+
+// Open periods are not stored, so pick them up again from the resolution below
+static void rebuild_rollups(Series* s) {
+    Writer* day = &s->writers[TSDB_DAY];
+    Writer* hour = &s->writers[TSDB_HOUR];
+    tsdb_scan(tsdb_dir, s->name, TSDB_HOUR, day->has_last ? day->last_ts + periods[TSDB_DAY] : INT64_MIN,
+              INT64_MAX, rebuild_day, s);
+    tsdb_scan(tsdb_dir, s->name, TSDB_RAW, hour->has_last ? hour->last_ts + periods[TSDB_HOUR] : INT64_MIN,
+              INT64_MAX, rebuild_hour, s);
+}
+
+// ---- series ----
+
+int tsdb_open(void) {
+    if (tsdb_dir[0] == '\0') {
+        return 0;
+    }
+    char path[256];
+    mkdir("data", 0755);
+    mkdir(tsdb_dir, 0755);
+    for (int r = 0; r < TSDB_RESOLUTIONS; r++) {
+        snprintf(path, sizeof(path), "%s/%s", tsdb_dir, resolution_names[r]);
+        mkdir(path, 0755);
+    }
+    store_open = 1;
+    return 0;
+}
+
+int tsdb_series(const char* name, int mantissa_bits) {
+    if (!store_open) {
+        return -1;
+    }
+    for (int i = 0; i < series_count; i++) {
+        if (strcmp(series_table[i]->name, name) == 0) {
+            return i;
+        }
+    }
+    if (series_count == TSDB_MAX_SERIES || strlen(name) >= sizeof(series_table[0]->name) || strchr(name, '/')) {
+        return -1;
+    }
+
+    Series* s = calloc(1, sizeof(Series));
+    strcpy(s->name, name);
+    s->mantissa_bits = mantissa_bits;
+    for (int r = 0; r < TSDB_RESOLUTIONS; r++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s/%s.tsb", tsdb_dir, resolution_names[r], name);
+        if (writer_open(&s->writers[r], path) != 0) {
+            for (int k = 0; k < r; k++) close(s->writers[k].fd);
+            free(s);
+            return -1;
+        }
+    }
+    rebuild_rollups(s);
+    series_table[series_count] = s;
+    return series_count++;
+}
+
+int tsdb_append(int series, int64_t ts, double value) {
+    if (series < 0 || series >= series_count) {
+        return -1;
+    }
+    Series* s = series_table[series];
+    if (writer_append(&s->writers[TSDB_RAW], 1, ts, &value, s->mantissa_bits) != 0) {
+        return -1;
+    }
+    rollup_feed(s, TSDB_HOUR, ts, value, value, value, 1.0);
+    return 0;
+}
+
+// Called by the processor after every tick
+void tsdb_flush(void) {
+    for (int i = 0; i < series_count; i++) {
+        for (int r = 0; r < TSDB_RESOLUTIONS; r++) {
+            writer_flush(&series_table[i]->writers[r]);
+        }
+    }
+}
+
+void tsdb_close(void) {
+    tsdb_flush();
+    for (int i = 0; i < series_count; i++) {
+        for (int r = 0; r < TSDB_RESOLUTIONS; r++) {
+            close(series_table[i]->writers[r].fd);
+        }
+        free(series_table[i]);
+    }
+    series_count = 0;
+    store_open = 0;
+}
+
+int tsdb_text(void) {
+    return tsdb_text_copies || !store_open;
+}
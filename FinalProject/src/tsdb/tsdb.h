@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdint.h>
+
+#define TSDB_BLOCK_SIZE 1024
+#define TSDB_MAGIC 0x42445354u      // "TSDB"
+#define TSDB_MAX_FIELDS 4
+#define TSDB_MAX_SERIES 128
+#define TSDB_LOSSLESS 52            // Mantissa bits kept, anything lower rounds the low bits away
+
+typedef enum {
+    TSDB_RAW,                       // As appended, one value per point
+    TSDB_HOUR,                      // min, max, mean, count per hour
+    TSDB_DAY,                       // min, max, mean, count per day
+    TSDB_RESOLUTIONS
+} TsdbResolution;
+
+// Every file is a run of fixed-size blocks, block k at offset k*TSDB_BLOCK_SIZE. A block holds a
+// Gorilla bit stream: the first point raw, then delta-of-delta timestamps and per-field XORs
+// against the previous point. Only the last block of a file may be unsealed.
+typedef struct {
+    uint32_t magic;
+    uint16_t count;
+    uint8_t fields;
+    uint8_t sealed;
+    uint32_t bits;                  // Bits of the stream in use
+    uint32_t reserved;
+    int64_t first_ts;
+    int64_t last_ts;
+} TsdbBlockHeader;
+
+typedef struct {
+    int64_t ts;                     // Unix seconds, rollups are stamped with the period start
+    double value[TSDB_MAX_FIELDS];  // Raw: value[0]. Rollups: min, max, mean, count
+} TsdbPoint;
+
+// Returns non-zero to stop the scan
+typedef int (*TsdbVisitor)(const TsdbPoint* point, void* ctx);
+
+extern char tsdb_dir[128];
+extern int tsdb_text_copies;        // 0: series the store holds are not also written as text logs
+
+// Writer side, owned by the processor thread, no locking
+int  tsdb_open(void);
+int  tsdb_series(const char* name, int mantissa_bits);     // Opens or looks up, -1 when the store is off
+int  tsdb_append(int series, int64_t ts, double value);     // Timestamps must increase per series
+void tsdb_flush(void);
+void tsdb_close(void);
+int  tsdb_text(void);               // Whether the text copy is written, always while the store is off
+
+// Reader side, needs no writer state so tools can link this file alone
+const char* tsdb_resolution_name(TsdbResolution res);
+long tsdb_scan(const char* dir, const char* name, TsdbResolution res, int64_t from, int64_t to,
+               TsdbVisitor visit, void* ctx);
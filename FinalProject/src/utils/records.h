@@ -0,0 +1,54 @@
+// Text record layouts shared by the pipeline writers and tools/analyzer.c
+
+#define SYMBOL_NAMES {"BTC-USDT", "ADA-USDT", "ETH-USDT", "DOGE-USDT", "XRP-USDT", "SOL-USDT", "LTC-USDT", "BNB-USDT"}
+
+#define TRANSACTIONS_DIR    "logs/transactions"
+#define MAVG_DIR            "data/mavg"
+#define CORR_DIR            "data/corr"
+#define BOOK_DIR            "data/book"
+#define STATS_DIR           "data/stats"
+#define TSDB_DIR            "data/tsdb"
+#define PCA_DIR             "data/pca"
+#define FLOW_DIR            "data/flow"
+#define TIMINGS_LOG         "logs/timings.log"
+#define CPU_IDLE_LOG        "logs/cpu_idle.log"
+#define ALERTS_LOG          "logs/alerts.log"
+
+// logs/transactions/<symbol>.log: [unix_ms], Price: <px>, Volume: <sz>
+#define TRADE_RECORD_FMT    "[%llu], Price: %.8f, Volume: %.8f\n"
+#define TRADE_SCAN_FMT      "[%llu], Price: %lf, Volume: %lf"
+
+// data/mavg/<symbol>.log: [unix_s], MovingAvg: <value>
+#define MAVG_RECORD_FMT     "[%llu], MovingAvg: %.8f\n"
+#define MAVG_VALUE_TAG      "MovingAvg:"
+
+// data/corr/<symbol>.log: unix_s,<max symbol>,<max corr>, then one column per symbol
+#define CORR_HEAD_FMT       "%llu,%s,%.4f"
+#define CORR_VALUE_FMT      ",%.4f"
+#define CORR_FIELDS         11
+
+// data/book/<symbol>.log: unix_s, last mid/spread/top-5 imbalance, their means over the minute, updates
+#define BOOK_RECORD_FMT     "[%llu], Mid: %.8f, Spread: %.8f, Imbalance: %.4f, MeanSpread: %.8f, MeanImbalance: %.4f, Updates: %llu\n"
+
+// data/stats/<symbol>.log: unix_s, realised volatility of the log returns since the last tick, EWMA volatility, price and size, trades
+#define STATS_RECORD_FMT    "[%llu], Vol: %.8f, EwmaVol: %.8f, EwmaPrice: %.8f, EwmaVolume: %.8f, Trades: %llu\n"
+
+// data/pca/pc<k>.log: unix_s, eigenvalue of the rolling return covariance, its share of the total variance,
+// solver iterations, then one loading per symbol
+#define PCA_RECORD_FMT      "[%llu], Eigenvalue: %.8e, Explained: %.4f, Iterations: %d, Loadings:"
+#define PCA_LOADING_FMT     " %.4f"
+
+// data/flow/<symbol>.log: unix_s, one line per window in seconds with buy and sell trades and volume, notional,
+// aggressor volume imbalance, trades per second and large trades
+#define FLOW_RECORD_FMT     "[%llu], Window: %d, Buys: %llu, Sells: %llu, BuyVolume: %.8f, SellVolume: %.8f, Notional: %.2f, Imbalance: %.4f, Rate: %.4f, Large: %llu\n"
+
+// logs/alerts.log: [exchange ms], symbol, kind, trade price and size, z-score
+#define ALERT_RECORD_FMT    "[%llu], %s, %s, Price: %.8f, Volume: %.8f, Z: %.2f\n"
+
+// logs/timings.log: Start: HH:MM:SS.mmm, End: HH:MM:SS.mmm, Duration: <ms> ms
+#define TIMING_RECORD_FMT   "Start: %s.%03ld, End: %s.%03ld, Duration: %.3f ms\n"
+#define TIMING_START_TAG    "Start: "
+#define TIMING_DURATION_TAG "Duration:"
+
+// logs/cpu_idle.log: [unix_s], <idle percent>
+#define CPU_IDLE_RECORD_FMT "[%ld], %.2f\n"
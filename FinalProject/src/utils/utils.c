@@ -1,4 +1,14 @@
 #include "utils.h"
+#include "records.h"
+#include "../trace/trace.h"
+#include "../metrics/metrics.h"
+#include "../sequence/sequence.h"
+#include "../reorder/reorder.h"
+#include "../book/book.h"
+#include "../broadcast/broadcast.h"
+#include "../stats/stats.h"
+#include "../flow/flow.h"
+#include "../shard/shard.h"
 #include <errno.h>
 #include <time.h>
 
@@ -17,18 +27,25 @@ void queue_push(TradeQueue* q, TradeData* trade) {
     pthread_mutex_lock(&q->lock);
     q->data[q->tail] = *trade;
     q->tail = (q->tail+1) % q->size;
+
+    // Full queue: drop the oldest trade instead of wrapping onto an empty-looking ring
+    if(q->tail == q->head) {
+        q->head = (q->head+1) % q->size;
+        metrics_add(METRIC_QUEUE_OVERWRITES, 1);
+    }
+    metrics_set(GAUGE_QUEUE_DEPTH, (int64_t)((q->tail + q->size - q->head) % q->size));
     pthread_cond_signal(&q->not_empty);
     pthread_mutex_unlock(&q->lock);
 }
 
-void queue_pop(TradeQueue* q, TradeData* trade) {
+int queue_pop(TradeQueue* q, TradeData* trade) {
     pthread_mutex_lock(&q->lock);
     
     while(q->head == q->tail) {
         // Check if logger should stop before waiting
         if (atomic_load(&logger_interrupt)) {
             pthread_mutex_unlock(&q->lock);
-            return; // Exit gracefully
+            return 0; // Exit gracefully
         }
         
         struct timespec timeout;
@@ -43,10 +60,76 @@ void queue_pop(TradeQueue* q, TradeData* trade) {
 
     *trade = q->data[q->head];
     q->head = (q->head+1) % q->size;
+    metrics_set(GAUGE_QUEUE_DEPTH, (int64_t)((q->tail + q->size - q->head) % q->size));
+    pthread_mutex_unlock(&q->lock);
+    return 1;
+}
+
+int queue_try_pop(TradeQueue* q, TradeData* trade) {
+    pthread_mutex_lock(&q->lock);
+    if(q->head == q->tail) {
+        pthread_mutex_unlock(&q->lock);
+        return 0;
+    }
+
+    *trade = q->data[q->head];
+    q->head = (q->head+1) % q->size;
+    metrics_set(GAUGE_QUEUE_DEPTH, (int64_t)((q->tail + q->size - q->head) % q->size));
     pthread_mutex_unlock(&q->lock);
+    return 1;
+}
+
+void history_push(SymbolHistory* h, const TradeData* trade) {
+    // Grow by unrolling the ring into a fresh array twice the size
+    if(h->count == h->capacity) {
+        size_t capacity = h->capacity ? h->capacity * 2 : 128;
+        TradeData* trades = malloc(capacity * sizeof(TradeData));
+        double* prices = malloc(capacity * sizeof(double));
+        double* volumes = malloc(capacity * sizeof(double));
+        for(size_t i = 0; i < h->count; i++) {
+            size_t at = (h->head + i) & (h->capacity - 1);
+            trades[i] = h->trades[at];
+            prices[i] = h->prices[at];
+            volumes[i] = h->volumes[at];
+        }
+        free(h->trades);
+        free(h->prices);
+        free(h->volumes);
+        h->trades = trades;
+        h->prices = prices;
+        h->volumes = volumes;
+        h->capacity = capacity;
+        h->head = 0;
+    }
+    size_t at = (h->head + h->count) & (h->capacity - 1);
+    h->trades[at] = *trade;
+    h->prices[at] = trade->price;
+    h->volumes[at] = trade->volume;
+    h->count++;
+}
+
+// Drops trades older than cutoff from the front of the window
+void history_evict(SymbolHistory* h, uint64_t cutoff) {
+    while(h->count > 0 && h->trades[h->head].timestamp < cutoff) {
+        h->head = (h->head + 1) & (h->capacity - 1);
+        h->count--;
+    }
+}
+
+TradeData* history_at(SymbolHistory* h, size_t i) {
+    return &h->trades[(h->head + i) & (h->capacity - 1)];
+}
+
+int symbol_index(const char* symbol) {
+    for(int i = 0; i < 8; i++) {
+        if(strcmp(symbol, symbols[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
 }
 
-void parse_transaction(const char* json_str, size_t len, TradeQueue* queue) {
+void parse_transaction(const char* json_str, size_t len, TradeQueue* queue, uint64_t recv_ns, int feed) {
     if (!json_str) {
         return;
     }
@@ -56,6 +139,15 @@ void parse_transaction(const char* json_str, size_t len, TradeQueue* queue) {
         return; // Skip non-JSON messages
     }
     
+    // Order book pushes share the connection, everything else is treated as trades
+    cJSON *arg = cJSON_GetObjectItem(json, "arg");
+    cJSON *channel = arg ? cJSON_GetObjectItem(arg, "channel") : NULL;
+    if (cJSON_IsString(channel) && strcmp(channel->valuestring, "books") == 0) {
+        book_handle(json, recv_ns);
+        cJSON_Delete(json);
+        return;
+    }
+
     // Get the data array
     cJSON *data = cJSON_GetObjectItem(json, "data");
     if (!cJSON_IsArray(data)) {
@@ -73,6 +165,9 @@ void parse_transaction(const char* json_str, size_t len, TradeQueue* queue) {
         cJSON *px = cJSON_GetObjectItem(trade, "px");
         cJSON *sz = cJSON_GetObjectItem(trade, "sz");
         cJSON *ts = cJSON_GetObjectItem(trade, "ts");
+        cJSON *tradeId = cJSON_GetObjectItem(trade, "tradeId");
+        cJSON *side = cJSON_GetObjectItem(trade, "side");
+        cJSON *count = cJSON_GetObjectItem(trade, "count");
         
         // Verify all required fields are strings
         if (cJSON_IsString(instId) && cJSON_IsString(px) && cJSON_IsString(sz) && cJSON_IsString(ts)) {
@@ -84,42 +179,58 @@ void parse_transaction(const char* json_str, size_t len, TradeQueue* queue) {
             // Convert string values to appropriate types
             tdata.price = atof(px->valuestring);
             tdata.volume = atof(sz->valuestring);
-            tdata.timestamp = strtoull(ts->valuestring, NULL, 10) / 1000;
-            
+            tdata.timestamp = strtoull(ts->valuestring, NULL, 10);
+            tdata.trade_id = cJSON_IsString(tradeId) ? strtoull(tradeId->valuestring, NULL, 10) : 0;
+            tdata.side = !cJSON_IsString(side) ? TRADE_SIDE_UNKNOWN
+                       : side->valuestring[0] == 'b' ? TRADE_SIDE_BUY
+                       : side->valuestring[0] == 's' ? TRADE_SIDE_SELL : TRADE_SIDE_UNKNOWN;
+            metrics_add(METRIC_TRADES, 1);
+
+            // Drop trades that were already delivered, by the other feed or before a reconnect
+            int sym = symbol_index(tdata.symbol);
+            if(sym >= 0 && !shard_owns(sym)) {
+                continue;   // Another shard's symbol
+            }
+            // A push aggregates count fills and carries the last of their ids
+            uint64_t fills = cJSON_IsString(count) ? strtoull(count->valuestring, NULL, 10) : 1;
+            if(sym >= 0 && tdata.trade_id && seq_check(&seq_trackers[sym], sym, tdata.trade_id, fills) != SEQ_NEW) {
+                continue;
+            }
+            metrics_add_feed(FEED_METRIC_FIRST_DELIVERIES, feed, 1);
+
+            // Stamp decode/queue stages for sampled trades
+            tdata.trace = (TradeTrace){0};
+            if (trace_should_sample()) {
+                struct timespec wall;
+                clock_gettime(CLOCK_REALTIME, &wall);
+                tdata.trace.sampled = 1;
+                tdata.trace.recv_ns = recv_ns;
+                tdata.trace.decode_ns = trace_now_ns();
+
+                // Exchange latency is measured against the wall clock at receive time
+                int64_t recv_wall_ms = (int64_t)wall.tv_sec * 1000 + wall.tv_nsec / 1000000
+                                     - (int64_t)((tdata.trace.decode_ns - recv_ns) / 1000000);
+                int64_t exchange_ms = recv_wall_ms - (int64_t)tdata.timestamp;
+                trace_record(TRACE_EXCHANGE, exchange_ms > 0 ? (uint64_t)exchange_ms * 1000000 : 0);
+                trace_record(TRACE_DECODE, tdata.trace.decode_ns - recv_ns);
+                tdata.trace.queue_ns = trace_now_ns();
+            }
+
             // Add to queue
             queue_push(queue, &tdata);
+            if (tdata.trace.sampled) {
+                trace_record(TRACE_QUEUE, trace_now_ns() - tdata.trace.decode_ns);
+            }
 
-            // Add to symbol histories
-            for(int i = 0; i < 8; i++) {
-                if(strcmp(tdata.symbol, symbols[i]) == 0) {
-                    pthread_mutex_lock(&symbol_histories[i].mutex);
-                    
-                    // Clean old trades first
-                    time_t cutoff = tdata.timestamp - 900;
-                    size_t write_pos = 0;
-                    
-                    // Compact array by removing old trades
-                    for(size_t read_pos = 0; read_pos < symbol_histories[i].count; read_pos++) {
-                        if(symbol_histories[i].trades[read_pos].timestamp >= (uint64_t)cutoff) {
-                            if(write_pos != read_pos) {
-                                symbol_histories[i].trades[write_pos] = symbol_histories[i].trades[read_pos];
-                            }
-                            write_pos++;
-                        }
-                    }
-                    symbol_histories[i].count = write_pos;
-                    
-                    // Resize array if needed
-                    if(symbol_histories[i].count >= symbol_histories[i].capacity) {
-                        symbol_histories[i].capacity = symbol_histories[i].capacity ? symbol_histories[i].capacity * 2 : 128;
-                        symbol_histories[i].trades = realloc(symbol_histories[i].trades, symbol_histories[i].capacity * sizeof(TradeData));
-                    }
-                    
-                    // Add trade to history
-                    symbol_histories[i].trades[symbol_histories[i].count++] = tdata;
-                    pthread_mutex_unlock(&symbol_histories[i].mutex);
-                    break;
+            // Hand to the reorder buffer, the window is filled in event-time order when minutes close
+            if(sym >= 0) {
+                broadcast_trade(sym, &tdata, recv_ns);
+                stats_update(sym, tdata.timestamp, tdata.trade_id, tdata.price, tdata.volume);
+                if(tdata.side != TRADE_SIDE_UNKNOWN) {
+                    flow_update(sym, tdata.timestamp, tdata.price, tdata.volume,
+                                tdata.side == TRADE_SIDE_BUY ? FLOW_BUY : FLOW_SELL);
                 }
+                reorder_insert(sym, &tdata);
             }
         }
     }
@@ -129,7 +240,7 @@ void parse_transaction(const char* json_str, size_t len, TradeQueue* queue) {
 }
 
 void log_time(struct timespec* start, struct timespec* end) {
-    FILE* f = fopen("logs/timings.log", "a");
+    FILE* f = fopen(TIMINGS_LOG, "a");
     if (f) {
         time_t start_s = start->tv_sec;
         time_t end_s = end->tv_sec;
@@ -137,7 +248,7 @@ void log_time(struct timespec* start, struct timespec* end) {
         strftime(start_time, sizeof(start_time), "%H:%M:%S", localtime(&start_s));
         strftime(end_time, sizeof(end_time), "%H:%M:%S", localtime(&end_s));
         
-        fprintf(f, "Start: %s.%03ld, End: %s.%03ld, Duration: %.3f ms\n",
+        fprintf(f, TIMING_RECORD_FMT,
             start_time, (long)(start->tv_nsec / 1000000),
             end_time, (long)(end->tv_nsec / 1000000),
             ((end->tv_sec - start->tv_sec) * 1000.0) + 
@@ -6,11 +6,30 @@
 #include <stdatomic.h>
 #include <cjson/cJSON.h>
 
+// Monotonic stage timestamps, only filled in for sampled trades
 typedef struct {
+    uint64_t recv_ns;
+    uint64_t decode_ns;
+    uint64_t queue_ns;
+    uint8_t sampled;
+    uint8_t in_mavg;
+} TradeTrace;
+
+// Aggressor side as reported by the exchange, unknown for trades restored from text logs
+typedef enum {
+    TRADE_SIDE_UNKNOWN,
+    TRADE_SIDE_BUY,
+    TRADE_SIDE_SELL
+} TradeSide;
+
+typedef struct TradeData {
     char symbol[16];
     double price;
     double volume;
-    uint64_t timestamp;
+    uint64_t timestamp;     // Exchange timestamp in ms
+    uint64_t trade_id;
+    uint8_t side;           // TradeSide
+    TradeTrace trace;
 } TradeData;
 
 typedef struct TradeQueue {
@@ -22,12 +41,20 @@ typedef struct TradeQueue {
     pthread_cond_t not_empty;
 } TradeQueue;
 
-typedef struct {
-    TradeData* trades;
+typedef struct SymbolHistory {
+    TradeData* trades;      // Ring ordered by timestamp, oldest at head, capacity a power of two
+    double* prices;         // Same ring positions as trades, as columns for the statistics kernels
+    double* volumes;
+    size_t head;
     size_t count;
     size_t capacity;
     pthread_mutex_t mutex;
 
+    // Reorder buffer: trades waiting for their minute to be finalised
+    TradeData* pending;
+    size_t pending_count;
+    size_t pending_capacity;
+
     // Last 8 moving average values
     double movingAvg_history[8];
     time_t movingAvg_timestamps[8];   
@@ -50,8 +77,13 @@ extern atomic_int logger_interrupt;
 
 void queue_init(TradeQueue* q, size_t size);
 void queue_push(TradeQueue* q, TradeData* trade);
-void queue_pop (TradeQueue* q, TradeData* trade);
-void parse_transaction(const char* json_str, size_t len, TradeQueue* queue);
+int  queue_pop (TradeQueue* q, TradeData* trade);
+int  queue_try_pop(TradeQueue* q, TradeData* trade);
+void history_push(SymbolHistory* h, const TradeData* trade);
+void history_evict(SymbolHistory* h, uint64_t cutoff);
+TradeData* history_at(SymbolHistory* h, size_t i);
+int  symbol_index(const char* symbol);
+void parse_transaction(const char* json_str, size_t len, TradeQueue* queue, uint64_t recv_ns, int feed);
 void log_time(struct timespec* start, struct timespec* end);
 void get_cpu_data(CpuData* data);
 float get_cpu_idle(CpuData* current_data, CpuData* previous_data);
\ No newline at end of file
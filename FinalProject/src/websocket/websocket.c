@@ -1,78 +1,165 @@
 #include "websocket.h"
 #include "../utils/utils.h"
+#include "../trace/trace.h"
+#include "../metrics/metrics.h"
+#include "../book/book.h"
+#include "../shard/shard.h"
 
-atomic_bool is_connected = false;
-time_t last_activity = 0;
-static time_t last_ping     = 0;
-
-static void subscribe(struct lws *wsi) {
-    const char* msg = "{\"op\":\"subscribe\",\"args\":["
-        "{\"channel\":\"trades\",\"instId\":\"BTC-USDT\"},"
-        "{\"channel\":\"trades\",\"instId\":\"ADA-USDT\"},"
-        "{\"channel\":\"trades\",\"instId\":\"ETH-USDT\"},"
-        "{\"channel\":\"trades\",\"instId\":\"DOGE-USDT\"},"
-        "{\"channel\":\"trades\",\"instId\":\"XRP-USDT\"},"
-        "{\"channel\":\"trades\",\"instId\":\"SOL-USDT\"},"
-        "{\"channel\":\"trades\",\"instId\":\"LTC-USDT\"},"
-        "{\"channel\":\"trades\",\"instId\":\"BNB-USDT\"}"
-    "]}";
-    size_t len = strlen(msg);
-    unsigned char buf[LWS_PRE + len];
-    memcpy(&buf[LWS_PRE], msg, len);
+#define METRICS_BODY_MAX 16384
+
+typedef struct {
+    size_t len;
+    unsigned char buf[LWS_PRE + METRICS_BODY_MAX];
+} MetricsSession;
+
+WebsocketPollHook websocket_poll_hook = NULL;
+bool websocket_deflate = false;
+
+FeedEndpoint feed_endpoint = {
+    .address = "ws.okx.com",
+    .path = "/ws/v5/public",
+    .port = 8443,
+    .ssl = true,
+};
+
+// Trades for every symbol this shard owns, plus order books on the first feed only since book updates
+// are a per-connection stream and cannot be merged across feeds
+static void subscribe(Feed* feed, struct lws *wsi) {
+    unsigned char buf[LWS_PRE + 2048];
+    char* msg = (char*)&buf[LWS_PRE];
+    size_t cap = sizeof(buf) - LWS_PRE;
+    int books = book_enabled && feed->id == 0;
+
+    size_t len = (size_t)snprintf(msg, cap, "{\"op\":\"subscribe\",\"args\":[");
+    int first = 1;
+    for (int i = 0; i < 8; i++) {
+        if (!shard_owns(i)) {
+            continue;
+        }
+        len += (size_t)snprintf(msg + len, cap - len, "%s{\"channel\":\"trades\",\"instId\":\"%s\"}", first ? "" : ",", symbols[i]);
+        first = 0;
+        if (books) {
+            len += (size_t)snprintf(msg + len, cap - len, ",{\"channel\":\"books\",\"instId\":\"%s\"}", symbols[i]);
+        }
+    }
+    len += (size_t)snprintf(msg + len, cap - len, "]}");
 
     int ret = lws_write(wsi, &buf[LWS_PRE], len, LWS_WRITE_TEXT);
     if (ret < 0) {
-        atomic_store(&is_connected, false);
+        atomic_store(&feed->is_connected, false);
     } else {
         bool* subscribed = lws_wsi_user(wsi);
         *subscribed = true;
     }
 }
 
+// Appends a fragment of the current message, timestamping its first byte for the trace.
+// Inflated messages arrive in pieces of at most rx_buffer_size
+static int append_rx(Feed* feed, const void* in, size_t len) {
+    if (feed->rx_len == 0) {
+        feed->rx_first_ns = trace_now_ns();
+    }
+    if (feed->rx_len + len + 1 > feed->rx_cap) {
+        size_t cap = feed->rx_cap ? feed->rx_cap : 8192;
+        while (cap < feed->rx_len + len + 1) {
+            cap *= 2;
+        }
+        char* buf = cap <= WEBSOCKET_MAX_MESSAGE ? realloc(feed->rx_buf, cap) : NULL;
+        if (!buf) {
+            feed->rx_len = 0;       // The caller discards the rest of the message
+            return -1;
+        }
+        feed->rx_buf = buf;
+        feed->rx_cap = cap;
+    }
+    memcpy(feed->rx_buf + feed->rx_len, in, len);
+    feed->rx_len += len;
+    return 0;
+}
+
 int websocket_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
     bool* subscribed = (bool*)user;
+    Feed* feed = (Feed*)lws_context_user(lws_get_context(wsi));
     time_t now = time(NULL);
+    bool final;
 
     switch (reason) {
         case LWS_CALLBACK_CLIENT_ESTABLISHED:
-            atomic_store(&is_connected, true);
+            atomic_store(&feed->is_connected, true);
+            metrics_set_feed(FEED_GAUGE_CONNECTED, feed->id, 1);
             *subscribed = false;
             lws_callback_on_writable(wsi);
             break;
 
         case LWS_CALLBACK_CLIENT_WRITEABLE:
             if (!*subscribed) {
-                subscribe(wsi);
-            } else if (now - last_ping >= 60) {
+                subscribe(feed, wsi);
+            } else if (feed->id == 0 && book_resync_pending()) {
+                unsigned char resync_buf[LWS_PRE + 256];
+                size_t resync_len = book_resync_message((char*)&resync_buf[LWS_PRE], sizeof(resync_buf) - LWS_PRE);
+                if (resync_len && lws_write(wsi, &resync_buf[LWS_PRE], resync_len, LWS_WRITE_TEXT) < 0) {
+                    atomic_store(&feed->is_connected, false);
+                }
+                if (book_resync_pending()) {
+                    lws_callback_on_writable(wsi);
+                }
+            } else if (now - feed->last_ping >= 60) {
                 unsigned char ping_buf[LWS_PRE + 1];
                 int ret = lws_write(wsi, &ping_buf[LWS_PRE], 0, LWS_WRITE_PING);
                 if (ret < 0) {
-                    atomic_store(&is_connected, false);
+                    atomic_store(&feed->is_connected, false);
                 } else {
-                    last_ping = now;
+                    feed->last_ping = now;
                 }
             }
             break;
 
         case LWS_CALLBACK_CLIENT_RECEIVE:
-            last_activity = now;
-            char *message = malloc(len + 1);
-            memcpy(message, in, len);
-            message[len] = '\0';
-            parse_transaction(message, len, &trade_queue);
-            free(message);
+            feed->last_activity = now;
+            metrics_add(METRIC_BYTES_RECEIVED, len);
+            final = lws_is_final_fragment(wsi) && !lws_remaining_packet_payload(wsi);
+            if (feed->rx_discard || append_rx(feed, in, len) != 0) {
+                feed->rx_discard = !final;  // Skip the rest of an oversized message, the next one starts clean
+                break;
+            }
+            if (!final) {
+                break;
+            }
+            metrics_add(METRIC_MESSAGES, 1);
+            metrics_add_feed(FEED_METRIC_MESSAGES, feed->id, 1);
+            feed->rx_buf[feed->rx_len] = '\0';
+            parse_transaction(feed->rx_buf, feed->rx_len, &trade_queue, feed->rx_first_ns, feed->id);
+            feed->rx_len = 0;
+            if (feed->id == 0 && book_resync_pending()) {
+                lws_callback_on_writable(wsi);
+            }
             break;
 
         case LWS_CALLBACK_CLIENT_RECEIVE_PONG:
-            last_activity = now;
+            feed->last_activity = now;
             break;
 
+        case LWS_CALLBACK_ADD_POLL_FD:
+        case LWS_CALLBACK_DEL_POLL_FD:
+        case LWS_CALLBACK_CHANGE_MODE_POLL_FD:
+            return websocket_poll_hook ? websocket_poll_hook(feed, reason, (struct lws_pollargs*)in) : 0;
+
+        // Dropping the handle lets the run loop reconnect without waiting for the inactivity timeout
         case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
-            atomic_store(&is_connected, false);
+            atomic_store(&feed->is_connected, false);
+            feed->rx_len = 0;
+            feed->rx_discard = false;
+            if (feed->wsi == wsi) feed->wsi = NULL;
+            metrics_set_feed(FEED_GAUGE_CONNECTED, feed->id, 0);
             break;
 
         case LWS_CALLBACK_CLOSED:
-            atomic_store(&is_connected, false);
+            atomic_store(&feed->is_connected, false);
+            feed->rx_len = 0;
+            feed->rx_discard = false;
+            if (feed->wsi == wsi) feed->wsi = NULL;
+            metrics_set_feed(FEED_GAUGE_CONNECTED, feed->id, 0);
+            metrics_add(METRIC_DISCONNECTS, 1);
             break;
 
         default:
@@ -82,7 +169,59 @@ int websocket_callback(struct lws* wsi, enum lws_callback_reasons reason, void*
     return 0;
 }
 
+// Serves GET /metrics from the same context as the exchange client
+static int metrics_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
+    MetricsSession* session = (MetricsSession*)user;
+    unsigned char headers[LWS_PRE + 256];
+    unsigned char *start = &headers[LWS_PRE], *p = start, *end = &headers[sizeof(headers) - 1];
+
+    switch (reason) {
+        case LWS_CALLBACK_HTTP:
+            if (strcmp((const char*)in, "/metrics") != 0) {
+                lws_return_http_status(wsi, HTTP_STATUS_NOT_FOUND, NULL);
+                return lws_http_transaction_completed(wsi) ? -1 : 0;
+            }
+
+            session->len = metrics_render((char*)&session->buf[LWS_PRE], METRICS_BODY_MAX);
+            if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK, "text/plain; version=0.0.4", session->len, &p, end) ||
+                lws_finalize_write_http_header(wsi, start, &p, end)) {
+                return 1;
+            }
+            lws_callback_on_writable(wsi);
+            return 0;
+
+        case LWS_CALLBACK_HTTP_WRITEABLE:
+            if (lws_write(wsi, &session->buf[LWS_PRE], session->len, LWS_WRITE_HTTP_FINAL) != (int)session->len) {
+                return 1;
+            }
+            return lws_http_transaction_completed(wsi) ? -1 : 0;
+
+        // Socket changes are reported on the first protocol, forward them to an external loop if any
+        case LWS_CALLBACK_ADD_POLL_FD:
+        case LWS_CALLBACK_DEL_POLL_FD:
+        case LWS_CALLBACK_CHANGE_MODE_POLL_FD:
+            if (websocket_poll_hook) {
+                return websocket_poll_hook((Feed*)lws_context_user(lws_get_context(wsi)), reason, (struct lws_pollargs*)in);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
 static struct lws_protocols protocols[] = {
+    {
+        .name = "http-metrics",
+        .callback = metrics_callback,
+        .per_session_data_size = sizeof(MetricsSession),
+        .rx_buffer_size = 0,
+        .id = 0,
+        .user = NULL,
+        .tx_packet_size = 0
+    },
     {
         .name = "okx-protocol",
         .callback = websocket_callback,
@@ -95,11 +234,77 @@ static struct lws_protocols protocols[] = {
     { NULL, NULL, 0, 0, 0, NULL, 0 }
 };
 
-struct lws_context* websocket_init() {
+// The stock permessage-deflate extension keeps one zlib stream per connection for its whole
+// life. Wrapped only to account for what it consumes, produces and costs in CPU time
+static int deflate_callback(struct lws_context* context, const struct lws_extension* ext, struct lws* wsi,
+                            enum lws_extension_callback_reasons reason, void* user, void* in, size_t len) {
+    if (reason != LWS_EXT_CB_PAYLOAD_RX) {
+        return lws_extension_callback_pm_deflate(context, ext, wsi, reason, user, in, len);
+    }
+
+    struct lws_ext_pm_deflate_rx_ebufs* pmdrx = in;
+    const unsigned char* wire = pmdrx->eb_in.token;
+    int wire_len = pmdrx->eb_in.len;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+    int ret = lws_extension_callback_pm_deflate(context, ext, wsi, reason, user, in, len);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+
+    // Uncompressed frames pass through with the input left in place
+    int consumed = wire_len - pmdrx->eb_in.len;
+    int inflated = pmdrx->eb_out.token != wire && pmdrx->eb_out.len > 0 ? pmdrx->eb_out.len : 0;
+    if (consumed > 0 || inflated > 0) {
+        metrics_add(METRIC_DEFLATE_WIRE_BYTES, consumed > 0 ? (uint64_t)consumed : 0);
+        metrics_add(METRIC_DEFLATE_INFLATED_BYTES, (uint64_t)inflated);
+        metrics_add(METRIC_DEFLATE_CPU_NS, (uint64_t)((t1.tv_sec - t0.tv_sec) * 1000000000ll + (t1.tv_nsec - t0.tv_nsec)));
+    }
+    return ret;
+}
+
+static const struct lws_extension extensions[] = {
+    {"permessage-deflate", deflate_callback, "permessage-deflate; client_max_window_bits"},
+    {NULL, NULL, NULL}
+};
+
+// Accepts ws://host[:port][/path] and wss://host[:port][/path]
+int websocket_parse_url(const char* url, FeedEndpoint* endpoint) {
+    const char* rest;
+    if (strncmp(url, "wss://", 6) == 0) {
+        endpoint->ssl = true;
+        endpoint->port = 443;
+        rest = url + 6;
+    } else if (strncmp(url, "ws://", 5) == 0) {
+        endpoint->ssl = false;
+        endpoint->port = 80;
+        rest = url + 5;
+    } else {
+        return -1;
+    }
+
+    size_t host_len = strcspn(rest, ":/");
+    if (host_len == 0 || host_len >= sizeof(endpoint->address)) {
+        return -1;
+    }
+    memcpy(endpoint->address, rest, host_len);
+    endpoint->address[host_len] = '\0';
+    rest += host_len;
+
+    if (*rest == ':') {
+        endpoint->port = (int)strtol(rest + 1, (char**)&rest, 10);
+    }
+    snprintf(endpoint->path, sizeof(endpoint->path), "%s", *rest == '/' ? rest : "/");
+    return 0;
+}
+
+// Only the feed given a listen port also serves /metrics
+struct lws_context* websocket_init(Feed* feed, int listen_port) {
     struct lws_context_creation_info info;
     memset(&info, 0, sizeof(info));
-    info.port = CONTEXT_PORT_NO_LISTEN;
+    info.port = listen_port > 0 ? listen_port : CONTEXT_PORT_NO_LISTEN;
+    info.iface = listen_port > 0 ? "127.0.0.1" : NULL;
     info.protocols = protocols;
+    info.extensions = websocket_deflate ? extensions : NULL;
+    info.user = feed;
     info.options |= LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
     info.options |= LWS_SERVER_OPTION_PEER_CERT_NOT_REQUIRED;
     info.client_ssl_ca_filepath = "/etc/ssl/certs/ca-certificates.crt";
@@ -107,18 +312,82 @@ struct lws_context* websocket_init() {
     info.ka_interval = 5;
     info.ka_probes = 3;
 
-    return lws_create_context(&info);
+    feed->context = lws_create_context(&info);
+    if (!feed->context && listen_port > 0) {
+        // Most likely the port is taken, the feed matters more than the metrics endpoint
+        fprintf(stderr, "Failed to listen for metrics on 127.0.0.1:%d, continuing without the endpoint\n", listen_port);
+        info.port = CONTEXT_PORT_NO_LISTEN;
+        info.iface = NULL;
+        feed->context = lws_create_context(&info);
+    }
+    feed->backoff = 2;
+    return feed->context;
 }
 
-struct lws* websocket_connect(struct lws_context *context) {
+struct lws* websocket_connect(Feed* feed) {
     struct lws_client_connect_info ccinfo = {0};
-    ccinfo.context      = context;
-    ccinfo.address      = "ws.okx.com";
-    ccinfo.port         = 8443;
-    ccinfo.path         = "/ws/v5/public";
-    ccinfo.host         = "ws.okx.com";
+    ccinfo.context      = feed->context;
+    ccinfo.address      = feed_endpoint.address;
+    ccinfo.port         = feed_endpoint.port;
+    ccinfo.path         = feed_endpoint.path;
+    ccinfo.host         = feed_endpoint.address;
     ccinfo.origin       = "https://www.okx.com";
-    ccinfo.ssl_connection = LCCSCF_USE_SSL;
+    ccinfo.ssl_connection = feed_endpoint.ssl ? LCCSCF_USE_SSL : 0;
     ccinfo.protocol     = "okx-protocol";
+    ccinfo.pwsi         = &feed->wsi;
     return lws_client_connect_via_info(&ccinfo);
+}
+
+// Reconnects with exponential backoff and drops connections that went quiet
+void websocket_maintain(Feed* feed, time_t now) {
+    const int max_backoff = 60;
+
+    // Check if we need to reconnect
+    if (!feed->wsi && !atomic_load(&feed->is_connected)) {
+        if (now - feed->last_connect >= feed->backoff) {
+            feed->wsi = websocket_connect(feed);
+            feed->last_connect = now;
+            metrics_add(METRIC_CONNECT_ATTEMPTS, 1);
+            if (feed->wsi) {
+                printf("Feed %d connected to WebSocket server.\n", feed->id);
+                feed->last_activity = now;  // reset timer on connect attempt
+                feed->backoff = 2;
+            } else {
+                printf("Feed %d connection failed, retrying...\n", feed->id);
+                metrics_add(METRIC_CONNECT_FAILURES, 1);
+                feed->backoff = feed->backoff < max_backoff ? feed->backoff * 2 : max_backoff;
+            }
+        }
+    }
+
+    // Check for inactivity
+    if (feed->wsi && now - feed->last_activity > 90) {
+        atomic_store(&feed->is_connected, false);
+        metrics_set_feed(FEED_GAUGE_CONNECTED, feed->id, 0);
+        metrics_add(METRIC_DISCONNECTS, 1);
+        feed->wsi = NULL;
+    }
+}
+
+// Threaded mode: the calling thread services this feed until its stop flag is raised
+void websocket_run(Feed* feed) {
+    feed->last_activity = time(NULL);
+    while(!*feed->stop) {
+        websocket_maintain(feed, time(NULL));
+
+        if(feed->wsi) {
+            int n = lws_service(feed->context, 50);
+            if (n < 0) {
+                atomic_store(&feed->is_connected, false);
+                feed->wsi = NULL;
+            }
+        } else {
+            lws_service(feed->context, 100); // Wait up to 100ms if not connected, still serving /metrics
+        }
+    }
+}
+
+void* websocket_thread(void* arg) {
+    websocket_run((Feed*)arg);
+    return NULL;
 }
\ No newline at end of file
@@ -1,10 +1,49 @@
 #include <libwebsockets.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <signal.h>
 
-extern atomic_bool is_connected;
-extern time_t last_activity;
+#define MAX_FEEDS 2
+#define WEBSOCKET_MAX_MESSAGE (1 << 20)    // Reassembled messages larger than this are dropped
+
+typedef struct {
+    char address[128];
+    char path[128];
+    int port;
+    bool ssl;
+} FeedEndpoint;
+
+// One exchange connection with its own lws context, serviced by one thread
+typedef struct Feed {
+    int id;
+    struct lws_context* context;
+    struct lws* wsi;
+    atomic_bool is_connected;
+    time_t last_activity;
+    time_t last_ping;
+    time_t last_connect;
+    int backoff;
+    volatile sig_atomic_t* stop;
+
+    // Fragments are reassembled here, the buffer only grows so steady state allocates nothing
+    char* rx_buf;
+    size_t rx_len;
+    size_t rx_cap;
+    uint64_t rx_first_ns;
+    bool rx_discard;                // Rest of an oversized message is skipped until its final fragment
+} Feed;
+
+// Set by an external event loop to own the sockets of every feed context
+typedef int (*WebsocketPollHook)(struct Feed* feed, enum lws_callback_reasons reason, struct lws_pollargs* args);
+
+extern FeedEndpoint feed_endpoint;
+extern bool websocket_deflate;
+extern WebsocketPollHook websocket_poll_hook;
 
 int websocket_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len);
-struct lws_context* websocket_init();
-struct lws* websocket_connect(struct lws_context *context);
\ No newline at end of file
+int websocket_parse_url(const char* url, FeedEndpoint* endpoint);
+struct lws_context* websocket_init(Feed* feed, int listen_port);
+struct lws* websocket_connect(Feed* feed);
+void  websocket_maintain(Feed* feed, time_t now);
+void  websocket_run(Feed* feed);
+void* websocket_thread(void* arg);
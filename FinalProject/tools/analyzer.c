@@ -0,0 +1,578 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../src/utils/records.h"
+#include "../src/tsdb/tsdb.h"
+
+// Native replacement for the regex parsing in evaluation.py: mmaps the logs,
+// parses them in parallel chunks and writes the aggregates the plots need as CSV.
+// Series the compressed store holds are decoded from it instead, the text logs
+// are only read for what the store does not have (older runs, or -T "")
+
+#define MAX_TASKS 4096
+#define IDLE_BINS 200           // 0.5% wide CPU idle histogram bins
+
+static const char* symbols[8] = SYMBOL_NAMES;
+
+typedef enum { KIND_MAVG, KIND_CORR, KIND_TIMING, KIND_CPU } LogKind;
+
+typedef struct {
+    uint64_t ts;
+    double value;
+} Point;
+
+typedef struct {
+    char start[16];
+    double duration_ms;
+} Timing;
+
+// Growable array shared by every record type
+typedef struct {
+    void* data;
+    size_t count;
+    size_t capacity;
+    size_t elem;
+} Vec;
+
+typedef struct {
+    LogKind kind;
+    int symbol;
+    const char* begin;
+    const char* end;
+
+    // Per chunk results, merged in chunk order afterwards
+    Vec rows;
+    double corr_sum[8];
+    uint64_t corr_count[8];
+} Task;
+
+typedef struct {
+    void* base;
+    size_t len;
+} Mapping;
+
+static Task tasks[MAX_TASKS];
+static int task_count = 0;
+static atomic_int next_task = 0;
+static Mapping mappings[32];
+static int mapping_count = 0;
+
+static void* vec_push(Vec* v) {
+    if (v->count == v->capacity) {
+        v->capacity = v->capacity ? v->capacity * 2 : 1024;
+        v->data = realloc(v->data, v->capacity * v->elem);
+    }
+    return (char*)v->data + v->elem * v->count++;
+}
+
+// Fixed-point decimal parser, bounded by the line end so it never reads past the mapping
+static const char* parse_decimal(const char* p, const char* end, double* out) {
+    int neg = 0;
+    if (p < end && *p == '-') { neg = 1; p++; }
+
+    const char* digits = p;
+    uint64_t mant = 0;
+    int frac = 0, seen_dot = 0;
+    while (p < end && ((*p >= '0' && *p <= '9') || (*p == '.' && !seen_dot))) {
+        if (*p == '.') {
+            seen_dot = 1;
+        } else if (mant < 1000000000000000000ull) {
+            mant = mant * 10 + (uint64_t)(*p - '0');
+            frac += seen_dot;
+        }
+        p++;
+    }
+    if (p == digits) {
+        return NULL;
+    }
+
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    double v = (double)mant / pow10[frac < 18 ? frac : 18];
+    *out = neg ? -v : v;
+    return p;
+}
+
+static const char* parse_u64(const char* p, const char* end, uint64_t* out) {
+    const char* start = p;
+    uint64_t v = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = v * 10 + (uint64_t)(*p++ - '0');
+    }
+    *out = v;
+    return p == start ? NULL : p;
+}
+
+static const char* find(const char* p, const char* end, const char* tag) {
+    size_t n = strlen(tag);
+    while (p + n <= end) {
+        const char* hit = memchr(p, tag[0], (size_t)(end - p));
+        if (!hit || hit + n > end) return NULL;
+        if (memcmp(hit, tag, n) == 0) return hit + n;
+        p = hit + 1;
+    }
+    return NULL;
+}
+
+static const char* skip_spaces(const char* p, const char* end) {
+    while (p < end && *p == ' ') p++;
+    return p;
+}
+
+static void parse_line(Task* t, const char* p, const char* end) {
+    uint64_t ts;
+    double value;
+
+    switch (t->kind) {
+        case KIND_MAVG:
+        case KIND_CPU: {
+            if (p >= end || *p != '[' || !(p = parse_u64(p + 1, end, &ts))) return;
+            if (t->kind == KIND_MAVG) {
+                if (!(p = find(p, end, MAVG_VALUE_TAG))) return;
+            } else if (p + 2 > end || p[0] != ']' || p[1] != ',') {
+                return;
+            } else {
+                p += 2;
+            }
+            if (!parse_decimal(skip_spaces(p, end), end, &value)) return;
+            Point* pt = vec_push(&t->rows);
+            pt->ts = ts;
+            pt->value = value;
+            break;
+        }
+
+        case KIND_CORR: {
+            // The last 8 fields are the correlations against every symbol
+            const char* fields[CORR_FIELDS];
+            int n = 0;
+            fields[n++] = p;
+            for (const char* c = p; c < end && n < CORR_FIELDS; c++) {
+                if (*c == ',') fields[n++] = c + 1;
+            }
+            if (n < CORR_FIELDS) return;
+
+            double vals[8];
+            for (int k = 0; k < 8; k++) {
+                if (!parse_decimal(fields[CORR_FIELDS - 8 + k], end, &vals[k])) return;
+            }
+            for (int k = 0; k < 8; k++) {
+                t->corr_sum[k] += vals[k];
+                t->corr_count[k]++;
+            }
+            break;
+        }
+
+        case KIND_TIMING: {
+            size_t tag_len = strlen(TIMING_START_TAG);
+            if ((size_t)(end - p) < tag_len || memcmp(p, TIMING_START_TAG, tag_len) != 0) return;
+            const char* start = p + tag_len;
+            const char* comma = memchr(start, ',', (size_t)(end - start));
+            if (!comma || comma - start >= 16) return;
+            if (!(p = find(comma, end, TIMING_DURATION_TAG))) return;
+            if (!parse_decimal(skip_spaces(p, end), end, &value)) return;
+
+            Timing* row = vec_push(&t->rows);
+            memcpy(row->start, start, (size_t)(comma - start));
+            row->start[comma - start] = '\0';
+            row->duration_ms = value;
+            break;
+        }
+    }
+}
+
+static void* worker(void* arg __attribute__((unused))) {
+    int idx;
+    while ((idx = atomic_fetch_add(&next_task, 1)) < task_count) {
+        Task* t = &tasks[idx];
+        const char* p = t->begin;
+        while (p < t->end) {
+            const char* nl = memchr(p, '\n', (size_t)(t->end - p));
+            const char* line_end = nl ? nl : t->end;
+            parse_line(t, p, line_end);
+            p = line_end + 1;
+        }
+    }
+    return NULL;
+}
+
+// Splits a mapped file into chunks that start and end on line boundaries
+static void add_file(const char* path, LogKind kind, int symbol, size_t chunk_size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0 || mapping_count == 32) {
+        close(fd);
+        return;
+    }
+    char* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return;
+    madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+    mappings[mapping_count++] = (Mapping){base, (size_t)st.st_size};
+
+    const char* end = base + st.st_size;
+    const char* p = base;
+    while (p < end && task_count < MAX_TASKS) {
+        const char* cut = (size_t)(end - p) > chunk_size ? p + chunk_size : end;
+        if (cut < end) {
+            const char* nl = memchr(cut, '\n', (size_t)(end - cut));
+            cut = nl ? nl + 1 : end;
+        }
+        if (task_count == MAX_TASKS - 1) {
+            cut = end;
+        }
+        tasks[task_count++] = (Task){
+            .kind = kind, .symbol = symbol, .begin = p, .end = cut,
+            .rows = {.elem = kind == KIND_TIMING ? sizeof(Timing) : sizeof(Point)},
+        };
+        p = cut;
+    }
+}
+
+// A task with no text to parse, its rows come from the store
+static Task* add_store_task(LogKind kind, int symbol) {
+    if (task_count == MAX_TASKS) return NULL;
+    tasks[task_count] = (Task){
+        .kind = kind, .symbol = symbol,
+        .rows = {.elem = kind == KIND_TIMING ? sizeof(Timing) : sizeof(Point)},
+    };
+    return &tasks[task_count++];
+}
+
+static int store_point(const TsdbPoint* p, void* ctx) {
+    Point* pt = vec_push(&((Task*)ctx)->rows);
+    pt->ts = (uint64_t)p->ts;
+    pt->value = p->value[0];
+    return 0;
+}
+
+// Tick durations are stamped with the tick's unix second, the log's start column is rebuilt from it
+static int store_timing(const TsdbPoint* p, void* ctx) {
+    Timing* row = vec_push(&((Task*)ctx)->rows);
+    time_t ts = (time_t)p->ts;
+    char clock[16];
+    strftime(clock, sizeof(clock), "%H:%M:%S", localtime(&ts));
+    snprintf(row->start, sizeof(row->start), "%.8s.000", clock);
+    row->duration_ms = p->value[0];
+    return 0;
+}
+
+typedef struct {
+    Task* task;
+    int other;
+} CorrCtx;
+
+static int store_corr(const TsdbPoint* p, void* ctx) {
+    CorrCtx* c = ctx;
+    c->task->corr_sum[c->other] += p->value[0];
+    c->task->corr_count[c->other]++;
+    return 0;
+}
+
+// Reads one raw series into a new task, 0 when the store has no points for it
+static long load_series(const char* store, const char* name, LogKind kind, int symbol) {
+    Task* t = add_store_task(kind, symbol);
+    if (!t) return 0;
+    long n = tsdb_scan(store, name, TSDB_RAW, INT64_MIN, INT64_MAX, kind == KIND_TIMING ? store_timing : store_point, t);
+    if (n <= 0) {
+        free(t->rows.data);
+        task_count--;
+        return 0;
+    }
+    return n;
+}
+
+// Every pair is stored once as corr.A.B with A before B, it counts towards both rows
+static long load_corr_pairs(const char* store, int symbol) {
+    Task* t = add_store_task(KIND_CORR, symbol);
+    if (!t) return 0;
+    long total = 0;
+    for (int other = 0; other < 8; other++) {
+        if (other == symbol) continue;
+        int a = symbol < other ? symbol : other, b = symbol < other ? other : symbol;
+        char name[64];
+        snprintf(name, sizeof(name), "corr.%s.%s", symbols[a], symbols[b]);
+        CorrCtx ctx = {t, other};
+        long n = tsdb_scan(store, name, TSDB_RAW, INT64_MIN, INT64_MAX, store_corr, &ctx);
+        if (n > 0) total += n;
+    }
+    if (total == 0) task_count--;
+    return total;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static FILE* open_out(const char* dir, const char* name) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE* f = fopen(path, "w");
+    if (!f) perror(path);
+    return f;
+}
+
+// Wide table, one row per timestamp, last value per symbol wins like the pandas pivot
+static void write_mavg(const char* out_dir) {
+    size_t total = 0;
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].kind == KIND_MAVG) total += tasks[i].rows.count;
+    }
+    if (total == 0) return;
+
+    uint64_t* stamps = malloc(total * sizeof(uint64_t));
+    size_t n = 0;
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].kind != KIND_MAVG) continue;
+        Point* pts = tasks[i].rows.data;
+        for (size_t k = 0; k < tasks[i].rows.count; k++) stamps[n++] = pts[k].ts;
+    }
+    qsort(stamps, n, sizeof(uint64_t), cmp_u64);
+    size_t unique = 0;
+    for (size_t k = 0; k < n; k++) {
+        if (unique == 0 || stamps[unique - 1] != stamps[k]) stamps[unique++] = stamps[k];
+    }
+
+    double* table = malloc(unique * 8 * sizeof(double));
+    for (size_t k = 0; k < unique * 8; k++) table[k] = NAN;
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].kind != KIND_MAVG) continue;
+        Point* pts = tasks[i].rows.data;
+        for (size_t k = 0; k < tasks[i].rows.count; k++) {
+            uint64_t* row = bsearch(&pts[k].ts, stamps, unique, sizeof(uint64_t), cmp_u64);
+            table[(size_t)(row - stamps) * 8 + tasks[i].symbol] = pts[k].value;
+        }
+    }
+
+    FILE* f = open_out(out_dir, "mavg.csv");
+    if (f) {
+        fprintf(f, "timestamp");
+        for (int s = 0; s < 8; s++) fprintf(f, ",%s", symbols[s]);
+        fprintf(f, "\n");
+        for (size_t r = 0; r < unique; r++) {
+            fprintf(f, "%llu", (unsigned long long)stamps[r]);
+            for (int s = 0; s < 8; s++) {
+                if (isnan(table[r * 8 + s])) fprintf(f, ",");
+                else fprintf(f, ",%.8f", table[r * 8 + s]);
+            }
+            fprintf(f, "\n");
+        }
+        fclose(f);
+    }
+    free(table);
+    free(stamps);
+}
+
+// Averaged and symmetrised the same way as load_corr() in evaluation.py
+static void write_corr(const char* out_dir) {
+    double sum[8][8] = {{0}};
+    uint64_t count[8][8] = {{0}};
+    int any = 0;
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].kind != KIND_CORR) continue;
+        any = 1;
+        for (int k = 0; k < 8; k++) {
+            sum[tasks[i].symbol][k] += tasks[i].corr_sum[k];
+            count[tasks[i].symbol][k] += tasks[i].corr_count[k];
+        }
+    }
+    if (!any) return;
+
+    double corr[8][8];
+    for (int a = 0; a < 8; a++) {
+        for (int b = 0; b < 8; b++) {
+            corr[a][b] = count[a][b] ? sum[a][b] / count[a][b] : NAN;
+        }
+    }
+    for (int a = 0; a < 8; a++) {
+        for (int b = a + 1; b < 8; b++) {
+            double v = !isnan(corr[a][b]) && !isnan(corr[b][a]) ? 0.5 * (corr[a][b] + corr[b][a])
+                     : !isnan(corr[a][b]) ? corr[a][b] : corr[b][a];
+            corr[a][b] = corr[b][a] = v;
+        }
+        if (isnan(corr[a][a])) corr[a][a] = 1.0;
+    }
+
+    FILE* f = open_out(out_dir, "corr.csv");
+    if (!f) return;
+    fprintf(f, "symbol");
+    for (int s = 0; s < 8; s++) fprintf(f, ",%s", symbols[s]);
+    fprintf(f, "\n");
+    for (int a = 0; a < 8; a++) {
+        fprintf(f, "%s", symbols[a]);
+        for (int b = 0; b < 8; b++) fprintf(f, ",%.6f", isnan(corr[a][b]) ? 0.0 : corr[a][b]);
+        fprintf(f, "\n");
+    }
+    fclose(f);
+}
+
+static double percentile(const double* sorted, size_t n, double q) {
+    double pos = q * (double)(n - 1);
+    size_t lo = (size_t)pos;
+    size_t hi = lo + 1 < n ? lo + 1 : lo;
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - (double)lo);
+}
+
+static void write_timings(const char* out_dir) {
+    size_t total = 0;
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].kind == KIND_TIMING) total += tasks[i].rows.count;
+    }
+    if (total == 0) return;
+
+    double* durations = malloc(total * sizeof(double));
+    size_t n = 0;
+    double sum = 0.0;
+    FILE* f = open_out(out_dir, "timings.csv");
+    if (f) fprintf(f, "start,duration_ms\n");
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].kind != KIND_TIMING) continue;
+        Timing* rows = tasks[i].rows.data;
+        for (size_t k = 0; k < tasks[i].rows.count; k++) {
+            if (f) fprintf(f, "%s,%.3f\n", rows[k].start, rows[k].duration_ms);
+            durations[n++] = rows[k].duration_ms;
+            sum += rows[k].duration_ms;
+        }
+    }
+    if (f) fclose(f);
+
+    qsort(durations, n, sizeof(double), cmp_double);
+    f = open_out(out_dir, "timings_summary.csv");
+    if (f) {
+        fprintf(f, "count,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n");
+        fprintf(f, "%zu,%.3f,%.3f,%.3f,%.3f,%.3f\n", n, sum / n, percentile(durations, n, 0.50),
+            percentile(durations, n, 0.90), percentile(durations, n, 0.99), durations[n - 1]);
+        fclose(f);
+    }
+    free(durations);
+}
+
+static void write_cpu_idle(const char* out_dir) {
+    uint64_t bins[IDLE_BINS] = {0};
+    uint64_t n = 0;
+    double sum = 0.0;
+    for (int i = 0; i < task_count; i++) {
+        if (tasks[i].kind != KIND_CPU) continue;
+        Point* pts = tasks[i].rows.data;
+        for (size_t k = 0; k < tasks[i].rows.count; k++) {
+            int b = (int)(pts[k].value / (100.0 / IDLE_BINS));
+            bins[b < 0 ? 0 : b >= IDLE_BINS ? IDLE_BINS - 1 : b]++;
+            sum += pts[k].value;
+            n++;
+        }
+    }
+    if (n == 0) return;
+
+    FILE* f = open_out(out_dir, "cpu_idle_hist.csv");
+    if (!f) return;
+    fprintf(f, "bin_lo,bin_hi,count\n");
+    for (int b = 0; b < IDLE_BINS; b++) {
+        fprintf(f, "%.1f,%.1f,%llu\n", b * 100.0 / IDLE_BINS, (b + 1) * 100.0 / IDLE_BINS, (unsigned long long)bins[b]);
+    }
+    fclose(f);
+
+    f = open_out(out_dir, "cpu_idle_summary.csv");
+    if (f) {
+        fprintf(f, "count,mean_pct\n%llu,%.4f\n", (unsigned long long)n, sum / n);
+        fclose(f);
+    }
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-d project_dir] [-o out_dir] [-j threads] [-T store_dir]\n"
+                    "  -T DIR   series store, relative to the project directory (\"\" = text logs only, default " TSDB_DIR ")\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = ".";
+    const char* out_dir = "results/analysis";
+    const char* store_dir = TSDB_DIR;
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "d:o:j:T:h")) != -1) {
+        switch (opt) {
+            case 'd': dir = optarg; break;
+            case 'o': out_dir = optarg; break;
+            case 'j': threads = atol(optarg); break;
+            case 'T': store_dir = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (threads < 1) threads = 1;
+    mkdir(out_dir, 0755);
+
+    // Enough chunks to keep every thread busy even when one file dominates
+    const size_t chunk_size = 8u << 20;
+    char path[512], store[512], name[64];
+    snprintf(store, sizeof(store), "%s/%s", dir, store_dir);
+    int use_store = store_dir[0] != '\0';
+    long from_store = 0;
+    for (int s = 0; s < 8; s++) {
+        long n = 0;
+        if (use_store) {
+            snprintf(name, sizeof(name), "mavg.%s", symbols[s]);
+            n = load_series(store, name, KIND_MAVG, s);
+        }
+        if (n == 0) {
+            snprintf(path, sizeof(path), "%s/" MAVG_DIR "/%s.log", dir, symbols[s]);
+            add_file(path, KIND_MAVG, s, chunk_size);
+        }
+        from_store += n;
+    }
+    long corr_points = 0;
+    for (int s = 0; s < 8 && use_store; s++) {
+        corr_points += load_corr_pairs(store, s);
+    }
+    for (int s = 0; s < 8 && corr_points == 0; s++) {
+        snprintf(path, sizeof(path), "%s/" CORR_DIR "/%s.log", dir, symbols[s]);
+        add_file(path, KIND_CORR, s, chunk_size);
+    }
+    from_store += corr_points;
+    long n = use_store ? load_series(store, "tick_ms", KIND_TIMING, -1) : 0;
+    if (n == 0) {
+        snprintf(path, sizeof(path), "%s/" TIMINGS_LOG, dir);
+        add_file(path, KIND_TIMING, -1, chunk_size);
+    }
+    from_store += n;
+    n = use_store ? load_series(store, "cpu_idle", KIND_CPU, -1) : 0;
+    if (n == 0) {
+        snprintf(path, sizeof(path), "%s/" CPU_IDLE_LOG, dir);
+        add_file(path, KIND_CPU, -1, chunk_size);
+    }
+    from_store += n;
+
+    pthread_t* pool = malloc((size_t)threads * sizeof(pthread_t));
+    for (long t = 0; t < threads; t++) pthread_create(&pool[t], NULL, worker, NULL);
+    for (long t = 0; t < threads; t++) pthread_join(pool[t], NULL);
+    free(pool);
+
+    write_mavg(out_dir);
+    write_corr(out_dir);
+    write_timings(out_dir);
+    write_cpu_idle(out_dir);
+
+    for (int i = 0; i < task_count; i++) free(tasks[i].rows.data);
+    for (int m = 0; m < mapping_count; m++) munmap(mappings[m].base, mappings[m].len);
+    printf("Analyzed %d chunks with %ld threads and %ld points from the store into %s\n",
+           task_count, threads, from_store, out_dir);
+    return 0;
+}
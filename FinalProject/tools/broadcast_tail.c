@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../src/broadcast/broadcast.h"
+
+// Example consumer of the shared-memory broadcast: prints trades and minute results as they are
+// published, or only per-second counts with -s, and reports records lost to overruns
+
+static volatile sig_atomic_t stop = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void print_minute(const BroadcastReader* r, const BroadcastMinute* m) {
+    const char* sym = m->symbol < 8 ? r->header->symbols[m->symbol] : "?";
+    switch (m->kind) {
+        case BROADCAST_AVERAGE:
+            printf("MAVG  %llu %-10s ma=%.8f vwap=%.8f trades=%llu\n", (unsigned long long)m->minute, sym,
+                   m->ma, m->vwap, (unsigned long long)m->trades);
+            break;
+        case BROADCAST_CORRELATION:
+            printf("CORR  %llu %-10s", (unsigned long long)m->minute, sym);
+            for (int k = 0; k < 8; k++) {
+                printf(" %.4f", m->corr[k]);
+            }
+            printf("\n");
+            break;
+        case BROADCAST_MINUTE_DONE:
+            printf("DONE  %llu\n", (unsigned long long)m->minute);
+            break;
+    }
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-p name] [-o] [-s]\n"
+                    "  -p NAME  broadcast region (default " BROADCAST_NAME ")\n"
+                    "  -o       start from the oldest record still in the rings instead of the newest\n"
+                    "  -s       print per-second counts instead of every record\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    const char* name = BROADCAST_NAME;
+    int from_oldest = 0, stats = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:osh")) != -1) {
+        switch (opt) {
+            case 'p': name = optarg; break;
+            case 'o': from_oldest = 1; break;
+            case 's': stats = 1; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    BroadcastReader r;
+    if (broadcast_reader_open(&r, name, from_oldest) != 0) {
+        fprintf(stderr, "No broadcast region at /dev/shm%s, is the pipeline running with -p?\n", name);
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    uint64_t trades = 0, minutes = 0, idle = 0;
+    uint64_t next_report = now_ns() + 1000000000ull;
+    while (!stop) {
+        int got = 0;
+        BroadcastTrade t;
+        BroadcastRead res;
+        while ((res = broadcast_read_trade(&r, &t)) != BROADCAST_READ_EMPTY) {
+            if (res == BROADCAST_READ_RESTARTED) {
+                fprintf(stderr, "Writer restarted, following the new stream\n");
+                continue;
+            }
+            if (res != BROADCAST_READ_OK) {
+                continue;
+            }
+            trades++;
+            got = 1;
+            if (!stats) {
+                printf("TRADE %llu %-10s id=%llu px=%.8f sz=%.8f\n", (unsigned long long)t.timestamp,
+                       t.symbol < 8 ? r.header->symbols[t.symbol] : "?", (unsigned long long)t.trade_id,
+                       t.price, t.volume);
+            }
+        }
+        BroadcastMinute m;
+        while ((res = broadcast_read_minute(&r, &m)) != BROADCAST_READ_EMPTY) {
+            if (res != BROADCAST_READ_OK) {
+                continue;
+            }
+            minutes++;
+            got = 1;
+            if (!stats) {
+                print_minute(&r, &m);
+            }
+        }
+        if (!stats && got) {
+            fflush(stdout);
+        }
+
+        uint64_t now = now_ns();
+        if (stats && now >= next_report) {
+            printf("trades=%llu minute_records=%llu trades_lost=%llu minutes_lost=%llu writer=%s\n",
+                   (unsigned long long)trades, (unsigned long long)minutes,
+                   (unsigned long long)r.trades_lost, (unsigned long long)r.minutes_lost,
+                   atomic_load(&r.header->writer_active) ? "up" : "down");
+            fflush(stdout);
+            trades = minutes = 0;
+            next_report = now + 1000000000ull;
+        }
+
+        // Spin briefly after traffic, then back off to a short sleep
+        if (got) {
+            idle = 0;
+        } else if (++idle > 1000) {
+            struct timespec ts = {0, 200000};
+            nanosleep(&ts, NULL);
+        }
+    }
+
+    if (r.trades_lost || r.minutes_lost) {
+        fprintf(stderr, "Lost %llu trades and %llu minute records to overruns\n",
+                (unsigned long long)r.trades_lost, (unsigned long long)r.minutes_lost);
+    }
+    broadcast_reader_close(&r);
+    return 0;
+}
@@ -0,0 +1,484 @@
+#include <libwebsockets.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "../src/utils/records.h"
+
+// Local stand-in for the OKX public websocket. Every subscribed session receives the
+// same synthetic trades stream, with optional per-session drops and duplicates so gap
+// detection and dual-feed deduplication can be exercised offline. With -R the stream is
+// instead replayed from a previous run's transaction logs at their original pacing, so the
+// threaded and event-loop runtimes can be compared on identical input. With -B a 25 level
+// order book per symbol is published on the "books" channel, snapshot on subscribe and then
+// checksummed incremental updates, the same way OKX does. With -z permessage-deflate is
+// accepted when the client offers it, for measuring the client's compressed path.
+
+#define RING_SIZE 8192
+#define MSG_MAX 4096
+#define SIM_BOOK_LEVELS 25
+#define SIZE_DECIMALS 4
+
+typedef struct {
+    uint64_t cursor;
+    bool subscribed;
+    uint64_t book_from[8];          // First ring position this session takes book updates from
+    unsigned int snapshot_mask;     // Symbols still owed a book snapshot
+    unsigned char snapshot[LWS_PRE + MSG_MAX];
+} Session;
+
+// Prices in ticks of 10^-tick_decimals, sizes in 10^-SIZE_DECIMALS lots, best level first
+typedef struct {
+    int64_t px;
+    int64_t sz;
+} SimLevel;
+
+typedef struct {
+    SimLevel bids[SIM_BOOK_LEVELS];
+    SimLevel asks[SIM_BOOK_LEVELS];
+    int64_t seq_id;
+} SimBook;
+
+static const char* symbols[8] = SYMBOL_NAMES;
+static volatile sig_atomic_t stop = 0;
+
+static int port = 9443;
+static int rate = 200;              // Messages per second
+static int batch = 1;               // Trades per message
+static double drop_prob = 0.0;
+static double dup_prob = 0.0;
+
+static unsigned char* ring[RING_SIZE];
+static size_t ring_len[RING_SIZE];
+static int ring_book[RING_SIZE];    // Symbol of a book message, -1 for trades
+static uint64_t produced = 0;
+
+static bool books = false;
+static bool deflate = false;
+
+// Compresses every message the way the exchange does once a client offers the extension
+static const struct lws_extension deflate_extensions[] = {
+    {"permessage-deflate", lws_extension_callback_pm_deflate, "permessage-deflate"},
+    {NULL, NULL, NULL}
+};
+static SimBook sim_books[8];
+static const int tick_decimals[8] = {1, 4, 2, 5, 4, 2, 2, 1};
+
+// Replay input, merged across symbols in timestamp order
+typedef struct {
+    uint64_t ts;
+    int symbol;
+    double price;
+    double volume;
+} ReplayTrade;
+
+static ReplayTrade* replay = NULL;
+static size_t replay_count = 0;
+static size_t replay_next = 0;
+static double replay_speed = 1.0;
+
+static uint64_t trade_ids[8];
+static double prices[8] = {64000.0, 0.45, 3400.0, 0.15, 0.52, 145.0, 82.0, 590.0};
+
+static uint64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static double uniform(void) {
+    return rand() / (RAND_MAX + 1.0);
+}
+
+static size_t append_trade(char* msg, size_t len, int first, int s, double px, double sz, uint64_t ts) {
+    return (size_t)snprintf(msg + len, MSG_MAX - len,
+        "%s{\"instId\":\"%s\",\"tradeId\":\"%llu\",\"px\":\"%.8g\",\"sz\":\"%.8f\",\"side\":\"%s\",\"ts\":\"%llu\",\"count\":\"1\"}",
+        first ? "" : ",", symbols[s], (unsigned long long)++trade_ids[s], px, sz,
+        uniform() < 0.5 ? "buy" : "sell", (unsigned long long)ts);
+}
+
+// Same layout as an OKX v5 trades push, one instrument per message
+static void produce(int s) {
+    unsigned char* slot = ring[produced % RING_SIZE];
+    char* msg = (char*)&slot[LWS_PRE];
+    uint64_t ts = wall_ms();
+
+    size_t len = (size_t)snprintf(msg, MSG_MAX, "{\"arg\":{\"channel\":\"trades\",\"instId\":\"%s\"},\"data\":[", symbols[s]);
+    for (int t = 0; t < batch && len < MSG_MAX - 256; t++) {
+        prices[s] *= 1.0 + (uniform() - 0.5) * 1e-4;
+        len = append_trade(msg, len, t == 0, s, prices[s], uniform(), ts);
+    }
+    len += (size_t)snprintf(msg + len, MSG_MAX - len, "]}");
+    ring_len[produced % RING_SIZE] = len;
+    ring_book[produced % RING_SIZE] = -1;
+    produced++;
+}
+
+// One recorded trade per message, timestamps shifted so the run starts now
+static void produce_replay(const ReplayTrade* trade, uint64_t shift) {
+    unsigned char* slot = ring[produced % RING_SIZE];
+    char* msg = (char*)&slot[LWS_PRE];
+
+    size_t len = (size_t)snprintf(msg, MSG_MAX, "{\"arg\":{\"channel\":\"trades\",\"instId\":\"%s\"},\"data\":[", symbols[trade->symbol]);
+    len = append_trade(msg, len, 1, trade->symbol, trade->price, trade->volume, trade->ts + shift);
+    len += (size_t)snprintf(msg + len, MSG_MAX - len, "]}");
+    ring_len[produced % RING_SIZE] = len;
+    ring_book[produced % RING_SIZE] = -1;
+    produced++;
+}
+
+static int format_units(char* buf, int64_t v, int decimals) {
+    int64_t scale = 1;
+    for (int d = 0; d < decimals; d++) scale *= 10;
+    if (decimals == 0) {
+        return sprintf(buf, "%lld", (long long)v);
+    }
+    return sprintf(buf, "%lld.%0*lld", (long long)(v / scale), decimals, (long long)(v % scale));
+}
+
+// Bitwise CRC32, kept independent of the client's table-driven one
+static int32_t crc32_signed(const char* s, size_t len) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint8_t)s[i];
+        for (int k = 0; k < 8; k++) {
+            crc = crc & 1 ? 0xEDB88320u ^ (crc >> 1) : crc >> 1;
+        }
+    }
+    return (int32_t)(crc ^ 0xFFFFFFFFu);
+}
+
+static int32_t book_checksum(int s) {
+    char buf[SIM_BOOK_LEVELS * 2 * 64];
+    size_t len = 0;
+    for (int i = 0; i < SIM_BOOK_LEVELS; i++) {
+        const SimLevel* levels[2] = {&sim_books[s].bids[i], &sim_books[s].asks[i]};
+        for (int k = 0; k < 2; k++) {
+            len += (size_t)format_units(buf + len, levels[k]->px, tick_decimals[s]);
+            buf[len++] = ':';
+            len += (size_t)format_units(buf + len, levels[k]->sz, SIZE_DECIMALS);
+            buf[len++] = ':';
+        }
+    }
+    return crc32_signed(buf, len - 1);
+}
+
+static size_t append_level(char* msg, size_t len, int first, int s, const SimLevel* level) {
+    char px[32], sz[32];
+    format_units(px, level->px, tick_decimals[s]);
+    format_units(sz, level->sz, SIZE_DECIMALS);
+    return len + (size_t)snprintf(msg + len, MSG_MAX - len, "%s[\"%s\",\"%s\",\"0\",\"1\"]", first ? "" : ",", px, sz);
+}
+
+// Snapshot carries every level, an update only the levels given
+static size_t render_book(char* msg, int s, const SimLevel* bids, int bid_count, const SimLevel* asks, int ask_count, int64_t prev_seq) {
+    size_t len = (size_t)snprintf(msg, MSG_MAX, "{\"arg\":{\"channel\":\"books\",\"instId\":\"%s\"},\"action\":\"%s\",\"data\":[{\"asks\":[",
+                                  symbols[s], prev_seq < 0 ? "snapshot" : "update");
+    for (int i = 0; i < ask_count; i++) len = append_level(msg, len, i == 0, s, &asks[i]);
+    len += (size_t)snprintf(msg + len, MSG_MAX - len, "],\"bids\":[");
+    for (int i = 0; i < bid_count; i++) len = append_level(msg, len, i == 0, s, &bids[i]);
+    len += (size_t)snprintf(msg + len, MSG_MAX - len, "],\"ts\":\"%llu\",\"checksum\":%d,\"prevSeqId\":%lld,\"seqId\":%lld}]}",
+                            (unsigned long long)wall_ms(), book_checksum(s), (long long)prev_seq, (long long)sim_books[s].seq_id);
+    return len;
+}
+
+static void init_books(void) {
+    for (int s = 0; s < 8; s++) {
+        int64_t scale = 1;
+        for (int d = 0; d < tick_decimals[s]; d++) scale *= 10;
+        int64_t mid = (int64_t)(prices[s] * scale);
+        for (int i = 0; i < SIM_BOOK_LEVELS; i++) {
+            sim_books[s].bids[i] = (SimLevel){mid - 1 - i, 1 + rand() % 100000};
+            sim_books[s].asks[i] = (SimLevel){mid + 1 + i, 1 + rand() % 100000};
+        }
+        sim_books[s].seq_id = 1000;
+    }
+}
+
+// One random change: resize a level, pull one and refill at the back, or improve the best price
+static void produce_book(int s) {
+    SimBook* b = &sim_books[s];
+    int ask = rand() & 1;
+    SimLevel* levels = ask ? b->asks : b->bids;
+    int64_t step = ask ? 1 : -1;
+    SimLevel changed[2];
+    int count = 0;
+    double op = uniform();
+
+    if (op < 0.2 && b->asks[0].px - b->bids[0].px > 2) {
+        changed[count++] = (SimLevel){levels[SIM_BOOK_LEVELS - 1].px, 0};
+        memmove(&levels[1], &levels[0], (SIM_BOOK_LEVELS - 1) * sizeof(SimLevel));
+        levels[0] = (SimLevel){levels[1].px - step, 1 + rand() % 100000};
+        changed[count++] = levels[0];
+    } else if (op < 0.4) {
+        int i = rand() % SIM_BOOK_LEVELS;
+        changed[count++] = (SimLevel){levels[i].px, 0};
+        memmove(&levels[i], &levels[i + 1], (size_t)(SIM_BOOK_LEVELS - 1 - i) * sizeof(SimLevel));
+        levels[SIM_BOOK_LEVELS - 1] = (SimLevel){levels[SIM_BOOK_LEVELS - 2].px + step, 1 + rand() % 100000};
+        changed[count++] = levels[SIM_BOOK_LEVELS - 1];
+    } else {
+        int i = rand() % SIM_BOOK_LEVELS;
+        levels[i].sz = 1 + rand() % 100000;
+        changed[count++] = levels[i];
+    }
+
+    int64_t prev = b->seq_id++;
+    unsigned char* slot = ring[produced % RING_SIZE];
+    ring_len[produced % RING_SIZE] = ask ? render_book((char*)&slot[LWS_PRE], s, NULL, 0, changed, count, prev)
+                                         : render_book((char*)&slot[LWS_PRE], s, changed, count, NULL, 0, prev);
+    ring_book[produced % RING_SIZE] = s;
+    produced++;
+}
+
+static int compare_replay(const void* a, const void* b) {
+    const ReplayTrade* x = a;
+    const ReplayTrade* y = b;
+    if (x->ts != y->ts) return x->ts < y->ts ? -1 : 1;
+    return x->symbol - y->symbol;
+}
+
+// Reads <dir>/<symbol>.log for every symbol, skipping files that do not exist
+static int load_replay(const char* dir) {
+    size_t capacity = 0;
+    for (int s = 0; s < 8; s++) {
+        char path[512];
+        snprintf(path, sizeof(path), "%s/%s.log", dir, symbols[s]);
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            continue;
+        }
+
+        char line[256];
+        while (fgets(line, sizeof(line), file)) {
+            unsigned long long ts;
+            double px, sz;
+            if (sscanf(line, TRADE_SCAN_FMT, &ts, &px, &sz) != 3) {
+                continue;
+            }
+            if (replay_count == capacity) {
+                capacity = capacity ? capacity * 2 : 65536;
+                ReplayTrade* grown = realloc(replay, capacity * sizeof(ReplayTrade));
+                if (!grown) {
+                    fclose(file);
+                    return -1;
+                }
+                replay = grown;
+            }
+            replay[replay_count++] = (ReplayTrade){ts, s, px, sz};
+        }
+        fclose(file);
+    }
+
+    qsort(replay, replay_count, sizeof(ReplayTrade), compare_replay);
+    return replay_count ? 0 : -1;
+}
+
+static int feed_callback(struct lws* wsi, enum lws_callback_reasons reason, void* user, void* in, size_t len) {
+    Session* session = (Session*)user;
+
+    switch (reason) {
+        case LWS_CALLBACK_ESTABLISHED:
+            session->cursor = produced;
+            session->subscribed = false;
+            session->snapshot_mask = 0;
+            for (int s = 0; s < 8; s++) {
+                session->book_from[s] = UINT64_MAX;
+            }
+            break;
+
+        // Book requests are matched loosely: every symbol named in a message mentioning "books"
+        case LWS_CALLBACK_RECEIVE: {
+            bool sub = memmem(in, len, "\"op\":\"subscribe\"", 16) != NULL;
+            bool unsub = memmem(in, len, "\"op\":\"unsubscribe\"", 18) != NULL;
+            session->subscribed |= sub;
+            if (books && memmem(in, len, "\"books\"", 7)) {
+                for (int s = 0; s < 8; s++) {
+                    if (!memmem(in, len, symbols[s], strlen(symbols[s]))) continue;
+                    if (sub) session->snapshot_mask |= 1u << s;
+                    if (unsub) session->book_from[s] = UINT64_MAX;
+                }
+                lws_callback_on_writable(wsi);
+            }
+            break;
+        }
+
+        case LWS_CALLBACK_SERVER_WRITEABLE:
+            // Snapshots are rendered from the current book, so updates already in the ring are skipped
+            if (session->snapshot_mask) {
+                int s = __builtin_ctz(session->snapshot_mask);
+                session->snapshot_mask &= ~(1u << s);
+                session->book_from[s] = produced;
+                size_t n = render_book((char*)&session->snapshot[LWS_PRE], s, sim_books[s].bids, SIM_BOOK_LEVELS,
+                                       sim_books[s].asks, SIM_BOOK_LEVELS, -1);
+                if (lws_write(wsi, &session->snapshot[LWS_PRE], n, LWS_WRITE_TEXT) < (int)n) {
+                    return -1;
+                }
+                lws_callback_on_writable(wsi);
+                break;
+            }
+            if (!session->subscribed || session->cursor == produced) {
+                break;
+            }
+            if (produced - session->cursor > RING_SIZE) {
+                session->cursor = produced - RING_SIZE;   // Slow reader, skip what was overwritten
+            }
+
+            // Simulated loss on this session only, and book updates it has not asked for
+            while (session->cursor < produced && (uniform() < drop_prob ||
+                   (ring_book[session->cursor % RING_SIZE] >= 0 &&
+                    session->cursor < session->book_from[ring_book[session->cursor % RING_SIZE]]))) {
+                session->cursor++;
+            }
+            if (session->cursor < produced) {
+                uint64_t idx = session->cursor % RING_SIZE;
+                if (lws_write(wsi, &ring[idx][LWS_PRE], ring_len[idx], LWS_WRITE_TEXT) < (int)ring_len[idx]) {
+                    return -1;
+                }
+                if (uniform() >= dup_prob) {
+                    session->cursor++;
+                }
+            }
+            if (session->cursor < produced) {
+                lws_callback_on_writable(wsi);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static struct lws_protocols protocols[] = {
+    {
+        .name = "okx-protocol",
+        .callback = feed_callback,
+        .per_session_data_size = sizeof(Session),
+        .rx_buffer_size = 4096,
+        .id = 0,
+        .user = NULL,
+        .tx_packet_size = 0
+    },
+    { NULL, NULL, 0, 0, 0, NULL, 0 }
+};
+
+static void sigint_handler(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-p port] [-r msgs_per_sec] [-b trades_per_msg] [-l drop_prob] [-D dup_prob] [-s seed]\n"
+                    "          [-R transactions_dir] [-x speed] [-B] [-z]\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    unsigned int seed = 1;
+    const char* replay_dir = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:r:b:l:D:s:R:x:Bzh")) != -1) {
+        switch (opt) {
+            case 'p': port = atoi(optarg); break;
+            case 'r': rate = atoi(optarg); break;
+            case 'b': batch = atoi(optarg); break;
+            case 'l': drop_prob = atof(optarg); break;
+            case 'D': dup_prob = atof(optarg); break;
+            case 's': seed = (unsigned int)strtoul(optarg, NULL, 10); break;
+            case 'R': replay_dir = optarg; break;
+            case 'x': replay_speed = atof(optarg); break;
+            case 'B': books = true; break;
+            case 'z': deflate = true; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (rate < 1 || batch < 1 || replay_speed <= 0.0) {
+        usage(argv[0]);
+        return 1;
+    }
+    srand(seed);
+    if (replay_dir && load_replay(replay_dir) != 0) {
+        fprintf(stderr, "No trades to replay in %s\n", replay_dir);
+        return 1;
+    }
+    signal(SIGINT, sigint_handler);
+
+    for (int i = 0; i < RING_SIZE; i++) {
+        ring[i] = malloc(LWS_PRE + MSG_MAX);
+    }
+    for (int s = 0; s < 8; s++) {
+        trade_ids[s] = 100000000ull * (s + 1);
+    }
+    init_books();
+
+    struct lws_context_creation_info info;
+    memset(&info, 0, sizeof(info));
+    info.port = port;
+    info.iface = "127.0.0.1";
+    info.protocols = protocols;
+    info.extensions = deflate ? deflate_extensions : NULL;
+    struct lws_context* context = lws_create_context(&info);
+    if (!context) {
+        fprintf(stderr, "Failed to create server context\n");
+        return 1;
+    }
+    if (replay) {
+        printf("Feed simulator on ws://127.0.0.1:%d/ws/v5/public, replaying %zu trades at %.2fx\n", port, replay_count, replay_speed);
+    } else {
+        printf("Feed simulator on ws://127.0.0.1:%d/ws/v5/public, %d msgs/s\n", port, rate);
+    }
+
+    // Messages are produced on a fixed schedule and pushed to every session that can take them
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t shift = replay ? wall_ms() - replay[0].ts : 0;
+    uint64_t ticks = 0;
+    while (!stop) {
+        lws_service(context, 1);
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+        uint64_t before = produced;
+        if (replay) {
+            // Recorded gaps are scaled by the speed factor, the shifted timestamps are not
+            uint64_t due_ts = replay[0].ts + (uint64_t)(elapsed * 1000.0 * replay_speed);
+            while (replay_next < replay_count && replay[replay_next].ts <= due_ts && produced - before < RING_SIZE / 2) {
+                if (books) {
+                    produce_book(replay[replay_next].symbol);
+                }
+                produce_replay(&replay[replay_next++], shift);
+            }
+            if (replay_next == replay_count && produced == before) {
+                printf("Replay finished, %zu trades sent\n", replay_count);
+                replay_next++;
+            }
+        } else {
+            // Each tick is one trades message, followed by one book update when -B is on
+            uint64_t due = (uint64_t)(elapsed * rate);
+            for (; ticks < due && produced - before < RING_SIZE / 2; ticks++) {
+                produce((int)(ticks % 8));
+                if (books) {
+                    produce_book((int)(ticks % 8));
+                }
+            }
+        }
+        if (produced > before) {
+            lws_callback_on_writable_all_protocol(context, &protocols[0]);
+        }
+    }
+
+    lws_context_destroy(context);
+    for (int i = 0; i < RING_SIZE; i++) {
+        free(ring[i]);
+    }
+    free(replay);
+    return 0;
+}
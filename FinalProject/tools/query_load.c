@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "../src/query/query.h"
+
+// Load generator for the query API: client threads issue a mix of queries back to back (or at a
+// fixed rate) and the per-type latency percentiles are printed at the end. Run it next to a
+// pipeline ingesting a feedsim replay to see query latency under live ingest.
+
+#define TYPES 4
+
+static const char* type_names[TYPES] = {"averages", "correlation", "last_trades", "trade_range"};
+
+typedef struct {
+    uint64_t* samples;
+    size_t count;
+    size_t capacity;
+} Samples;
+
+typedef struct {
+    int id;
+    Samples lat[TYPES];
+    uint64_t errors;
+    uint64_t not_ready;
+    uint64_t records;
+} Client;
+
+static const char* socket_path = QUERY_SOCKET_PATH;
+static int duration_s = 10;
+static uint32_t last_n = 100;
+static unsigned int rate = 0;        // Queries per second per client, 0 = closed loop
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t wall_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void add_sample(Samples* s, uint64_t v) {
+    if (s->count == s->capacity) {
+        s->capacity = s->capacity ? s->capacity * 2 : 4096;
+        s->samples = realloc(s->samples, s->capacity * sizeof(uint64_t));
+    }
+    s->samples[s->count++] = v;
+}
+
+static int full_io(int fd, void* buf, size_t len, int writing) {
+    char* p = buf;
+    while (len) {
+        ssize_t n = writing ? send(fd, p, len, MSG_NOSIGNAL) : recv(fd, p, len, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static size_t record_size(uint16_t type) {
+    switch (type) {
+        case QUERY_AVERAGES:    return sizeof(QueryAverage);
+        case QUERY_CORRELATION: return sizeof(QueryCorrelationRow);
+        default:                return sizeof(QueryTrade);
+    }
+}
+
+static void* client_func(void* arg) {
+    Client* c = arg;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        c->errors++;
+        return NULL;
+    }
+
+    size_t buf_cap = sizeof(QueryTrade) * QUERY_RECENT_TRADES;
+    char* buf = malloc(buf_cap);
+    unsigned int seed = (unsigned int)c->id * 2654435761u + 1;
+    uint64_t start = now_ns();
+    uint64_t end = start + (uint64_t)duration_s * 1000000000ull;
+    uint64_t interval = rate ? 1000000000ull / rate : 0;
+    uint64_t next = start;
+
+    for (uint64_t i = 0; ; i++) {
+        uint64_t t0 = now_ns();
+        if (t0 >= end) {
+            break;
+        }
+        if (interval) {
+            if (t0 < next) {
+                struct timespec ts = {0, (long)(next - t0)};
+                nanosleep(&ts, NULL);
+            }
+            next += interval;
+        }
+
+        int type = (int)((i + (uint64_t)c->id) % TYPES);
+        uint16_t symbol = (uint16_t)(rand_r(&seed) % 8);
+        QueryRequest req = {.type = (uint16_t)(type + QUERY_AVERAGES), .symbol = symbol};
+        if (req.type == QUERY_AVERAGES || req.type == QUERY_CORRELATION) {
+            req.symbol = (rand_r(&seed) & 1) ? QUERY_ALL_SYMBOLS : symbol;
+        } else if (req.type == QUERY_LAST_TRADES) {
+            req.count = last_n;
+        } else {
+            req.to_ms = wall_ms();
+            req.from_ms = req.to_ms - 10000;
+        }
+
+        t0 = now_ns();
+        QueryResponse resp;
+        if (full_io(fd, &req, sizeof(req), 1) < 0 || full_io(fd, &resp, sizeof(resp), 0) < 0) {
+            c->errors++;
+            break;
+        }
+        size_t body = (size_t)resp.count * record_size(resp.type);
+        if (body > buf_cap || full_io(fd, buf, body, 0) < 0) {
+            c->errors++;
+            break;
+        }
+        add_sample(&c->lat[type], now_ns() - t0);
+
+        if (resp.status == QUERY_NOT_READY) {
+            c->not_ready++;
+        } else if (resp.status != QUERY_OK && resp.status != QUERY_TRUNCATED) {
+            c->errors++;
+        }
+        c->records += resp.count;
+    }
+
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile_us(const Samples* s, double p) {
+    if (s->count == 0) return 0.0;
+    size_t idx = (size_t)(p * (double)(s->count - 1));
+    return s->samples[idx] / 1000.0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-s socket] [-c clients] [-d seconds] [-n trades] [-r rate]\n"
+                    "  -s PATH  query socket (default " QUERY_SOCKET_PATH ")\n"
+                    "  -c N     concurrent client connections (default 4)\n"
+                    "  -d S     test duration in seconds (default 10)\n"
+                    "  -n N     trades requested by last-trades queries (default 100)\n"
+                    "  -r R     queries per second per client, 0 = back to back (default 0)\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    int client_count = 4;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:c:d:n:r:h")) != -1) {
+        switch (opt) {
+            case 's': socket_path = optarg; break;
+            case 'c': client_count = atoi(optarg); break;
+            case 'd': duration_s = atoi(optarg); break;
+            case 'n': last_n = (uint32_t)strtoul(optarg, NULL, 10); break;
+            case 'r': rate = (unsigned int)strtoul(optarg, NULL, 10); break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (client_count < 1 || duration_s < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    Client* clients = calloc((size_t)client_count, sizeof(Client));
+    pthread_t* threads = malloc((size_t)client_count * sizeof(pthread_t));
+    for (int i = 0; i < client_count; i++) {
+        clients[i].id = i;
+        pthread_create(&threads[i], NULL, client_func, &clients[i]);
+    }
+    for (int i = 0; i < client_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Merge the per-client samples by query type
+    Samples merged[TYPES] = {0};
+    uint64_t errors = 0, not_ready = 0, records = 0, total = 0;
+    for (int i = 0; i < client_count; i++) {
+        for (int t = 0; t < TYPES; t++) {
+            for (size_t k = 0; k < clients[i].lat[t].count; k++) {
+                add_sample(&merged[t], clients[i].lat[t].samples[k]);
+            }
+            free(clients[i].lat[t].samples);
+        }
+        errors += clients[i].errors;
+        not_ready += clients[i].not_ready;
+        records += clients[i].records;
+    }
+
+    printf("%-12s %10s %10s %10s %10s %10s\n", "query", "count", "p50_us", "p99_us", "p999_us", "max_us");
+    for (int t = 0; t < TYPES; t++) {
+        qsort(merged[t].samples, merged[t].count, sizeof(uint64_t), compare_u64);
+        printf("%-12s %10zu %10.2f %10.2f %10.2f %10.2f\n", type_names[t], merged[t].count,
+               percentile_us(&merged[t], 0.50), percentile_us(&merged[t], 0.99),
+               percentile_us(&merged[t], 0.999), percentile_us(&merged[t], 1.0));
+        total += merged[t].count;
+        free(merged[t].samples);
+    }
+    printf("%llu queries in %d s (%.0f/s) over %d clients, %llu records, %llu not ready, %llu errors\n",
+           (unsigned long long)total, duration_s, (double)total / duration_s, client_count,
+           (unsigned long long)records, (unsigned long long)not_ready, (unsigned long long)errors);
+
+    free(clients);
+    free(threads);
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,101 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "../src/tsdb/tsdb.h"
+#include "../src/utils/records.h"
+
+// Range export from the compressed series store as CSV, or the list of stored series with -l
+
+typedef struct {
+    const char* name;
+    TsdbResolution res;
+} ExportCtx;
+
+static int print_point(const TsdbPoint* p, void* ctx) {
+    const ExportCtx* e = ctx;
+    if (e->res == TSDB_RAW) {
+        printf("%s,%lld,%.10g\n", e->name, (long long)p->ts, p->value[0]);
+    } else {
+        printf("%s,%lld,%.10g,%.10g,%.10g,%.0f\n", e->name, (long long)p->ts, p->value[0], p->value[1],
+               p->value[2], p->value[3]);
+    }
+    return 0;
+}
+
+static int list_series(const char* dir, TsdbResolution res) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, tsdb_resolution_name(res));
+    DIR* d = opendir(path);
+    if (!d) {
+        perror(path);
+        return 1;
+    }
+    struct dirent* ent;
+    while ((ent = readdir(d)) != NULL) {
+        size_t len = strlen(ent->d_name);
+        if (len > 4 && strcmp(ent->d_name + len - 4, ".tsb") == 0) {
+            printf("%.*s\n", (int)(len - 4), ent->d_name);
+        }
+    }
+    closedir(d);
+    return 0;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [-d dir] [-r 1m|1h|1d] [-f from] [-t to] [-l] series...\n"
+                    "  -d DIR   store directory (default " TSDB_DIR ")\n"
+                    "  -r RES   resolution: raw minutes, or hour and day rollups (default 1m)\n"
+                    "  -f S     first unix second to export (default all)\n"
+                    "  -t S     last unix second to export (default all)\n"
+                    "  -l       list the series stored at the resolution\n", prog);
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = TSDB_DIR;
+    TsdbResolution res = TSDB_RAW;
+    int64_t from = INT64_MIN, to = INT64_MAX;
+    int list = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "d:r:f:t:lh")) != -1) {
+        switch (opt) {
+            case 'd': dir = optarg; break;
+            case 'r':
+                for (res = 0; res < TSDB_RESOLUTIONS; res++) {
+                    if (strcmp(optarg, tsdb_resolution_name(res)) == 0) break;
+                }
+                if (res == TSDB_RESOLUTIONS) {
+                    fprintf(stderr, "Unknown resolution: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'f': from = strtoll(optarg, NULL, 10); break;
+            case 't': to = strtoll(optarg, NULL, 10); break;
+            case 'l': list = 1; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (list) {
+        return list_series(dir, res);
+    }
+    if (optind == argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    printf(res == TSDB_RAW ? "series,ts,value\n" : "series,ts,min,max,mean,count\n");
+    int status = 0;
+    for (int i = optind; i < argc; i++) {
+        ExportCtx ctx = {argv[i], res};
+        if (tsdb_scan(dir, argv[i], res, from, to, print_point, &ctx) < 0) {
+            fprintf(stderr, "No %s series %s in %s\n", tsdb_resolution_name(res), argv[i], dir);
+            status = 1;
+        }
+    }
+    return status;
+}